@@ -0,0 +1,37 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include "common/uncopyable.h"
+
+#include <cstddef>
+
+// A whole file mapped read only into memory. Pages are read from disk as
+// they're first touched, so opening a large file costs next to nothing.
+class MappedFile : public Uncopyable
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// Returns false if the file can't be opened or mapped. An empty file
+	// opens with a null data().
+	bool open( char const *filename );
+	void close();
+
+	bool is_open() const { return m_open; }
+	unsigned char const *data() const { return m_data; }
+	size_t size() const { return m_size; }
+
+private:
+	unsigned char const *m_data;
+	size_t m_size;
+	bool m_open;
+#ifdef _WIN32
+	void *m_file;
+	void *m_mapping;
+#else
+	int m_file;
+#endif
+};
+
+#endif //MAPPEDFILE_H
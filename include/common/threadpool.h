@@ -0,0 +1,87 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "common/uncopyable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running queued jobs
+class ThreadPool : public Uncopyable
+{
+public:
+	// One thread per core if threads isn't given
+	explicit ThreadPool( int threads = 0 );
+	~ThreadPool();
+
+	int thread_count() const { return int( m_threads.size() ); }
+
+	void run( std::function< void() > job );
+
+	// Blocks until every job queued so far has finished
+	void wait();
+
+	// Calls func( i ) for i in [0, n) across the workers and the calling
+	// thread, returning once all calls have finished, or at once if n isn't
+	// positive. Indices are handed out one at a time so uneven work balances
+	// itself. Don't call it from inside a job, as the workers it waits on may
+	// all be busy waiting themselves.
+	template< typename F >
+	void parallel_for( int n, F func );
+
+private:
+	void worker();
+
+	std::vector< std::thread > m_threads;
+	std::deque< std::function< void() > > m_jobs;
+	std::mutex m_mutex;
+	std::condition_variable m_job_ready;
+	std::condition_variable m_all_done;
+	int m_pending;
+	bool m_stop;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename F >
+void ThreadPool::parallel_for( int n, F func )
+{
+	if( n <= 0 )
+		return;
+
+	std::atomic< int > next( 0 );
+	auto loop = [&next, n, &func]()
+	{
+		for( int i = next++; i < n; i = next++ )
+			func( i );
+	};
+
+	// The calling thread takes a share, so a single index needs no helpers
+	int helpers = std::max( std::min( thread_count(), n - 1 ), 0 );
+	std::atomic< int > running( helpers );
+	std::mutex done_mutex;
+	std::condition_variable done;
+	for( int t = 0; t < helpers; ++t )
+		run( [&]()
+		{
+			loop();
+			std::lock_guard< std::mutex > lock( done_mutex );
+			if( --running == 0 )
+				done.notify_one();
+		} );
+
+	loop();
+
+	std::unique_lock< std::mutex > lock( done_mutex );
+	done.wait( lock, [&running]() { return running == 0; } );
+}
+
+#endif // THREADPOOL_H
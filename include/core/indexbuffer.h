@@ -10,7 +10,7 @@ class IndexBuffer : public Shared
 {
 public:
 	typedef SharedPtr< IndexBuffer > Ptr;
-	explicit IndexBuffer( int count = 0, unsigned int *indices = 0, bool dynamic = false ) : m_dynamic( dynamic ), m_gl_buffer( 0 )
+	explicit IndexBuffer( int count = 0, unsigned int const *indices = 0, bool dynamic = false ) : m_dynamic( dynamic ), m_gl_buffer( 0 )
 	{
 		if( count ) m_indices.resize( count );
 		if( count && indices ) std::copy( indices, indices + count, m_indices.begin() );
@@ -26,8 +26,8 @@ public:
 private:
 	std::vector< unsigned int > m_indices;
 	bool m_dynamic;
-
-	unsigned int m_gl_buffer;
+
+	unsigned int m_gl_buffer;
 };
 
 #endif // INDEXBUFFER_H
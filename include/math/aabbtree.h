@@ -0,0 +1,70 @@
+#ifndef AABBTREE_H
+#define AABBTREE_H
+
+#include "math/frustum.h"
+#include "math/vec3.h"
+
+#include <vector>
+
+// A bounding volume hierarchy over boxes that come and go and move about,
+// for culling many boxes against a frustum without testing each one.
+//
+// Boxes are named by handles, which stay the same until the box is removed.
+// Adding or removing boxes rebuilds the tree, top down, the next time it is
+// culled. Moving a box just refits the boxes above it, which keeps the tree
+// correct but looser, so it is also rebuilt once there have been as many
+// moves as boxes since it was built.
+class AABBTree
+{
+public:
+	AABBTree();
+
+	int insert( AABB const &box );
+	void remove( int handle );
+	void move( int handle, AABB const &box );
+
+	AABB const &box( int handle ) const { return m_boxes[ handle ]; }
+
+	void rebuild();
+
+	// Sets bit handle % 32 of word handle / 32 for each box intersecting the
+	// frustum, as FrustumCuller does for its indices. Boxes under a node wholly
+	// inside are taken without testing them, and those of a leaf straddling
+	// the frustum are tested together by FrustumCuller.
+	void cull( Frustum const &f, std::vector< unsigned int > &visible );
+	// The same, but listing the handles of the boxes intersecting the frustum
+	// in handles, so using them costs what is seen rather than every box
+	void cull( Frustum const &f, std::vector< int > &handles );
+
+	// Returns how many tree nodes the last cull tested
+	int tested() const { return m_tested; }
+
+private:
+	struct Node
+	{
+		float3 lo, hi;
+		int parent;
+		int right;       // -1 for a leaf, else the left child is the next node
+		int first, last; // The boxes below, in m_order
+	};
+
+	int build( int parent, int first, int last );
+	// Calls take( i ) for the place in m_order of each box intersecting
+	template< typename Take >
+	void cull( int n, int planes, FrustumCuller const &c, Take &take );
+	// Rebuilds the tree if boxes have come or gone, or moved enough
+	void prepare();
+
+	std::vector< AABB > m_boxes;    // Per handle
+	std::vector< int > m_leaf;      // Per handle, its node, or -1 if removed
+	std::vector< int > m_free;
+	std::vector< Node > m_nodes;
+	std::vector< int > m_order;     // Handles in the order of the leaves
+	AABBArray m_sorted;             // Their boxes, in the same order
+	std::vector< float3 > m_centres;
+	bool m_rebuild;
+	int m_moves; // Since the last rebuild
+	int m_tested;
+};
+
+#endif //AABBTREE_H
@@ -3,6 +3,8 @@
 
 #include "math/mat44.h"
 
+#include <vector>
+
 struct AABB;
 
 class Frustum
@@ -12,6 +14,8 @@ public:
 
 	bool intersect_sphere( float3 const &p, float radius ) const;
 	bool intersect_aabb( AABB const &aabb ) const;
+
+	float4 const &plane( int i ) const {return m_planes[i];}
 private:
 	float4 m_planes[6];
 };
@@ -30,4 +34,46 @@ struct AABB
 	float3 half_size;
 };
 
+// The smallest AABB holding box once transformed by m
+AABB transform_aabb( float44 const &m, AABB const &box );
+
+// Structure of arrays AABB storage for FrustumCuller
+struct AABBArray
+{
+	void clear();
+	void reserve( size_t size );
+	void push_back( AABB const &aabb );
+	void set( size_t i, AABB const &aabb );
+	size_t size() const {return mid_x.size();}
+
+	std::vector< float > mid_x, mid_y, mid_z;
+	std::vector< float > half_x, half_y, half_z;
+};
+
+// Tests many boxes against a frustum, a SIMD register of boxes at a time.
+// The result is a bitmask with bit i % 32 of word i / 32 set if box i
+// intersects the frustum, so it can be computed once and shared by every
+// pass that draws with the same frustum.
+class FrustumCuller
+{
+public:
+	explicit FrustumCuller( Frustum const &f );
+
+	void cull( AABBArray const &boxes, std::vector< unsigned int > &visible ) const;
+
+	// Tests the count boxes from first, at most 32, against just the planes
+	// set in the low six bits of planes. Bit i of the result is set if box
+	// first + i is not wholly outside any of them.
+	unsigned int cull( AABBArray const &boxes, size_t first, size_t count, int planes = 0x3f ) const;
+
+	Frustum const &frustum() const { return m_frustum; }
+
+	static bool is_visible( std::vector< unsigned int > const &visible, size_t i )
+	{
+		return ( visible[i / 32] >> ( i % 32 ) & 1 ) != 0;
+	}
+private:
+	Frustum m_frustum;
+};
+
 #endif
@@ -4,6 +4,7 @@
 #include <math.h>
 
 #include "vec4.h"
+#include "simd.h"
 
 template< typename T >
 struct mat44
@@ -154,4 +155,159 @@ template< typename T >  mat44<T> look_at( vec4<T> const &pos, vec4<T> const &tar
 	return ret;
 }
 
+// float specializations. The columns of a float44 are contiguous so each one
+// loads straight into a vector register; the generic templates above remain
+// the fallback for other scalar types and for builds without SIMD.
+
+#if defined( GRT_SIMD_SSE ) || defined( GRT_SIMD_NEON )
+
+template<>  inline vec4<float> operator*( mat44<float> const &a, vec4<float> const &b )
+{
+	simd::f4 v = simd::f4::load( &b.x );
+	simd::f4 r = simd::f4::load( &a.i.x ) * simd::lane<0>( v );
+	r = simd::madd( simd::f4::load( &a.j.x ), simd::lane<1>( v ), r );
+	r = simd::madd( simd::f4::load( &a.k.x ), simd::lane<2>( v ), r );
+	r = simd::madd( simd::f4::load( &a.t.x ), simd::lane<3>( v ), r );
+	vec4<float> ret;
+	r.store( &ret.x );
+	return ret;
+}
+
+template<>  inline mat44<float> operator*( mat44<float> const &a, mat44<float> const & b )
+{
+	mat44<float> ret;
+#if defined( GRT_SIMD_AVX )
+	// Two result columns per 256 bit register
+	__m256 ai = _mm256_broadcast_ps( reinterpret_cast< __m128 const * >( &a.i.x ) );
+	__m256 aj = _mm256_broadcast_ps( reinterpret_cast< __m128 const * >( &a.j.x ) );
+	__m256 ak = _mm256_broadcast_ps( reinterpret_cast< __m128 const * >( &a.k.x ) );
+	__m256 at = _mm256_broadcast_ps( reinterpret_cast< __m128 const * >( &a.t.x ) );
+	for( int c = 0; c != 16; c += 8 )
+	{
+		__m256 bc = _mm256_loadu_ps( &b.i.x + c );
+		__m256 r = _mm256_mul_ps( ai, _mm256_shuffle_ps( bc, bc, 0x00 ) );
+		r = _mm256_add_ps( r, _mm256_mul_ps( aj, _mm256_shuffle_ps( bc, bc, 0x55 ) ) );
+		r = _mm256_add_ps( r, _mm256_mul_ps( ak, _mm256_shuffle_ps( bc, bc, 0xaa ) ) );
+		r = _mm256_add_ps( r, _mm256_mul_ps( at, _mm256_shuffle_ps( bc, bc, 0xff ) ) );
+		_mm256_storeu_ps( &ret.i.x + c, r );
+	}
+#else
+	simd::f4 ai = simd::f4::load( &a.i.x );
+	simd::f4 aj = simd::f4::load( &a.j.x );
+	simd::f4 ak = simd::f4::load( &a.k.x );
+	simd::f4 at = simd::f4::load( &a.t.x );
+	for( int c = 0; c != 4; ++c )
+	{
+		simd::f4 bc = simd::f4::load( &b[c].x );
+		simd::f4 r = ai * simd::lane<0>( bc );
+		r = simd::madd( aj, simd::lane<1>( bc ), r );
+		r = simd::madd( ak, simd::lane<2>( bc ), r );
+		r = simd::madd( at, simd::lane<3>( bc ), r );
+		r.store( &ret[c].x );
+	}
+#endif
+	return ret;
+}
+
+template<>  inline mat44<float> transpose( mat44<float> const &m )
+{
+	mat44<float> ret;
+#if defined( GRT_SIMD_NEON )
+	float32x4x4_t rows = vld4q_f32( &m.i.x );
+	for( int c = 0; c != 4; ++c )
+		vst1q_f32( &ret[c].x, rows.val[c] );
+#else
+	simd::f4 i = simd::f4::load( &m.i.x );
+	simd::f4 j = simd::f4::load( &m.j.x );
+	simd::f4 k = simd::f4::load( &m.k.x );
+	simd::f4 t = simd::f4::load( &m.t.x );
+	simd::transpose( i, j, k, t );
+	i.store( &ret.i.x );
+	j.store( &ret.j.x );
+	k.store( &ret.k.x );
+	t.store( &ret.t.x );
+#endif
+	return ret;
+}
+
+template<>  inline mat44<float> inverse( mat44<float> const &m )
+{
+	// Cramer's rule with the cofactors computed two at a time (after Intel's
+	// "Streaming SIMD Extensions - Inverse of 4x4 Matrix"). Rows 1 and 3 of
+	// the transposed input are kept with their halves swapped.
+	using namespace simd;
+	f4 row0 = f4::load( &m.i.x );
+	f4 row1 = f4::load( &m.j.x );
+	f4 row2 = f4::load( &m.k.x );
+	f4 row3 = f4::load( &m.t.x );
+	transpose( row0, row1, row2, row3 );
+	row1 = swap_halves( row1 );
+	row3 = swap_halves( row3 );
+
+	f4 minor0, minor1, minor2, minor3, tmp;
+
+	tmp = swap_pairs( row2 * row3 );
+	minor0 = row1 * tmp;
+	minor1 = row0 * tmp;
+	tmp = swap_halves( tmp );
+	minor0 = row1 * tmp - minor0;
+	minor1 = swap_halves( row0 * tmp - minor1 );
+
+	tmp = swap_pairs( row1 * row2 );
+	minor0 = madd( row3, tmp, minor0 );
+	minor3 = row0 * tmp;
+	tmp = swap_halves( tmp );
+	minor0 = minor0 - row3 * tmp;
+	minor3 = swap_halves( row0 * tmp - minor3 );
+
+	tmp = swap_pairs( swap_halves( row1 ) * row3 );
+	row2 = swap_halves( row2 );
+	minor0 = madd( row2, tmp, minor0 );
+	minor2 = row0 * tmp;
+	tmp = swap_halves( tmp );
+	minor0 = minor0 - row2 * tmp;
+	minor2 = swap_halves( row0 * tmp - minor2 );
+
+	tmp = swap_pairs( row0 * row1 );
+	minor2 = madd( row3, tmp, minor2 );
+	minor3 = row2 * tmp - minor3;
+	tmp = swap_halves( tmp );
+	minor2 = row3 * tmp - minor2;
+	minor3 = minor3 - row2 * tmp;
+
+	tmp = swap_pairs( row0 * row3 );
+	minor1 = minor1 - row2 * tmp;
+	minor2 = madd( row1, tmp, minor2 );
+	tmp = swap_halves( tmp );
+	minor1 = madd( row2, tmp, minor1 );
+	minor2 = minor2 - row1 * tmp;
+
+	tmp = swap_pairs( row0 * row2 );
+	minor1 = madd( row3, tmp, minor1 );
+	minor3 = minor3 - row1 * tmp;
+	tmp = swap_halves( tmp );
+	minor1 = minor1 - row3 * tmp;
+	minor3 = madd( row1, tmp, minor3 );
+
+	// As in the generic version a singular matrix returns the unscaled adjugate
+	float det = hsum( row0 * minor0 );
+	if( det != 0 )
+	{
+		f4 rdet( 1 / det );
+		minor0 = minor0 * rdet;
+		minor1 = minor1 * rdet;
+		minor2 = minor2 * rdet;
+		minor3 = minor3 * rdet;
+	}
+
+	mat44<float> inverted;
+	minor0.store( &inverted.i.x );
+	minor1.store( &inverted.j.x );
+	minor2.store( &inverted.k.x );
+	minor3.store( &inverted.t.x );
+	return inverted;
+}
+
+#endif
+
 #endif
@@ -3,6 +3,20 @@
 
 #include "vec3.h"
 
+#include <stddef.h>
+
 float perlin( float3 v );
 
+// Octaves of perlin noise, each lacunarity times the frequency and gain times
+// the amplitude of the one before. turbulence sums the absolute values.
+float fbm( float3 v, int octaves, float lacunarity = 2.f, float gain = 0.5f );
+float turbulence( float3 v, int octaves, float lacunarity = 2.f, float gain = 0.5f );
+
+// As above for n points at a time. Builds with AVX2 enabled evaluate eight
+// points at once; others, including the default CMake build, loop over the
+// scalar versions.
+void perlin_batch( float3 const *pts, float *out, size_t n );
+void fbm_batch( float3 const *pts, float *out, size_t n, int octaves, float lacunarity = 2.f, float gain = 0.5f );
+void turbulence_batch( float3 const *pts, float *out, size_t n, int octaves, float lacunarity = 2.f, float gain = 0.5f );
+
 #endif //PERLIN_H
@@ -0,0 +1,349 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Compile time selection of the vector instruction set used by the math
+// kernels. GRT_SIMD_SSE is set for x86 builds with SSE2 (GRT_SIMD_AVX as well
+// when compiling with AVX enabled) and GRT_SIMD_NEON for ARM builds with NEON.
+// Define GRT_NO_SIMD to build the scalar fallbacks everywhere.
+
+#if !defined( GRT_NO_SIMD )
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define GRT_SIMD_SSE
+#if defined( __AVX__ )
+#define GRT_SIMD_AVX
+#endif
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#define GRT_SIMD_NEON
+#endif
+#endif
+
+#if defined( GRT_SIMD_AVX )
+#include <immintrin.h>
+#elif defined( GRT_SIMD_SSE ) && defined( __SSE4_1__ )
+#include <smmintrin.h>
+#elif defined( GRT_SIMD_SSE )
+#include <emmintrin.h>
+#elif defined( GRT_SIMD_NEON )
+#include <arm_neon.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+namespace simd
+{
+
+// Four floats in a vector register. Comparisons return masks with all bits
+// of a lane set where the comparison is true, for use with select(), the
+// bitwise operators and movemask().
+struct f4
+{
+#if defined( GRT_SIMD_SSE )
+	typedef __m128 native;
+#elif defined( GRT_SIMD_NEON )
+	typedef float32x4_t native;
+#else
+	struct native { float v[4]; };
+#endif
+
+	f4() {}
+	f4( native v ) : v( v ) {}
+	explicit f4( float s );
+
+	static f4 load( float const *p );
+	void store( float *p ) const;
+
+	native v;
+};
+
+f4 operator+( f4 a, f4 b );
+f4 operator-( f4 a, f4 b );
+f4 operator*( f4 a, f4 b );
+f4 operator/( f4 a, f4 b );
+f4 operator-( f4 a );
+
+f4 operator<( f4 a, f4 b );
+f4 operator>( f4 a, f4 b );
+f4 operator<=( f4 a, f4 b );
+f4 operator>=( f4 a, f4 b );
+
+f4 operator&( f4 a, f4 b );
+f4 operator|( f4 a, f4 b );
+f4 andnot( f4 a, f4 b );        // ~a & b
+f4 select( f4 mask, f4 a, f4 b ); // mask ? a : b
+int movemask( f4 mask );         // Bit n set if lane n of mask is set
+
+f4 min( f4 a, f4 b );
+f4 max( f4 a, f4 b );
+f4 abs( f4 a );
+f4 floor( f4 a );
+f4 madd( f4 a, f4 b, f4 c );    // a * b + c
+
+template< int I > f4 lane( f4 a ); // Broadcast lane I
+f4 swap_pairs( f4 a );            // ( y, x, w, z )
+f4 swap_halves( f4 a );           // ( z, w, x, y )
+float hsum( f4 a );
+void transpose( f4 &a, f4 &b, f4 &c, f4 &d );
+
+#if defined( GRT_SIMD_AVX )
+
+// Eight floats in an AVX register, with the same operations as f4
+struct f8
+{
+	typedef __m256 native;
+
+	f8() {}
+	f8( native v ) : v( v ) {}
+	explicit f8( float s ) : v( _mm256_set1_ps( s ) ) {}
+
+	static f8 load( float const *p ) { return _mm256_loadu_ps( p ); }
+	void store( float *p ) const { _mm256_storeu_ps( p, v ); }
+
+	native v;
+};
+
+// The widest vector available, for kernels that process independent lanes
+typedef f8 fwide;
+#else
+typedef f4 fwide;
+#endif
+
+const int wide_width = sizeof( fwide ) / sizeof( float );
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+#if defined( GRT_SIMD_SSE )
+
+inline f4::f4( float s ) : v( _mm_set1_ps( s ) ) {}
+inline f4 f4::load( float const *p ) { return _mm_loadu_ps( p ); }
+inline void f4::store( float *p ) const { _mm_storeu_ps( p, v ); }
+
+inline f4 operator+( f4 a, f4 b ) { return _mm_add_ps( a.v, b.v ); }
+inline f4 operator-( f4 a, f4 b ) { return _mm_sub_ps( a.v, b.v ); }
+inline f4 operator*( f4 a, f4 b ) { return _mm_mul_ps( a.v, b.v ); }
+inline f4 operator/( f4 a, f4 b ) { return _mm_div_ps( a.v, b.v ); }
+inline f4 operator-( f4 a ) { return _mm_xor_ps( a.v, _mm_set1_ps( -0.f ) ); }
+
+inline f4 operator<( f4 a, f4 b ) { return _mm_cmplt_ps( a.v, b.v ); }
+inline f4 operator>( f4 a, f4 b ) { return _mm_cmpgt_ps( a.v, b.v ); }
+inline f4 operator<=( f4 a, f4 b ) { return _mm_cmple_ps( a.v, b.v ); }
+inline f4 operator>=( f4 a, f4 b ) { return _mm_cmpge_ps( a.v, b.v ); }
+
+inline f4 operator&( f4 a, f4 b ) { return _mm_and_ps( a.v, b.v ); }
+inline f4 operator|( f4 a, f4 b ) { return _mm_or_ps( a.v, b.v ); }
+inline f4 andnot( f4 a, f4 b ) { return _mm_andnot_ps( a.v, b.v ); }
+inline f4 select( f4 mask, f4 a, f4 b ) { return _mm_or_ps( _mm_and_ps( mask.v, a.v ), _mm_andnot_ps( mask.v, b.v ) ); }
+inline int movemask( f4 mask ) { return _mm_movemask_ps( mask.v ); }
+
+inline f4 min( f4 a, f4 b ) { return _mm_min_ps( a.v, b.v ); }
+inline f4 max( f4 a, f4 b ) { return _mm_max_ps( a.v, b.v ); }
+inline f4 abs( f4 a ) { return _mm_andnot_ps( _mm_set1_ps( -0.f ), a.v ); }
+inline f4 floor( f4 a )
+{
+#if defined( __SSE4_1__ ) || defined( GRT_SIMD_AVX )
+	return _mm_floor_ps( a.v );
+#else
+	// Truncate, then step down where truncation rounded up (negative inputs).
+	// Floats from 2^23 up are whole already, and may not fit an int, so they
+	// and NaNs are passed through.
+	__m128 t = _mm_cvtepi32_ps( _mm_cvttps_epi32( a.v ) );
+	t = _mm_sub_ps( t, _mm_and_ps( _mm_cmpgt_ps( t, a.v ), _mm_set1_ps( 1.f ) ) );
+	__m128 small = _mm_cmplt_ps( abs( a ).v, _mm_set1_ps( 8388608.f ) );
+	return _mm_or_ps( _mm_and_ps( small, t ), _mm_andnot_ps( small, a.v ) );
+#endif
+}
+inline f4 madd( f4 a, f4 b, f4 c ) { return _mm_add_ps( _mm_mul_ps( a.v, b.v ), c.v ); }
+
+template< int I > f4 lane( f4 a ) { return _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( I, I, I, I ) ); }
+inline f4 swap_pairs( f4 a ) { return _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 2, 3, 0, 1 ) ); }
+inline f4 swap_halves( f4 a ) { return _mm_shuffle_ps( a.v, a.v, _MM_SHUFFLE( 1, 0, 3, 2 ) ); }
+inline float hsum( f4 a )
+{
+	__m128 s = _mm_add_ps( a.v, swap_halves( a ).v );
+	s = _mm_add_ss( s, _mm_shuffle_ps( s, s, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+	return _mm_cvtss_f32( s );
+}
+inline void transpose( f4 &a, f4 &b, f4 &c, f4 &d )
+{
+	_MM_TRANSPOSE4_PS( a.v, b.v, c.v, d.v );
+}
+
+#elif defined( GRT_SIMD_NEON )
+
+namespace detail
+{
+inline f4 from_mask( uint32x4_t m ) { return vreinterpretq_f32_u32( m ); }
+inline uint32x4_t to_mask( f4 a ) { return vreinterpretq_u32_f32( a.v ); }
+}
+
+inline f4::f4( float s ) : v( vdupq_n_f32( s ) ) {}
+inline f4 f4::load( float const *p ) { return vld1q_f32( p ); }
+inline void f4::store( float *p ) const { vst1q_f32( p, v ); }
+
+inline f4 operator+( f4 a, f4 b ) { return vaddq_f32( a.v, b.v ); }
+inline f4 operator-( f4 a, f4 b ) { return vsubq_f32( a.v, b.v ); }
+inline f4 operator*( f4 a, f4 b ) { return vmulq_f32( a.v, b.v ); }
+inline f4 operator/( f4 a, f4 b )
+{
+#if defined( __aarch64__ )
+	return vdivq_f32( a.v, b.v );
+#else
+	// ARMv7 has no vector divide: refine the reciprocal estimate twice
+	float32x4_t r = vrecpeq_f32( b.v );
+	r = vmulq_f32( vrecpsq_f32( b.v, r ), r );
+	r = vmulq_f32( vrecpsq_f32( b.v, r ), r );
+	return vmulq_f32( a.v, r );
+#endif
+}
+inline f4 operator-( f4 a ) { return vnegq_f32( a.v ); }
+
+inline f4 operator<( f4 a, f4 b ) { return detail::from_mask( vcltq_f32( a.v, b.v ) ); }
+inline f4 operator>( f4 a, f4 b ) { return detail::from_mask( vcgtq_f32( a.v, b.v ) ); }
+inline f4 operator<=( f4 a, f4 b ) { return detail::from_mask( vcleq_f32( a.v, b.v ) ); }
+inline f4 operator>=( f4 a, f4 b ) { return detail::from_mask( vcgeq_f32( a.v, b.v ) ); }
+
+inline f4 operator&( f4 a, f4 b ) { return detail::from_mask( vandq_u32( detail::to_mask( a ), detail::to_mask( b ) ) ); }
+inline f4 operator|( f4 a, f4 b ) { return detail::from_mask( vorrq_u32( detail::to_mask( a ), detail::to_mask( b ) ) ); }
+inline f4 andnot( f4 a, f4 b ) { return detail::from_mask( vbicq_u32( detail::to_mask( b ), detail::to_mask( a ) ) ); }
+inline f4 select( f4 mask, f4 a, f4 b ) { return vbslq_f32( detail::to_mask( mask ), a.v, b.v ); }
+inline int movemask( f4 mask )
+{
+	uint32x4_t m = vshrq_n_u32( detail::to_mask( mask ), 31 );
+	return vgetq_lane_u32( m, 0 ) | ( vgetq_lane_u32( m, 1 ) << 1 ) |
+	       ( vgetq_lane_u32( m, 2 ) << 2 ) | ( vgetq_lane_u32( m, 3 ) << 3 );
+}
+
+inline f4 min( f4 a, f4 b ) { return vminq_f32( a.v, b.v ); }
+inline f4 max( f4 a, f4 b ) { return vmaxq_f32( a.v, b.v ); }
+inline f4 abs( f4 a ) { return vabsq_f32( a.v ); }
+inline f4 floor( f4 a )
+{
+#if defined( __aarch64__ )
+	return vrndmq_f32( a.v );
+#else
+	// As for SSE, passing through floats too big to convert and NaNs
+	float32x4_t t = vcvtq_f32_s32( vcvtq_s32_f32( a.v ) );
+	uint32x4_t one = vreinterpretq_u32_f32( vdupq_n_f32( 1.f ) );
+	t = vsubq_f32( t, vreinterpretq_f32_u32( vandq_u32( vcgtq_f32( t, a.v ), one ) ) );
+	return vbslq_f32( vcltq_f32( vabsq_f32( a.v ), vdupq_n_f32( 8388608.f ) ), t, a.v );
+#endif
+}
+inline f4 madd( f4 a, f4 b, f4 c ) { return vmlaq_f32( c.v, a.v, b.v ); }
+
+template< int I > f4 lane( f4 a )
+{
+	return vdupq_lane_f32( I < 2 ? vget_low_f32( a.v ) : vget_high_f32( a.v ), I & 1 );
+}
+inline f4 swap_pairs( f4 a ) { return vrev64q_f32( a.v ); }
+inline f4 swap_halves( f4 a ) { return vextq_f32( a.v, a.v, 2 ); }
+inline float hsum( f4 a )
+{
+	float32x2_t s = vadd_f32( vget_low_f32( a.v ), vget_high_f32( a.v ) );
+	return vget_lane_f32( vpadd_f32( s, s ), 0 );
+}
+inline void transpose( f4 &a, f4 &b, f4 &c, f4 &d )
+{
+	float32x4x2_t ab = vtrnq_f32( a.v, b.v );
+	float32x4x2_t cd = vtrnq_f32( c.v, d.v );
+	a = vcombine_f32( vget_low_f32( ab.val[0] ),  vget_low_f32( cd.val[0] ) );
+	b = vcombine_f32( vget_low_f32( ab.val[1] ),  vget_low_f32( cd.val[1] ) );
+	c = vcombine_f32( vget_high_f32( ab.val[0] ), vget_high_f32( cd.val[0] ) );
+	d = vcombine_f32( vget_high_f32( ab.val[1] ), vget_high_f32( cd.val[1] ) );
+}
+
+#else // Scalar fallback
+
+namespace detail
+{
+inline unsigned int bits( float f ) { unsigned int u; memcpy( &u, &f, sizeof( u ) ); return u; }
+inline float from_bits( unsigned int u ) { float f; memcpy( &f, &u, sizeof( f ) ); return f; }
+inline float mask( bool b ) { return from_bits( b ? 0xffffffffu : 0u ); }
+}
+
+#define GRT_SIMD_LANES( expr ) f4 r; for( int n = 0; n != 4; ++n ) r.v.v[n] = ( expr ); return r;
+
+inline f4::f4( float s ) { for( int n = 0; n != 4; ++n ) v.v[n] = s; }
+inline f4 f4::load( float const *p ) { f4 r; memcpy( r.v.v, p, sizeof( r.v.v ) ); return r; }
+inline void f4::store( float *p ) const { memcpy( p, v.v, sizeof( v.v ) ); }
+
+inline f4 operator+( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] + b.v.v[n] ) }
+inline f4 operator-( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] - b.v.v[n] ) }
+inline f4 operator*( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] * b.v.v[n] ) }
+inline f4 operator/( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] / b.v.v[n] ) }
+inline f4 operator-( f4 a ) { GRT_SIMD_LANES( -a.v.v[n] ) }
+
+inline f4 operator<( f4 a, f4 b ) { GRT_SIMD_LANES( detail::mask( a.v.v[n] < b.v.v[n] ) ) }
+inline f4 operator>( f4 a, f4 b ) { GRT_SIMD_LANES( detail::mask( a.v.v[n] > b.v.v[n] ) ) }
+inline f4 operator<=( f4 a, f4 b ) { GRT_SIMD_LANES( detail::mask( a.v.v[n] <= b.v.v[n] ) ) }
+inline f4 operator>=( f4 a, f4 b ) { GRT_SIMD_LANES( detail::mask( a.v.v[n] >= b.v.v[n] ) ) }
+
+inline f4 operator&( f4 a, f4 b ) { GRT_SIMD_LANES( detail::from_bits( detail::bits( a.v.v[n] ) & detail::bits( b.v.v[n] ) ) ) }
+inline f4 operator|( f4 a, f4 b ) { GRT_SIMD_LANES( detail::from_bits( detail::bits( a.v.v[n] ) | detail::bits( b.v.v[n] ) ) ) }
+inline f4 andnot( f4 a, f4 b ) { GRT_SIMD_LANES( detail::from_bits( ~detail::bits( a.v.v[n] ) & detail::bits( b.v.v[n] ) ) ) }
+inline f4 select( f4 mask, f4 a, f4 b ) { GRT_SIMD_LANES( detail::bits( mask.v.v[n] ) ? a.v.v[n] : b.v.v[n] ) }
+inline int movemask( f4 mask )
+{
+	int m = 0;
+	for( int n = 0; n != 4; ++n )
+		m |= ( detail::bits( mask.v.v[n] ) >> 31 ) << n;
+	return m;
+}
+
+inline f4 min( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] < b.v.v[n] ? a.v.v[n] : b.v.v[n] ) }
+inline f4 max( f4 a, f4 b ) { GRT_SIMD_LANES( a.v.v[n] > b.v.v[n] ? a.v.v[n] : b.v.v[n] ) }
+inline f4 abs( f4 a ) { GRT_SIMD_LANES( a.v.v[n] < 0.f ? -a.v.v[n] : a.v.v[n] ) }
+inline f4 floor( f4 a ) { GRT_SIMD_LANES( ::floorf( a.v.v[n] ) ) }
+inline f4 madd( f4 a, f4 b, f4 c ) { GRT_SIMD_LANES( a.v.v[n] * b.v.v[n] + c.v.v[n] ) }
+
+template< int I > f4 lane( f4 a ) { return f4( a.v.v[I] ); }
+inline f4 swap_pairs( f4 a ) { GRT_SIMD_LANES( a.v.v[n ^ 1] ) }
+inline f4 swap_halves( f4 a ) { GRT_SIMD_LANES( a.v.v[n ^ 2] ) }
+inline float hsum( f4 a ) { return ( a.v.v[0] + a.v.v[2] ) + ( a.v.v[1] + a.v.v[3] ); }
+inline void transpose( f4 &a, f4 &b, f4 &c, f4 &d )
+{
+	f4 *rows[4] = { &a, &b, &c, &d };
+	for( int i = 0; i != 4; ++i )
+		for( int j = i + 1; j != 4; ++j )
+		{
+			float t = rows[i]->v.v[j];
+			rows[i]->v.v[j] = rows[j]->v.v[i];
+			rows[j]->v.v[i] = t;
+		}
+}
+
+#undef GRT_SIMD_LANES
+
+#endif
+
+#if defined( GRT_SIMD_AVX )
+
+inline f8 operator+( f8 a, f8 b ) { return _mm256_add_ps( a.v, b.v ); }
+inline f8 operator-( f8 a, f8 b ) { return _mm256_sub_ps( a.v, b.v ); }
+inline f8 operator*( f8 a, f8 b ) { return _mm256_mul_ps( a.v, b.v ); }
+inline f8 operator/( f8 a, f8 b ) { return _mm256_div_ps( a.v, b.v ); }
+inline f8 operator-( f8 a ) { return _mm256_xor_ps( a.v, _mm256_set1_ps( -0.f ) ); }
+
+inline f8 operator<( f8 a, f8 b ) { return _mm256_cmp_ps( a.v, b.v, _CMP_LT_OQ ); }
+inline f8 operator>( f8 a, f8 b ) { return _mm256_cmp_ps( a.v, b.v, _CMP_GT_OQ ); }
+inline f8 operator<=( f8 a, f8 b ) { return _mm256_cmp_ps( a.v, b.v, _CMP_LE_OQ ); }
+inline f8 operator>=( f8 a, f8 b ) { return _mm256_cmp_ps( a.v, b.v, _CMP_GE_OQ ); }
+
+inline f8 operator&( f8 a, f8 b ) { return _mm256_and_ps( a.v, b.v ); }
+inline f8 operator|( f8 a, f8 b ) { return _mm256_or_ps( a.v, b.v ); }
+inline f8 andnot( f8 a, f8 b ) { return _mm256_andnot_ps( a.v, b.v ); }
+inline f8 select( f8 mask, f8 a, f8 b ) { return _mm256_blendv_ps( b.v, a.v, mask.v ); }
+inline int movemask( f8 mask ) { return _mm256_movemask_ps( mask.v ); }
+
+inline f8 min( f8 a, f8 b ) { return _mm256_min_ps( a.v, b.v ); }
+inline f8 max( f8 a, f8 b ) { return _mm256_max_ps( a.v, b.v ); }
+inline f8 abs( f8 a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.f ), a.v ); }
+inline f8 floor( f8 a ) { return _mm256_floor_ps( a.v ); }
+inline f8 madd( f8 a, f8 b, f8 c ) { return _mm256_add_ps( _mm256_mul_ps( a.v, b.v ), c.v ); }
+
+#endif
+
+} // namespace simd
+
+#endif // SIMD_H
@@ -0,0 +1,25 @@
+#ifndef SIMPLEX_H
+#define SIMPLEX_H
+
+#include "vec2.h"
+#include "vec3.h"
+#include "vec4.h"
+
+#include <stddef.h>
+
+// Simplex noise in the range [-1, 1]
+float simplex( float2 v );
+float simplex( float3 v );
+float simplex( float4 v );
+
+// As above, also returning the analytic gradient of the noise at v. This
+// costs a little more than the value alone but far less than the extra
+// evaluations needed to find the gradient by differencing.
+float simplex( float2 v, float2 &grad );
+float simplex( float3 v, float3 &grad );
+float simplex( float4 v, float4 &grad );
+
+// simplex() for n points. grad may be null if gradients aren't needed.
+void simplex_batch( float3 const *pts, float *out, float3 *grad, size_t n );
+
+#endif //SIMPLEX_H
@@ -47,23 +47,56 @@ class KeyData : public Shared
 public:
 	typedef SharedPtr< KeyData< T > > Ptr;
 
-	T get( double time )
+	T get( double time ) const
 	{
 		if( m_times.empty() )
 			return T();
+		return sample( time, int( std::upper_bound( m_times.begin(), m_times.end(), time ) - m_times.begin() ) );
+	}
 
-		auto after = std::upper_bound( m_times.begin(), m_times.end(), time );
-
-		if( after == m_times.end() )
-			return m_keys.back();
-		if( after == m_times.begin() )
-			return m_keys.front();
-
-		int i_after = after - m_times.begin();
-		int i_before = i_after - 1;
+	// As get( time ), for a caller sampling at times that mostly move
+	// forward. cursor is where the last call found time among the keys, 0 to
+	// start, and each caller keeps its own so the keys can be shared. The
+	// keys are searched by galloping from the cursor in whichever direction
+	// time moved, probing 1, 2, 4... keys away before a binary search of the
+	// last gap, so a nearby time takes a few comparisons and a seek about
+	// twice as many as a binary search.
+	T get( double time, int &cursor ) const
+	{
+		int count = int( m_times.size() );
+		if( !count )
+			return T();
 
-		return interp( m_keys[i_before], m_keys[i_after],
-			( time - m_times[i_before] ) / ( m_times[i_after] - m_times[i_before] ) );
+		typename std::vector< double >::const_iterator times = m_times.begin();
+		int after = cursor;
+		if( after < 0 || after > count )
+			after = int( std::upper_bound( times, m_times.end(), time ) - times );
+		else if( after > 0 && m_times[ after - 1 ] > time )
+		{
+			// Keys from hi on are later than time
+			int hi = after - 1, lo = hi - 1;
+			for( int step = 1; lo >= 0 && m_times[ lo ] > time; step *= 2 )
+			{
+				hi = lo;
+				lo -= step;
+			}
+			lo = std::max( lo + 1, 0 );
+			after = int( std::upper_bound( times + lo, times + hi, time ) - times );
+		}
+		else
+		{
+			// Keys before lo are no later than time
+			int lo = after, hi = after;
+			for( int step = 1; hi < count && m_times[ hi ] <= time; step *= 2 )
+			{
+				lo = hi + 1;
+				hi += step;
+			}
+			hi = std::min( hi, count );
+			after = int( std::upper_bound( times + lo, times + hi, time ) - times );
+		}
+		cursor = after;
+		return sample( time, after );
 	}
 
 	void reserve( int size )
@@ -79,6 +112,20 @@ public:
 	}
 
 private:
+	// Interpolates between the keys either side of time, after being the
+	// first key later than time
+	T sample( double time, int after ) const
+	{
+		if( after == int( m_times.size() ) )
+			return m_keys.back();
+		if( after == 0 )
+			return m_keys.front();
+
+		int before = after - 1;
+		return interp( m_keys[before], m_keys[after],
+			( time - m_times[before] ) / ( m_times[after] - m_times[before] ) );
+	}
+
 	std::vector< double > m_times;
 	std::vector< T > m_keys;
 };
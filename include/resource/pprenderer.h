@@ -6,6 +6,7 @@
 
 #include "common/shared.h"
 
+#include "math/aabbtree.h"
 #include "math/mat44.h"
 #include "math/mat33.h"
 
@@ -13,6 +14,7 @@
 #include "resource/scenenode.h"
 
 #include <map>
+#include <unordered_map>
 
 class Device;
 class Material;
@@ -22,7 +24,7 @@ class TextureTarget;
 class Texture2D;
 struct Light;
 
-class PPRenderer : public SceneNodeVisitor
+class PPRenderer
 {
 public:
 	PPRenderer( Device &device, ResourcePool &pool );
@@ -31,9 +33,6 @@ public:
 	void render( Device &device, float44 const &cam_pos, float44 const &cam_pers,
 	             SceneNode &root );
 
-    virtual void visit( SceneMesh &mesh ) override;
-    virtual void visit( SceneLight &light ) override;
-
 private:
 	//static const int SHADOW_SIZE = 2048;
 	void update_light( SceneLight &light );
@@ -43,8 +42,9 @@ private:
 		GEOMETRY,
 		MATERIAL
 	};
-	void draw_meshes( Shader shader, RenderState &s, RenderTarget &t, Frustum const &f,
-	                  float44 const &projected_from_world, UniformGroup &uniforms );
+	void draw_meshes( Shader shader, RenderState &s, RenderTarget &t, float44 const &projected_from_world,
+	                  UniformGroup &uniforms );
+	void update_mesh_tree( SceneNode &root );
 
 	SharedPtr< ShaderProgram > m_depth_pass_program;
 	//SharedPtr< ShaderProgram > m_gbuf_program;
@@ -81,8 +81,28 @@ private:
 
 	RenderState m_shadow_state;
 
-	std::vector< SceneLight * > m_lights;
-	std::vector< SceneMesh * > m_meshes;
+	std::vector< SceneMesh * > m_drawn; // The meshes the camera sees, nearest first
+
+	// The world bounds of every mesh in the scene, kept from frame to frame
+	struct MeshEntry
+	{
+		MeshEntry() : mesh( 0 ), handle( -1 ), sync( 0 ), version( 0 ) {}
+		SceneMesh *mesh;
+		int handle;
+		unsigned int sync;    // The last sync the mesh was in the scene at
+		unsigned int version; // Its transform_version() when its bounds were worked out
+		AABB local_aabb;      // Its local_aabb then
+	};
+	AABBTree m_mesh_tree;
+	std::unordered_map< SceneMesh *, MeshEntry > m_mesh_entries;
+	std::vector< MeshEntry * > m_scene_meshes;   // The entry of each mesh in the scene, as of the last sync
+	std::vector< SceneMesh * > m_handle_meshes;  // The mesh of each m_mesh_tree handle
+	SceneNode *m_scene;
+	unsigned int m_scene_version; // Its contents_version() at the last sync
+	unsigned int m_sync;
+
+	std::vector< int > m_visible;        // m_mesh_tree handles of the meshes the camera sees
+	std::vector< int > m_shadow_visible; // Those a shadow map face sees
 };
 
 
@@ -4,13 +4,18 @@
 #include "common/shared.h"
 #include "resource/mesh.h"
 #include "resource/material.h"
+#include "resource/transformhierarchy.h"
 #include "math/mat44.h"
 #include "math/quat.h"
 #include "math/frustum.h"
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 class TextureCube;
+class ThreadPool;
 
 class SceneNode;
 class SceneMesh;
@@ -27,6 +32,14 @@ public:
 };
 
 
+// The transforms of a tree of nodes are kept together in one
+// TransformHierarchy, each node holding a handle into it, so world transforms
+// are worked out in one pass over flat arrays instead of by walking up the
+// parents of each node. A new node starts with a hierarchy of its own, so
+// nodes can be made on any thread, and moves into its new parent's when
+// attached to another tree. A detached node stays in its old tree's until
+// then. The transform accessors only read, and can be called from any thread
+// while nothing in the tree is changed.
 class SceneNode : public Shared
 {
 public:
@@ -37,19 +50,21 @@ public:
 
 	void set_parent( SceneNode *parent );
 
-	float44 const &world_from_local() const;
+	float44 world_from_local() const;
+	// Changes whenever world_from_local() may have
+	unsigned int transform_version() const;
 
 	void parent_from_local( float44 const &m );
-	float44 const &parent_from_local() const;
+	float44 parent_from_local() const;
 
 	void rotation( floatq const &q );
-	floatq const &rotation() const;
+	floatq rotation() const;
 
 	void scale( float3 const &s );
-	float3 const &scale() const;
+	float3 scale() const;
 
 	void position( float3 const &p );
-	float3 const &position() const;
+	float3 position() const;
 
     virtual void accept( SceneNodeVisitor &visitor );
 
@@ -58,34 +73,91 @@ public:
 	Iterator begin();
 	Iterator end();
 
-	std::string name;
+	void name( std::string const &n );
+	std::string const &name() const { return m_name; }
 
-private:
-	mutable float44 m_parent_from_local;
-	mutable float44 m_world_from_local;
-	mutable floatq m_rotation;
-	mutable float3 m_position;
-	mutable float3 m_scale;
-	void set_dirty();
-	void decompose() const;
-
-	mutable bool m_dirty;   // If a node's m_dirty is true, m_dirty is true for all descendants
-	mutable bool m_local_dirty;   // Set if rotate, scale or position are used
-	mutable bool m_local_set;   // true if parent_from_local set directly (rotate/scale/position out of date)
+	// The meshes and lights of this node and those below it. Gathered depth
+	// first on the first call, then kept up to date as nodes below are added
+	// or removed, at a cost of the nodes moved rather than of the scene. Each
+	// removal moves the last entry into the gap, so they are in no particular
+	// order.
+	std::vector< SceneMesh * > const &meshes();
+	std::vector< SceneLight * > const &lights();
+	// Changes whenever meshes() or lights() do, and differs between nodes
+	unsigned int contents_version();
 
+private:
+	friend void update_transforms( SceneNode &root, ThreadPool &pool );
+	friend SharedPtr< SceneNode > find_node( SceneNode &root, char const *name );
+
+	// Drops the name indices of this node and its ancestors, up to the first
+	// that no index covers
+	void names_changed();
+	// Takes the meshes and lights of this node and those below out of the
+	// lists of from and its ancestors, and adds them to those of to and its
+	// ancestors
+	void contents_moved( SceneNode *from, SceneNode *to );
+
+	std::string m_name;
+
+	// The nodes below, by name, built by the first find_node() from here
+	typedef std::unordered_map< std::string, SceneNode * > NameIndex;
+	std::unique_ptr< NameIndex > m_names;
+
+	struct Contents
+	{
+		Contents() : version( 0 ) {}
+
+		std::vector< SceneMesh * > meshes;
+		std::vector< SceneLight * > lights;
+
+		// Where each entry is in the lists above
+		std::unordered_map< SceneMesh *, size_t > mesh_slots;
+		std::unordered_map< SceneLight *, size_t > light_slots;
+		unsigned int version;
+
+		void add( Contents const &c );
+		void remove( Contents const &c );
+	};
+	Contents const &contents();
+	// Appends the meshes and lights of this node and those below to c,
+	// depth first, marking the nodes as covered by a list if cover is set
+	void gather( Contents &c, bool cover );
+	std::unique_ptr< Contents > m_contents;
+
+	// Whether a name index, or a mesh and light list, on this node or an
+	// ancestor may cover it. Set on the nodes below when one is built, so a
+	// node without it has no ancestor with one either.
+	bool m_names_cached;
+	bool m_contents_cached;
+
+	// Shared by the nodes of the tree this is in
+	TransformHierarchy::Ptr m_transforms;
+	int m_transform;
+
+	// Detaching moves the last child into the gap, so children are in no
+	// particular order
 	std::vector< Ptr > m_children;
 	SceneNode *m_parent;
+	int m_child_index; // Where this is in m_parent->m_children
 };
 
 class SceneMesh : public SceneNode
 {
 public:
-	SceneMesh( ) : bone_transforms( "u_t_bone_transforms[0]" ) {}
+	SceneMesh( ) : bone_transforms( "u_t_bone_transforms[0]" )
+	{
+		// Never culled until given real bounds
+		local_aabb.mid = float3( 0.f, 0.f, 0.f );
+		local_aabb.half_size = float3( 10000.f, 10000.f, 10000.f );
+		aabb = local_aabb;
+	}
 	typedef SharedPtr< SceneMesh > Ptr;
 
 	Mesh          mesh;
 	Material::Ptr material;
-	AABB          aabb;      // \todo This will need to be updated as soon as we're using a heirarchy
+	AABB          local_aabb; // Bounds of the vertices in the mesh's own space
+	AABB          aabb;       // local_aabb in world space, as of the last update_bounds()
 	float distance_from_eye2;
 
 	std::vector< SceneNode::Ptr > bones;
@@ -94,6 +166,10 @@ public:
 	void update_bones();
 	void set_bones( ShaderProgram &sp );
 
+	// Moves aabb to where the mesh now is. A skinned mesh is bounded by
+	// local_aabb under each bone's transform, so call after update_bones().
+	void update_bounds();
+
     virtual void accept( SceneNodeVisitor &visitor ) override;
 };
 
@@ -122,6 +198,18 @@ public:
 };
 
 void visit_scene( SceneNode &node, SceneNodeVisitor &visitor );
+// The last node named name in a depth first walk from root, or null. The
+// first call from a node indexes the names below it, so later calls are
+// constant time until names or the tree below it change.
 SceneNode::Ptr find_node( SceneNode &root, char const *name );
 
+// Finds each of count names at once, into out
+void find_nodes( SceneNode &root, char const *const *names, size_t count, SceneNode::Ptr *out );
+
+// Works out the world transforms of root and its descendants ahead of use,
+// sharing separate subtrees between the pool's workers. Call once a frame
+// after moving nodes, so that reading a transform while rendering doesn't
+// work it out along the node's path to the root.
+void update_transforms( SceneNode &root, ThreadPool &pool );
+
 #endif // SCENENODE_H
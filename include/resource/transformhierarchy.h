@@ -0,0 +1,133 @@
+#ifndef TRANSFORMHIERARCHY_H
+#define TRANSFORMHIERARCHY_H
+
+#include "common/shared.h"
+#include "math/mat44.h"
+#include "math/quat.h"
+#include "math/vec3.h"
+
+#include <vector>
+
+class ThreadPool;
+
+// The transforms of a forest of nodes, kept in flat arrays rather than in the
+// nodes themselves. Nodes are named by handles that stay the same for their
+// lifetime, and stored in depth first order, so each parent comes before its
+// children and update() works out every world transform in one pass along
+// the arrays.
+//
+// A node's local transform is set either as rotation, scale and position, or
+// as a matrix, and either form can be read back. Changes are only flagged
+// when made; matrices are composed and world transforms worked out by the
+// next update(). Until then world() works out a node's transform along its
+// path to the root, from the highest node on it that has moved.
+//
+// New nodes go on the end as roots. After nodes are removed or moved to
+// another parent the arrays are reordered by the next update().
+//
+// The accessors never write, so any number of threads can read transforms
+// at once while nothing is being changed.
+class TransformHierarchy : public Shared
+{
+public:
+	typedef SharedPtr< TransformHierarchy > Ptr;
+
+	TransformHierarchy();
+
+	// Adds a root with an identity transform, returning its handle
+	int create();
+	// Removes the node. Its children become roots.
+	void destroy( int node );
+	// Moves a node of another hierarchy into this one as a root, keeping its
+	// local transform, and returns its new handle
+	int adopt( TransformHierarchy &from, int node );
+
+	// A parent of -1 makes the node a root
+	void set_parent( int node, int parent );
+	int parent( int node ) const;
+
+	void local( int node, float44 const &m );
+	float44 local( int node ) const;
+
+	void rotation( int node, floatq const &q );
+	floatq rotation( int node ) const;
+
+	void scale( int node, float3 const &s );
+	float3 scale( int node ) const;
+
+	void position( int node, float3 const &p );
+	float3 position( int node ) const;
+
+	float44 world( int node ) const;
+
+	// A count that changes whenever the node's world transform may have, so
+	// what's worked out from the transform can be kept until it does
+	unsigned int version( int node ) const;
+
+	// Reorders the arrays if the tree has changed shape, then brings every
+	// world transform up to date
+	void update();
+
+	// Brings the world transforms of the node and its descendants up to date,
+	// handing separate subtrees to the pool's workers
+	void update( int node, ThreadPool &pool );
+
+	int size() const { return int( m_parent.size() ) - m_dead; }
+
+private:
+	enum Flags
+	{
+		ComposeLocal = 1,   // Rotation, scale or position set since the matrix was made
+		DecomposeLocal = 2, // Matrix set since rotation, scale and position were
+		Moved = 4           // Local transform changed since the last update
+	};
+
+	// The local matrix, or its rotation, scale and position, without
+	// storing them
+	float44 composed( int i ) const;
+	void decomposed( int i, floatq &r, float3 &s, float3 &p ) const;
+	void compose( int i );
+	void decompose( int i );
+	void changed( int i, int flags );
+
+	// The node's parent, or -1 if it's a root or its parent is removed
+	int live_parent( int i ) const;
+	// The highest node on the path from node i to the root that has moved
+	// or lost its parent since the last update, or -1 if none has
+	int moved_above( int i ) const;
+	// The world transform of node i, found by multiplying down from node
+	// top, one of its ancestors, whose parent is up to date
+	float44 world_below( int i, int top ) const;
+	void reorder();
+
+	// Updates the nodes [begin, end), whose parents outside the range must
+	// be up to date, returning how many of them were flagged Moved
+	int update_range( int begin, int end );
+	// Works out whether the node has moved and if so its world transform,
+	// leaving its flags alone
+	bool update_node( int i );
+
+	// Per node, in depth first order. Removed nodes are left in place with
+	// no handle until the next reorder.
+	std::vector< int > m_parent;
+	std::vector< float44 > m_local;
+	std::vector< float44 > m_world;
+	std::vector< floatq > m_rotation;
+	std::vector< float3 > m_scale;
+	std::vector< float3 > m_position;
+	std::vector< unsigned char > m_flags;
+	std::vector< int > m_handle;
+	std::vector< int > m_end; // Just past the node's last descendant
+	std::vector< unsigned int > m_version; // m_changes when the world transform last changed
+
+	std::vector< int > m_index; // Per handle, the node's place in the arrays
+	std::vector< int > m_free_handles;
+	std::vector< unsigned char > m_moved;
+
+	int m_dead;
+	int m_moved_count; // Nodes flagged Moved
+	unsigned int m_changes; // Changes made to any node
+	bool m_reorder;
+};
+
+#endif //TRANSFORMHIERARCHY_H
@@ -1,16 +1,106 @@
 #ifndef VOXELBOX_H
 #define VOXELBOX_H
 
+#include <algorithm>
 #include <vector>
+#include "math/simd.h"
 #include "math/vec3.h"
 #include <float.h>
 
-template< typename T >
+// Storage orders for VoxelBox. Each maps a voxel to its index in storage, and
+// steps from an index to a face neighbour's without going back through
+// coordinates; the step mustn't leave the box. Layouts with linear_rows keep
+// each row along x contiguous, which region operations use to work on whole
+// rows at once.
+
+// x, then y, then z
+class LinearLayout
+{
+public:
+	LinearLayout() {}
+	static const bool linear_rows = true;
+
+	explicit LinearLayout( int3 const &size );
+
+	int storage_size() const { return m_stride[2] * m_size_z; }
+	int index( int x, int y, int z ) const { return x + m_stride[1] * y + m_stride[2] * z; }
+	int neighbour( int i, int axis, int dir ) const { return i + dir * m_stride[axis]; }
+
+private:
+	int m_stride[3];
+	int m_size_z;
+};
+
+// Z-order curve: the bits of x, y and z interleaved, so voxels close in all
+// three directions are mostly close in memory. Each axis is padded to a power
+// of two, and an axis with more bits than the others carries on alone.
+class MortonLayout
+{
+public:
+	static const bool linear_rows = false;
+
+	MortonLayout() {}
+	explicit MortonLayout( int3 const &size );
+
+	int storage_size() const { return m_storage_size; }
+	int index( int x, int y, int z ) const { return m_spread[0][x] | m_spread[1][y] | m_spread[2][z]; }
+	int neighbour( int i, int axis, int dir ) const
+	{
+		// Adding to just the axis' bits, by filling the others with ones so
+		// the carry passes through them
+		int m = m_mask[axis];
+		return ( dir > 0 ? ( ( i | ~m ) + 1 ) & m : ( ( i & m ) - 1 ) & m ) | ( i & ~m );
+	}
+
+private:
+	std::vector< int > m_spread[3]; // Each axis' coordinates with their bits moved into place
+	int m_mask[3];
+	int m_storage_size;
+};
+
+// Bricks of 2^Bits voxels a side stored one after another, each linear
+// inside. Sizes are padded to whole bricks.
+template< int Bits = 2 >
+class BrickLayout
+{
+public:
+	static const int brick_size = 1 << Bits;
+	static const bool linear_rows = false;
+
+	BrickLayout() {}
+	explicit BrickLayout( int3 const &size );
+
+	int storage_size() const { return m_brick_stride[2] * m_bricks_z; }
+	int index( int x, int y, int z ) const
+	{
+		return ( x >> Bits ) * m_brick_stride[0] + ( y >> Bits ) * m_brick_stride[1] + ( z >> Bits ) * m_brick_stride[2] +
+		       ( x & ( brick_size - 1 ) ) + ( ( y & ( brick_size - 1 ) ) << Bits ) + ( ( z & ( brick_size - 1 ) ) << ( 2 * Bits ) );
+	}
+	int neighbour( int i, int axis, int dir ) const
+	{
+		int shift = axis * Bits;
+		int local = ( i >> shift ) & ( brick_size - 1 );
+		if( dir > 0 ? local != brick_size - 1 : local != 0 )
+			return i + ( dir << shift );
+		// Into the next brick, at the opposite face
+		return i + dir * ( m_brick_stride[axis] - ( ( brick_size - 1 ) << shift ) );
+	}
+
+private:
+	int m_brick_stride[3];
+	int m_bricks_z;
+};
+
+template< typename T, typename Layout = LinearLayout >
 class VoxelBox
 {
 public:
 	VoxelBox( int size_x, int size_y, int size_z );
 	VoxelBox( int3 const &size );
+	VoxelBox( int3 const &size, T const &val );
+
+	int3 const &size() const { return m_size; }
+	Layout const &layout() const { return m_layout; }
 
 	T &at( int x, int y, int z );
 	T const &at( int x, int y, int z ) const;
@@ -22,17 +112,51 @@ public:
 	T &fast_at( int3 const &v );
 	T const &fast_at( int3 const &v ) const;
 
+	// Direct access by storage index, for walking neighbours with
+	// neighbour() rather than recomputing indices from coordinates
+	int index( int3 const &v ) const { return m_layout.index( v.x, v.y, v.z ); }
+	int neighbour( int i, int axis, int dir ) const { return m_layout.neighbour( i, axis, dir ); }
+	T &at_index( int i ) { return m_data[i]; }
+	T const &at_index( int i ) const { return m_data[i]; }
+
 private:
 	int3 m_size;
+	Layout m_layout;
 	std::vector< T > m_data;
-	T m_default;
+	T m_default; // What at() gives outside the box, zero until set through it
 };
 
-template< typename T >
-void fill( VoxelBox< T > &b, T const &val,
+// Region operations. Each clips its region to the boxes once up front and
+// then works a row at a time, so rows of linear boxes are filled and copied
+// in bulk rather than a voxel at a time. Voxels equal to T() are empty.
+
+// Sets the voxels [lo, hi) of b, clipped to the box
+template< typename T, typename L >
+void fill( VoxelBox< T, L > &b, T const &val, int3 const &lo, int3 const &hi );
+template< typename T, typename L >
+void fill( VoxelBox< T, L > &b, T const &val,
            int x0, int y0, int z0,
            int x1, int y1, int z1 );
 
+// Copies the voxels [lo, hi) of src into dst, lo landing on at. Only voxels
+// inside both boxes are copied, and dst and src must be different boxes.
+template< typename T, typename LD, typename LS >
+void blit( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi );
+
+// As blit(), but copying only the voxels of src that aren't empty, for the
+// union of the two
+template< typename T, typename LD, typename LS >
+void merge( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi );
+
+// As blit(), but emptying the voxels of dst where those of src aren't empty
+template< typename T, typename LD, typename LS >
+void subtract( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi );
+
+// A box holding a copy of the voxels [lo, hi) of src. Parts of the range
+// outside src, and the new box's own outside, read as src's outside does.
+template< typename T, typename L >
+VoxelBox< T, L > extract( VoxelBox< T, L > const &src, int3 const &lo, int3 const &hi );
+
 template< typename T, typename F >
 void traverse( VoxelBox< T > &b, float3 p );
 
@@ -40,83 +164,285 @@ void traverse( VoxelBox< T > &b, float3 p );
 // Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
-template< typename T >
-VoxelBox< T >::VoxelBox( int size_x, int size_y, int size_z )
-	: m_size( size_x, size_y, size_z )
+inline LinearLayout::LinearLayout( int3 const &size )
+	: m_size_z( size.z )
 {
-	m_data.resize( m_size.x * m_size.y * m_size.z );
+	m_stride[0] = 1;
+	m_stride[1] = size.x;
+	m_stride[2] = size.x * size.y;
 }
 
-template< typename T >
-VoxelBox< T >::VoxelBox( int3 const &size )
-	: m_size( size )
+inline MortonLayout::MortonLayout( int3 const &size )
+{
+	int bits[3];
+	for( int a = 0; a != 3; ++a )
+		for( bits[a] = 0; ( 1 << bits[a] ) < size[a]; ++bits[a] )
+			;
+
+	// Deal out the output bits round the axes that still have bits left
+	int out_bit[3][32];
+	int n = 0;
+	for( int b = 0; b != 32; ++b )
+		for( int a = 0; a != 3; ++a )
+			if( b < bits[a] )
+				out_bit[a][b] = n++;
+	m_storage_size = 1 << n;
+
+	for( int a = 0; a != 3; ++a )
+	{
+		m_spread[a].resize( size_t( 1 ) << bits[a] );
+		for( int v = 0; v != int( m_spread[a].size() ); ++v )
+		{
+			int s = 0;
+			for( int b = 0; b != bits[a]; ++b )
+				if( v & ( 1 << b ) )
+					s |= 1 << out_bit[a][b];
+			m_spread[a][v] = s;
+		}
+		m_mask[a] = m_spread[a].back();
+	}
+}
+
+template< int Bits >
+BrickLayout< Bits >::BrickLayout( int3 const &size )
 {
-	m_data.resize( m_size.x * m_size.y * m_size.z );
+	int3 bricks( ( size.x + brick_size - 1 ) >> Bits, ( size.y + brick_size - 1 ) >> Bits, ( size.z + brick_size - 1 ) >> Bits );
+	m_brick_stride[0] = 1 << ( 3 * Bits );
+	m_brick_stride[1] = m_brick_stride[0] * bricks.x;
+	m_brick_stride[2] = m_brick_stride[1] * bricks.y;
+	m_bricks_z = bricks.z;
 }
 
-template< typename T >
-T &VoxelBox< T >::at( int x, int y, int z )
+template< typename T, typename Layout >
+VoxelBox< T, Layout >::VoxelBox( int size_x, int size_y, int size_z )
+	: m_size( size_x, size_y, size_z ), m_layout( m_size ), m_default()
+{
+	m_data.resize( m_layout.storage_size() );
+}
+
+template< typename T, typename Layout >
+VoxelBox< T, Layout >::VoxelBox( int3 const &size )
+	: m_size( size ), m_layout( size ), m_default()
+{
+	m_data.resize( m_layout.storage_size() );
+}
+
+template< typename T, typename Layout >
+VoxelBox< T, Layout >::VoxelBox( int3 const &size, T const &val )
+	: m_size( size ), m_layout( size ), m_default()
+{
+	m_data.resize( m_layout.storage_size(), val );
+}
+
+template< typename T, typename Layout >
+T &VoxelBox< T, Layout >::at( int x, int y, int z )
 {
 	if( x < 0 || y < 0 || z < 0 || x >= m_size.x || y >= m_size.y || z >= m_size.z )
 		return m_default;
 	else
-		return m_data[ x + m_size.x * ( y + m_size.y * z ) ];
+		return m_data[ m_layout.index( x, y, z ) ];
 }
 
-template< typename T >
-T &VoxelBox< T >::at( int3 const &v )
+template< typename T, typename Layout >
+T &VoxelBox< T, Layout >::at( int3 const &v )
 {
 	return at( v.x, v.y, v.z );
 }
 
-template< typename T >
-T const &VoxelBox< T >::at( int x, int y, int z ) const
+template< typename T, typename Layout >
+T const &VoxelBox< T, Layout >::at( int x, int y, int z ) const
 {
 	if( x < 0 || y < 0 || z < 0 || x >= m_size.x || y >= m_size.y || z >= m_size.z )
 		return m_default;
 	else
-		return m_data[ x + m_size.x * ( y + m_size.y * z ) ];
+		return m_data[ m_layout.index( x, y, z ) ];
 }
 
-template< typename T >
-T const &VoxelBox< T >::at( int3 const &v ) const
+template< typename T, typename Layout >
+T const &VoxelBox< T, Layout >::at( int3 const &v ) const
 {
 	return at( v.x, v.y, v.z );
 }
 
-template< typename T >
-T &VoxelBox< T >::fast_at( int x, int y, int z )
+template< typename T, typename Layout >
+T &VoxelBox< T, Layout >::fast_at( int x, int y, int z )
 {
-	return m_data[ x + m_size.x * ( y + m_size.y * z ) ];
+	return m_data[ m_layout.index( x, y, z ) ];
 }
 
-template< typename T >
-T &VoxelBox< T >::fast_at( int3 const &v )
+template< typename T, typename Layout >
+T &VoxelBox< T, Layout >::fast_at( int3 const &v )
 {
 	return fast_at( v.x, v.y, v.z );
 }
 
-template< typename T >
-T const &VoxelBox< T >::fast_at( int x, int y, int z ) const
+template< typename T, typename Layout >
+T const &VoxelBox< T, Layout >::fast_at( int x, int y, int z ) const
 {
-	return m_data[ x + m_size.x * ( y + m_size.y * z ) ];
+	return m_data[ m_layout.index( x, y, z ) ];
 }
 
-template< typename T >
-T const &VoxelBox< T >::fast_at( int3 const &v ) const
+template< typename T, typename Layout >
+T const &VoxelBox< T, Layout >::fast_at( int3 const &v ) const
 {
 	return fast_at( v.x, v.y, v.z );
 }
 
-template< typename T >
-void fill( VoxelBox< T > &b, T const &val,
+template< typename T, typename L >
+void fill( VoxelBox< T, L > &b, T const &val, int3 const &lo, int3 const &hi )
+{
+	int3 size = b.size();
+	int3 l0( std::max( lo.x, 0 ), std::max( lo.y, 0 ), std::max( lo.z, 0 ) );
+	int3 l1( std::min( hi.x, size.x ), std::min( hi.y, size.y ), std::min( hi.z, size.z ) );
+	if( l0.x >= l1.x || l0.y >= l1.y || l0.z >= l1.z )
+		return;
+
+	for( int z = l0.z; z != l1.z; ++z )
+		for( int y = l0.y; y != l1.y; ++y )
+		{
+			if( L::linear_rows )
+			{
+				T *row = &b.fast_at( l0.x, y, z );
+				std::fill( row, row + ( l1.x - l0.x ), val );
+			}
+			else
+				for( int x = l0.x; x != l1.x; ++x )
+					b.fast_at( x, y, z ) = val;
+		}
+}
+
+template< typename T, typename L >
+void fill( VoxelBox< T, L > &b, T const &val,
            int x0, int y0, int z0,
            int x1, int y1, int z1 )
 {
-	for( int z = z0; z < z1; ++z )
-		for( int y = y0; y < y1; ++y )
-			for( int x = x0; x < x1; ++x )
-				b.at( x, y, z ) = val;
+	fill( b, val, int3( x0, y0, z0 ), int3( x1, y1, z1 ) );
+}
+
+namespace detail
+{
+
+// Rows of merge() and subtract(). Byte voxels, the usual kind, are done 16
+// at a time with simd selects.
+template< typename T >
+void merge_row( T *d, T const *s, int n )
+{
+	for( int i = 0; i != n; ++i )
+		if( !( s[i] == T() ) )
+			d[i] = s[i];
+}
+
+template< typename T >
+void subtract_row( T *d, T const *s, int n )
+{
+	for( int i = 0; i != n; ++i )
+		if( !( s[i] == T() ) )
+			d[i] = T();
+}
+
+inline void merge_row( unsigned char *d, unsigned char const *s, int n )
+{
+	int i = 0;
+#if defined( GRT_SIMD_SSE )
+	__m128i zero = _mm_setzero_si128();
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m128i sv = _mm_loadu_si128( ( __m128i const * )( s + i ) );
+		__m128i dv = _mm_loadu_si128( ( __m128i const * )( d + i ) );
+		__m128i empty = _mm_cmpeq_epi8( sv, zero );
+		_mm_storeu_si128( ( __m128i * )( d + i ), _mm_or_si128( sv, _mm_and_si128( empty, dv ) ) );
+	}
+#elif defined( GRT_SIMD_NEON )
+	for( ; i + 16 <= n; i += 16 )
+	{
+		uint8x16_t sv = vld1q_u8( s + i ), dv = vld1q_u8( d + i );
+		vst1q_u8( d + i, vbslq_u8( vceqq_u8( sv, vdupq_n_u8( 0 ) ), dv, sv ) );
+	}
+#endif
+	for( ; i != n; ++i )
+		if( s[i] )
+			d[i] = s[i];
+}
+
+inline void subtract_row( unsigned char *d, unsigned char const *s, int n )
+{
+	int i = 0;
+#if defined( GRT_SIMD_SSE )
+	__m128i zero = _mm_setzero_si128();
+	for( ; i + 16 <= n; i += 16 )
+	{
+		__m128i sv = _mm_loadu_si128( ( __m128i const * )( s + i ) );
+		__m128i dv = _mm_loadu_si128( ( __m128i const * )( d + i ) );
+		_mm_storeu_si128( ( __m128i * )( d + i ), _mm_and_si128( _mm_cmpeq_epi8( sv, zero ), dv ) );
+	}
+#elif defined( GRT_SIMD_NEON )
+	for( ; i + 16 <= n; i += 16 )
+	{
+		uint8x16_t sv = vld1q_u8( s + i ), dv = vld1q_u8( d + i );
+		vst1q_u8( d + i, vandq_u8( vceqq_u8( sv, vdupq_n_u8( 0 ) ), dv ) );
+	}
+#endif
+	for( ; i != n; ++i )
+		if( s[i] )
+			d[i] = 0;
+}
+
+// Calls op( d, s, n ) for runs of n voxels of src from [lo, hi) and of dst
+// from at, clipped to both boxes. Runs are whole rows when both boxes have
+// linear rows, and single voxels otherwise.
+template< typename T, typename LD, typename LS, typename Op >
+void for_each_run( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src,
+                   int3 const &lo, int3 const &hi, Op op )
+{
+	int3 offset = at - lo, l0, l1;
+	for( int i = 0; i != 3; ++i )
+	{
+		l0[i] = std::max( lo[i], std::max( 0, -offset[i] ) );
+		l1[i] = std::min( hi[i], std::min( src.size()[i], dst.size()[i] - offset[i] ) );
+		if( l0[i] >= l1[i] )
+			return;
+	}
+
+	for( int z = l0.z; z != l1.z; ++z )
+		for( int y = l0.y; y != l1.y; ++y )
+		{
+			if( LD::linear_rows && LS::linear_rows )
+				op( &dst.fast_at( l0.x + offset.x, y + offset.y, z + offset.z ), &src.fast_at( l0.x, y, z ), l1.x - l0.x );
+			else
+				for( int x = l0.x; x != l1.x; ++x )
+					op( &dst.fast_at( x + offset.x, y + offset.y, z + offset.z ), &src.fast_at( x, y, z ), 1 );
+		}
+}
+
+}
+
+template< typename T, typename LD, typename LS >
+void blit( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi )
+{
+	detail::for_each_run( dst, at, src, lo, hi, []( T *d, T const *s, int n ) { std::copy( s, s + n, d ); } );
+}
+
+template< typename T, typename LD, typename LS >
+void merge( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi )
+{
+	detail::for_each_run( dst, at, src, lo, hi, []( T *d, T const *s, int n ) { detail::merge_row( d, s, n ); } );
+}
+
+template< typename T, typename LD, typename LS >
+void subtract( VoxelBox< T, LD > &dst, int3 const &at, VoxelBox< T, LS > const &src, int3 const &lo, int3 const &hi )
+{
+	detail::for_each_run( dst, at, src, lo, hi, []( T *d, T const *s, int n ) { detail::subtract_row( d, s, n ); } );
+}
+
+template< typename T, typename L >
+VoxelBox< T, L > extract( VoxelBox< T, L > const &src, int3 const &lo, int3 const &hi )
+{
+	T const &outside = src.at( -1, -1, -1 );
+	int3 size = hi - lo;
+	VoxelBox< T, L > b( int3( std::max( size.x, 0 ), std::max( size.y, 0 ), std::max( size.z, 0 ) ), outside );
+	b.at( -1, -1, -1 ) = outside;
+	blit( b, int3( 0, 0, 0 ), src, lo, hi );
+	return b;
 }
 
 template< typename F >
@@ -0,0 +1,139 @@
+#ifndef VOXELCOLLISION_H
+#define VOXELCOLLISION_H
+
+#include "resource/voxelworld.h"
+#include "math/vec3.h"
+
+#include <stdint.h>
+#include <algorithm>
+#include <unordered_map>
+
+class ThreadPool;
+struct VoxelBody;
+
+// Which voxels are solid, a bit per voxel in rows along x, kept per chunk so
+// a box is tested a row at a time rather than a voxel at a time. Chunks with
+// nothing solid take no storage.
+//
+// The bits are set from any volume with an at( int3 ) const, such as a
+// VoxelBox or VoxelWorld, and solid( value ) deciding which values block.
+// After edits only the changed ranges need updating, such as those in
+// VoxelWorld::dirty().
+class VoxelOccupancy
+{
+public:
+	static const int chunk_bits = 5;
+	static const int chunk_size = 1 << chunk_bits;
+	static const int chunk_mask = chunk_size - 1;
+
+	// Sets the bits of the voxels [lo, hi)
+	template< typename V, typename F >
+	void update( V const &vol, F solid, int3 const &lo, int3 const &hi );
+	template< typename V, typename F >
+	void update( V const &vol, F solid, VoxelDirtyMap const &dirty );
+
+	void clear() { m_chunks.clear(); }
+	size_t chunk_count() const { return m_chunks.size(); }
+
+	bool solid( int3 const &v ) const;
+	// Whether any of the voxels [lo, hi) is solid
+	bool any_solid( int3 const &lo, int3 const &hi ) const;
+	// Finds the nearest layer along axis of the voxels [lo, hi) that holds a
+	// solid voxel, walking up the axis if dir is positive and down otherwise
+	bool first_solid( int3 const &lo, int3 const &hi, int axis, int dir, int &layer ) const;
+
+private:
+	struct Chunk
+	{
+		uint32_t rows[ chunk_size * chunk_size ]; // Bit x of row y + z * chunk_size
+	};
+
+	static int3 chunk_of( int3 const &v ) { return int3( v.x >> chunk_bits, v.y >> chunk_bits, v.z >> chunk_bits ); }
+
+	Chunk const *chunk( int3 const &c ) const;
+	// As first_solid() for voxels [lo, hi) within the one chunk
+	static bool first_in_chunk( Chunk const &ch, int3 const &lo, int3 const &hi, int axis, int dir, int &layer );
+	// Drops the chunk if nothing in it is solid
+	void prune( int3 const &c );
+
+	std::unordered_map< int3, Chunk, ChunkHash > m_chunks;
+
+	friend void sweep( VoxelOccupancy const &occ, VoxelBody &body );
+};
+
+// An axis aligned box moving through the solid voxels of a VoxelOccupancy
+struct VoxelBody
+{
+	float3 lo, hi;
+	float3 move;   // Wanted this step
+	int3 blocked;  // Set by sweep() to the direction each axis was stopped in, or zero
+};
+
+// Moves the body by as much of its move as it can, one axis at a time with
+// y first so landing on a ledge doesn't catch on the wall beside it. The
+// body stops a small gap short of any solid voxel it would enter. Voxels it
+// already overlaps don't block it, so a body caught inside one can still
+// move out.
+void sweep( VoxelOccupancy const &occ, VoxelBody &body );
+
+// Sweeps each body, spread across the pool if given. Bodies don't block
+// each other.
+void sweep( VoxelOccupancy const &occ, VoxelBody *bodies, int count, ThreadPool *pool = 0 );
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename V, typename F >
+void VoxelOccupancy::update( V const &vol, F solid, int3 const &lo, int3 const &hi )
+{
+	if( lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z )
+		return;
+
+	int3 c0 = chunk_of( lo ), c1 = chunk_of( hi - int3( 1, 1, 1 ) ), c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+			{
+				// The part of the range in this chunk, in voxels
+				int3 base = c * chunk_size;
+				int3 v0( std::max( lo.x, base.x ), std::max( lo.y, base.y ), std::max( lo.z, base.z ) );
+				int3 v1( std::min( hi.x, base.x + chunk_size ), std::min( hi.y, base.y + chunk_size ),
+				         std::min( hi.z, base.z + chunk_size ) );
+				uint32_t span = uint32_t( ( uint64_t( 1 ) << ( v1.x - base.x ) ) - ( uint64_t( 1 ) << ( v0.x - base.x ) ) );
+
+				// Only make the chunk once something solid turns up
+				typename std::unordered_map< int3, Chunk, ChunkHash >::iterator i = m_chunks.find( c );
+				bool found = i != m_chunks.end();
+				int3 v;
+				for( v.z = v0.z; v.z != v1.z; ++v.z )
+					for( v.y = v0.y; v.y != v1.y; ++v.y )
+					{
+						uint32_t bits = 0;
+						for( v.x = v0.x; v.x != v1.x; ++v.x )
+							if( solid( vol.at( v ) ) )
+								bits |= uint32_t( 1 ) << ( v.x - base.x );
+						if( !found && !bits )
+							continue;
+						if( !found )
+						{
+							i = m_chunks.insert( std::make_pair( c, Chunk() ) ).first;
+							std::fill( i->second.rows, i->second.rows + chunk_size * chunk_size, 0u );
+							found = true;
+						}
+						uint32_t &row = i->second.rows[ ( v.y - base.y ) + ( v.z - base.z ) * chunk_size ];
+						row = ( row & ~span ) | bits;
+					}
+				if( found )
+					prune( c );
+			}
+}
+
+template< typename V, typename F >
+void VoxelOccupancy::update( V const &vol, F solid, VoxelDirtyMap const &dirty )
+{
+	for( VoxelDirtyMap::const_iterator d = dirty.begin(); d != dirty.end(); ++d )
+		update( vol, solid, d->second.lo, d->second.hi );
+}
+
+#endif //VOXELCOLLISION_H
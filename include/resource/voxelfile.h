@@ -0,0 +1,412 @@
+#ifndef VOXELFILE_H
+#define VOXELFILE_H
+
+#include "common/mappedfile.h"
+#include "common/uncopyable.h"
+#include "resource/voxelpack.h"
+#include "resource/voxelworld.h"
+#include "math/vec3.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Layout of a voxel world file. All values are little endian.
+//
+// The header is followed by the world's empty value, then chunks, each a
+// PackedVoxelChunk as written by its write(), then an index of every chunk.
+// Chunks rewritten by a save go back where they were if they still fit, or
+// after the last chunk if not, and the index is rewritten after them. Space
+// left by chunks that moved or shrank is only reclaimed by writing the world
+// out again.
+struct VoxelFileHeader
+{
+	static const unsigned int current_version = 1;
+
+	char magic[4]; // "GRTV"
+	unsigned int version;
+	unsigned int voxel_bytes;
+	unsigned int chunk_size;
+	unsigned int chunk_count;
+	unsigned int reserved;
+	unsigned long long index_offset;
+};
+
+struct VoxelFileEntry
+{
+	int x, y, z;
+	unsigned int bytes;
+	unsigned long long offset;
+};
+
+// A VoxelWorld backed by a file. open() maps the file and reads only the
+// index, and each chunk is decoded into world() the first time it's read or
+// written, so opening costs the same whatever the world's size and loading
+// follows what's looked at.
+//
+// Chunks changed through set() and fill() are written back by save(), which
+// touches only those chunks and the index. Writes made directly to world()
+// need mark_unsaved(). Chunks decoded into world() show in its dirty() like
+// any other write, so a mesher watching it builds them as they arrive.
+template< typename T >
+class VoxelWorldFile : public Uncopyable
+{
+public:
+	static const int chunk_size = VoxelWorld< T >::chunk_size;
+
+	VoxelWorldFile();
+
+	// Returns false, printing why, if the file can't be read or was written
+	// with a different version, voxel type or chunk size
+	bool open( char const *filename );
+	// Starts a new file, replacing any at filename, holding an empty world
+	bool create( char const *filename, T const &empty = T() );
+	// Writes every chunk of w to a new file, which isn't opened
+	static bool write( char const *filename, VoxelWorld< T > const &w );
+
+	T const &at( int x, int y, int z );
+	T const &at( int3 const &v );
+	void set( int x, int y, int z, T const &val );
+	void set( int3 const &v, T const &val );
+	void fill( int3 const &lo, int3 const &hi, T const &val );
+
+	// Loads the chunks overlapping the voxels [lo, hi) if they aren't already
+	void load( int3 const &lo, int3 const &hi );
+	void load_chunk( int3 const &c );
+	bool is_loaded( int3 const &c ) const { return m_loaded.count( c ) != 0; }
+
+	void mark_unsaved( int3 const &c ) { m_unsaved.insert( c ); }
+	size_t unsaved_count() const { return m_unsaved.size(); }
+	// Writes back every chunk changed since the last save. Returns false if
+	// the file couldn't be written, keeping the changes unsaved.
+	bool save();
+
+	VoxelWorld< T > &world() { return m_world; }
+	VoxelWorld< T > const &world() const { return m_world; }
+	size_t file_chunk_count() const { return m_index.size(); }
+
+private:
+	typedef std::unordered_map< int3, VoxelFileEntry, ChunkHash > Index;
+
+	static size_t data_start() { return sizeof( VoxelFileHeader ) + sizeof( T ); }
+	static bool write_file( char const *filename, T const &empty, VoxelWorld< T > const *w );
+	static void encode( VoxelWorld< T > const &w, int3 const &c, std::vector< unsigned char > &out );
+	bool read_header();
+
+	std::string m_filename;
+	MappedFile m_file;
+	Index m_index;
+	unsigned long long m_end; // Where the next appended chunk goes
+
+	VoxelWorld< T > m_world;
+	std::unordered_set< int3, ChunkHash > m_loaded;
+	std::unordered_set< int3, ChunkHash > m_unsaved;
+	int3 m_last_loaded;
+	bool m_has_last;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+VoxelWorldFile< T >::VoxelWorldFile()
+	: m_end( 0 ), m_has_last( false )
+{
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::open( char const *filename )
+{
+	m_filename = filename;
+	m_index.clear();
+	m_loaded.clear();
+	m_unsaved.clear();
+	m_has_last = false;
+	m_world = VoxelWorld< T >();
+
+	if( !m_file.open( filename ) )
+	{
+		printf( "Error: unable to open voxel file %s\n", filename );
+		return false;
+	}
+	if( !read_header() )
+	{
+		m_file.close();
+		return false;
+	}
+	return true;
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::read_header()
+{
+	char const *filename = m_filename.c_str();
+	VoxelFileHeader h;
+	if( m_file.size() < data_start() )
+	{
+		printf( "Error: %s is too short for a voxel file\n", filename );
+		return false;
+	}
+	memcpy( &h, m_file.data(), sizeof( h ) );
+	if( memcmp( h.magic, "GRTV", 4 ) != 0 )
+	{
+		printf( "Error: %s isn't a voxel file\n", filename );
+		return false;
+	}
+	if( h.version != VoxelFileHeader::current_version || h.voxel_bytes != sizeof( T ) || h.chunk_size != chunk_size )
+	{
+		printf( "Error: %s is version %u with %u byte voxels in %u^3 chunks, expected version %u, %u and %d\n",
+		        filename, h.version, h.voxel_bytes, h.chunk_size,
+		        VoxelFileHeader::current_version, unsigned( sizeof( T ) ), chunk_size );
+		return false;
+	}
+	if( h.index_offset > m_file.size() || ( m_file.size() - h.index_offset ) / sizeof( VoxelFileEntry ) < h.chunk_count )
+	{
+		printf( "Error: %s has a truncated chunk index\n", filename );
+		return false;
+	}
+
+	T empty;
+	memcpy( &empty, m_file.data() + sizeof( h ), sizeof( T ) );
+	m_world = VoxelWorld< T >( empty );
+
+	VoxelFileEntry const *entries = ( VoxelFileEntry const * )( m_file.data() + h.index_offset );
+	m_index.reserve( h.chunk_count );
+	m_end = data_start();
+	for( unsigned int i = 0; i != h.chunk_count; ++i )
+	{
+		VoxelFileEntry e;
+		memcpy( &e, entries + i, sizeof( e ) );
+		m_index[ int3( e.x, e.y, e.z ) ] = e;
+		m_end = std::max( m_end, e.offset + e.bytes );
+	}
+	return true;
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::create( char const *filename, T const &empty )
+{
+	return write_file( filename, empty, 0 ) && open( filename );
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::write( char const *filename, VoxelWorld< T > const &w )
+{
+	return write_file( filename, w.empty(), &w );
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::write_file( char const *filename, T const &empty, VoxelWorld< T > const *w )
+{
+	FILE *f = fopen( filename, "wb" );
+	if( !f )
+	{
+		printf( "Error: unable to write voxel file %s\n", filename );
+		return false;
+	}
+
+	std::vector< unsigned char > data;
+	std::vector< VoxelFileEntry > entries;
+	if( w )
+	{
+		w->for_each_chunk( [&]( int3 const &c, typename VoxelWorld< T >::Chunk const & )
+		{
+			VoxelFileEntry e = { c.x, c.y, c.z, 0, data_start() + data.size() };
+			size_t at = data.size();
+			encode( *w, c, data );
+			e.bytes = ( unsigned int )( data.size() - at );
+			entries.push_back( e );
+		} );
+	}
+
+	VoxelFileHeader h = { { 'G', 'R', 'T', 'V' }, VoxelFileHeader::current_version, sizeof( T ), chunk_size,
+	                      ( unsigned int )entries.size(), 0, data_start() + data.size() };
+	bool ok = fwrite( &h, sizeof( h ), 1, f ) == 1 && fwrite( &empty, sizeof( T ), 1, f ) == 1 &&
+	          fwrite( data.data(), 1, data.size(), f ) == data.size() &&
+	          fwrite( entries.data(), sizeof( VoxelFileEntry ), entries.size(), f ) == entries.size();
+	ok = fclose( f ) == 0 && ok;
+	if( !ok )
+		printf( "Error: unable to write voxel file %s\n", filename );
+	return ok;
+}
+
+template< typename T >
+void VoxelWorldFile< T >::encode( VoxelWorld< T > const &w, int3 const &c, std::vector< unsigned char > &out )
+{
+	PackedVoxelChunk< T > packed;
+	typename VoxelWorld< T >::Chunk const *chunk = w.chunk( c );
+	if( !chunk )
+		packed.encode_uniform( int3( chunk_size, chunk_size, chunk_size ), w.empty() );
+	else if( chunk->uniform() )
+		packed.encode_uniform( int3( chunk_size, chunk_size, chunk_size ), chunk->value );
+	else
+		packed.encode( *chunk->box );
+	packed.write( out );
+}
+
+template< typename T >
+T const &VoxelWorldFile< T >::at( int x, int y, int z )
+{
+	int3 v( x, y, z );
+	load_chunk( VoxelWorld< T >::chunk_of( v ) );
+	return static_cast< VoxelWorld< T > const & >( m_world ).at( v );
+}
+
+template< typename T >
+T const &VoxelWorldFile< T >::at( int3 const &v )
+{
+	return at( v.x, v.y, v.z );
+}
+
+template< typename T >
+void VoxelWorldFile< T >::set( int x, int y, int z, T const &val )
+{
+	int3 v( x, y, z ), c = VoxelWorld< T >::chunk_of( v );
+	load_chunk( c );
+	m_world.set( v, val );
+	m_unsaved.insert( c );
+}
+
+template< typename T >
+void VoxelWorldFile< T >::set( int3 const &v, T const &val )
+{
+	set( v.x, v.y, v.z, val );
+}
+
+template< typename T >
+void VoxelWorldFile< T >::fill( int3 const &lo, int3 const &hi, T const &val )
+{
+	if( lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z )
+		return;
+
+	load( lo, hi );
+	::fill( m_world, val, lo.x, lo.y, lo.z, hi.x, hi.y, hi.z );
+
+	int3 c0 = VoxelWorld< T >::chunk_of( lo ), c1 = VoxelWorld< T >::chunk_of( hi - int3( 1, 1, 1 ) );
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+				m_unsaved.insert( c );
+}
+
+template< typename T >
+void VoxelWorldFile< T >::load( int3 const &lo, int3 const &hi )
+{
+	if( lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z )
+		return;
+
+	int3 c0 = VoxelWorld< T >::chunk_of( lo ), c1 = VoxelWorld< T >::chunk_of( hi - int3( 1, 1, 1 ) );
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+				load_chunk( c );
+}
+
+template< typename T >
+void VoxelWorldFile< T >::load_chunk( int3 const &c )
+{
+	// Reads tend to stay in one chunk for a while
+	if( m_has_last && m_last_loaded == c )
+		return;
+	if( !m_loaded.insert( c ).second )
+	{
+		m_last_loaded = c;
+		m_has_last = true;
+		return;
+	}
+	m_last_loaded = c;
+	m_has_last = true;
+
+	typename Index::const_iterator i = m_index.find( c );
+	if( i == m_index.end() )
+		return;
+
+	VoxelFileEntry const &e = i->second;
+	PackedVoxelChunk< T > packed;
+	if( e.offset + e.bytes > m_file.size() ||
+	    !packed.read( int3( chunk_size, chunk_size, chunk_size ), m_file.data() + e.offset, e.bytes ) )
+	{
+		printf( "Error: chunk %d %d %d of %s is damaged, reading it as empty\n", c.x, c.y, c.z, m_filename.c_str() );
+		return;
+	}
+
+	if( packed.uniform() )
+		m_world.set_uniform( c, packed.get( 0, 0, 0 ) );
+	else
+		packed.decode( m_world.make_dense( c ) );
+}
+
+template< typename T >
+bool VoxelWorldFile< T >::save()
+{
+	if( m_unsaved.empty() )
+		return true;
+	if( m_filename.empty() )
+		return false;
+
+	// The mapping is dropped while writing, as not every system allows
+	// writing to a mapped file. Everything unsaved is already in m_world.
+	m_file.close();
+	m_has_last = false;
+
+	FILE *f = fopen( m_filename.c_str(), "r+b" );
+	bool ok = f != 0;
+
+	Index index = m_index;
+	unsigned long long end = m_end;
+	std::vector< unsigned char > data;
+	for( auto c = m_unsaved.begin(); ok && c != m_unsaved.end(); ++c )
+	{
+		data.clear();
+		encode( m_world, *c, data );
+
+		typename Index::iterator i = index.find( *c );
+		VoxelFileEntry e = { c->x, c->y, c->z, ( unsigned int )data.size(), end };
+		if( i != index.end() && data.size() <= i->second.bytes )
+			e.offset = i->second.offset;
+		else
+			end += data.size();
+		index[ *c ] = e;
+
+		ok = fseek( f, long( e.offset ), SEEK_SET ) == 0 && fwrite( data.data(), 1, data.size(), f ) == data.size();
+	}
+
+	std::vector< VoxelFileEntry > entries;
+	entries.reserve( index.size() );
+	for( typename Index::const_iterator i = index.begin(); i != index.end(); ++i )
+		entries.push_back( i->second );
+
+	// The new index goes after every chunk, then the header points at it
+	VoxelFileHeader h = { { 'G', 'R', 'T', 'V' }, VoxelFileHeader::current_version, sizeof( T ), chunk_size,
+	                      ( unsigned int )entries.size(), 0, end };
+	ok = ok && fseek( f, long( end ), SEEK_SET ) == 0 &&
+	     fwrite( entries.data(), sizeof( VoxelFileEntry ), entries.size(), f ) == entries.size() &&
+	     fflush( f ) == 0 &&
+	     fseek( f, 0, SEEK_SET ) == 0 && fwrite( &h, sizeof( h ), 1, f ) == 1;
+	if( f )
+		ok = fclose( f ) == 0 && ok;
+
+	if( ok )
+	{
+		m_index.swap( index );
+		m_end = end;
+		m_unsaved.clear();
+	}
+	else
+		printf( "Error: unable to save voxel file %s\n", m_filename.c_str() );
+
+	if( !m_file.open( m_filename.c_str() ) )
+	{
+		printf( "Error: unable to reopen voxel file %s\n", m_filename.c_str() );
+		return false;
+	}
+	return ok;
+}
+
+#endif //VOXELFILE_H
@@ -0,0 +1,242 @@
+#ifndef VOXELLIGHT_H
+#define VOXELLIGHT_H
+
+#include "resource/voxelbox.h"
+#include "resource/voxelworld.h"
+#include "math/vec3.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// Light levels from 0 to 15 flooded through the open voxels of a box, for
+// baking into meshes in place of dynamic lights. Each voxel holds two
+// levels packed in a byte: light from point sources in the low four bits,
+// and sunlight in the high four.
+//
+// Light drops a level with each voxel it spreads to and doesn't enter
+// voxels for which opaque( value ) is true. Sunlight enters from the top of
+// the box and carries on straight down at full strength.
+//
+// Changes are made by breadth first passes over just the voxels whose light
+// changes, so adding or removing a light or editing a voxel costs in
+// proportion to the area it lights. The voxels whose light changed are
+// recorded per chunk in changed() until clear_changed(), so meshes baked
+// from the light can be rebuilt for just that area.
+//
+// The methods taking a volume read it with at( int3 ) const, so vol can be a
+// VoxelBox or VoxelWorld, covering the same voxels as the field.
+class VoxelLightField
+{
+public:
+	static const int max_level = 15;
+
+	explicit VoxelLightField( int3 const &size );
+
+	int3 const &size() const { return m_size; }
+
+	// Both levels, as packed for meshing
+	VoxelBox< unsigned char > const &levels() const { return m_levels; }
+	int block( int3 const &v ) const { return m_levels.fast_at( v ) & 15; }
+	int sun( int3 const &v ) const { return m_levels.fast_at( v ) >> 4; }
+
+	// Lights the box from above, replacing any sunlight already there
+	template< typename V, typename F >
+	void light_sun( V const &vol, F opaque );
+
+	// Adds a point light, or changes the level of the one at v
+	template< typename V, typename F >
+	void add_light( V const &vol, F opaque, int3 const &v, int level );
+	template< typename V, typename F >
+	void remove_light( V const &vol, F opaque, int3 const &v );
+
+	// Updates the light around v after it has been changed in vol
+	template< typename V, typename F >
+	void voxel_changed( V const &vol, F opaque, int3 const &v );
+
+	VoxelDirtyMap const &changed() const { return m_changed; }
+	void clear_changed() { m_changed.clear(); }
+
+private:
+	enum Channel { Block = 0, Sun = 1 };
+
+	struct Node
+	{
+		int3 v;
+		int level;
+	};
+
+	bool inside( int3 const &v ) const
+	{
+		return v.x >= 0 && v.y >= 0 && v.z >= 0 && v.x < m_size.x && v.y < m_size.y && v.z < m_size.z;
+	}
+	int get( int3 const &v, int c ) const { return ( m_levels.fast_at( v ) >> ( 4 * c ) ) & 15; }
+	void set( int3 const &v, int c, int level );
+
+	// Level reaching a neighbour from a voxel at level, down being -y
+	static int spread( int c, int level, int dir )
+	{
+		return c == Sun && dir == 3 && level == max_level ? max_level : level - 1;
+	}
+
+	void remove_pass( int c );
+	template< typename V, typename F >
+	void add_pass( V const &vol, F opaque, int c );
+	void flush_changed();
+
+	int3 m_size;
+	VoxelBox< unsigned char > m_levels;
+	std::unordered_map< int3, int, ChunkHash > m_sources;
+
+	std::vector< Node > m_add, m_remove;
+	VoxelRange m_touched;
+	bool m_any_touched;
+	VoxelDirtyMap m_changed;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+static const int3 voxel_light_dirs[6] =
+{
+	int3( 1, 0, 0 ), int3( -1, 0, 0 ), int3( 0, 1, 0 ), int3( 0, -1, 0 ), int3( 0, 0, 1 ), int3( 0, 0, -1 )
+};
+}
+
+template< typename V, typename F >
+void VoxelLightField::light_sun( V const &vol, F opaque )
+{
+	// Clear the old sunlight, then start each open column at full strength
+	int3 v;
+	for( v.z = 0; v.z != m_size.z; ++v.z )
+		for( v.y = 0; v.y != m_size.y; ++v.y )
+			for( v.x = 0; v.x != m_size.x; ++v.x )
+				if( get( v, Sun ) )
+					set( v, Sun, 0 );
+
+	v.y = m_size.y - 1;
+	for( v.z = 0; v.z != m_size.z; ++v.z )
+		for( v.x = 0; v.x != m_size.x; ++v.x )
+			if( !opaque( vol.at( v ) ) )
+			{
+				set( v, Sun, max_level );
+				Node n = { v, max_level };
+				m_add.push_back( n );
+			}
+	add_pass( vol, opaque, Sun );
+	flush_changed();
+}
+
+template< typename V, typename F >
+void VoxelLightField::add_light( V const &vol, F opaque, int3 const &v, int level )
+{
+	if( !inside( v ) )
+		return;
+	level = std::min( std::max( level, 0 ), int( max_level ) );
+
+	if( m_sources.count( v ) )
+		remove_light( vol, opaque, v );
+	if( !level )
+		return;
+
+	m_sources[v] = level;
+	if( get( v, Block ) < level )
+	{
+		set( v, Block, level );
+		Node n = { v, level };
+		m_add.push_back( n );
+		add_pass( vol, opaque, Block );
+	}
+	flush_changed();
+}
+
+template< typename V, typename F >
+void VoxelLightField::remove_light( V const &vol, F opaque, int3 const &v )
+{
+	if( !m_sources.erase( v ) )
+		return;
+
+	Node n = { v, get( v, Block ) };
+	set( v, Block, 0 );
+	m_remove.push_back( n );
+	remove_pass( Block );
+	add_pass( vol, opaque, Block );
+	flush_changed();
+}
+
+template< typename V, typename F >
+void VoxelLightField::voxel_changed( V const &vol, F opaque, int3 const &v )
+{
+	if( !inside( v ) )
+		return;
+
+	for( int c = 0; c != 2; ++c )
+	{
+		if( opaque( vol.at( v ) ) )
+		{
+			// Take out the light that passed through v
+			Node n = { v, get( v, c ) };
+			if( n.level )
+			{
+				set( v, c, 0 );
+				m_remove.push_back( n );
+				remove_pass( c );
+			}
+		}
+		else
+		{
+			// Let the light around v in
+			if( c == Sun && v.y == m_size.y - 1 )
+			{
+				set( v, Sun, max_level );
+				Node n = { v, max_level };
+				m_add.push_back( n );
+			}
+			for( int d = 0; d != 6; ++d )
+			{
+				Node n = { v + detail::voxel_light_dirs[d], 0 };
+				if( inside( n.v ) && ( n.level = get( n.v, c ) ) != 0 )
+					m_add.push_back( n );
+			}
+		}
+
+		// A light source is lit whatever is in its voxel
+		std::unordered_map< int3, int, ChunkHash >::const_iterator s = m_sources.find( v );
+		if( c == Block && s != m_sources.end() && get( v, Block ) < s->second )
+		{
+			set( v, Block, s->second );
+			Node n = { v, s->second };
+			m_add.push_back( n );
+		}
+		add_pass( vol, opaque, c );
+	}
+	flush_changed();
+}
+
+template< typename V, typename F >
+void VoxelLightField::add_pass( V const &vol, F opaque, int c )
+{
+	for( size_t head = 0; head != m_add.size(); ++head )
+	{
+		Node a = m_add[ head ];
+		a.level = get( a.v, c ); // May have been cleared since it was queued
+		if( a.level <= 1 )
+			continue;
+		for( int d = 0; d != 6; ++d )
+		{
+			int3 n = a.v + detail::voxel_light_dirs[d];
+			int level = spread( c, a.level, d );
+			if( !inside( n ) || get( n, c ) >= level || opaque( vol.at( n ) ) )
+				continue;
+			set( n, c, level );
+			Node l = { n, level };
+			m_add.push_back( l );
+		}
+	}
+	m_add.clear();
+}
+
+#endif //VOXELLIGHT_H
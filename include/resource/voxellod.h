@@ -0,0 +1,133 @@
+#ifndef VOXELLOD_H
+#define VOXELLOD_H
+
+#include "resource/voxelbox.h"
+#include "math/vec3.h"
+
+#include <memory>
+#include <vector>
+
+// Ever coarser copies of a VoxelBox for drawing distant voxels with fewer
+// faces. Level 0 is the box itself and each level above halves the size,
+// a voxel of level l covering 2^l voxels of the box along each axis.
+//
+// A coarse voxel takes the value of the majority of the eight below it,
+// T() counting as empty. Ties go to solid, so floors and walls a voxel
+// thick survive, and a solid voxel takes whichever solid value is most
+// common below it.
+//
+// The box is kept by reference and must outlive the pyramid. After it
+// changes, update() votes again for just the voxels above the change.
+template< typename T >
+class VoxelLod
+{
+public:
+	VoxelLod( VoxelBox< T > const &source, int levels );
+
+	int level_count() const { return int( m_levels.size() ) + 1; }
+	VoxelBox< T > const &level( int l ) const { return l ? *m_levels[ l - 1 ] : m_source; }
+
+	// Votes again for the voxels above [lo, hi) of the box
+	void update( int3 const &lo, int3 const &hi );
+
+private:
+	// Votes for the voxels [lo, hi) of level l from the level below
+	void vote( int l, int3 const &lo, int3 const &hi );
+
+	VoxelBox< T > const &m_source;
+	std::vector< std::unique_ptr< VoxelBox< T > > > m_levels;
+};
+
+// The level to draw something at from its distance to the eye: full detail
+// within near, then one level coarser each time the distance doubles, so
+// the voxels of every level cover about the same area on screen and the
+// number of faces drawn stays roughly constant however far the view goes.
+inline int lod_level( float distance, float near, int levels )
+{
+	int l = 0;
+	for( float d = near; distance >= d && l < levels - 1; d *= 2.f )
+		++l;
+	return l;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+VoxelLod< T >::VoxelLod( VoxelBox< T > const &source, int levels )
+	: m_source( source )
+{
+	int3 size = source.size();
+	for( int l = 1; l < levels && ( size.x > 1 || size.y > 1 || size.z > 1 ); ++l )
+	{
+		size = int3( ( size.x + 1 ) / 2, ( size.y + 1 ) / 2, ( size.z + 1 ) / 2 );
+		m_levels.push_back( std::unique_ptr< VoxelBox< T > >( new VoxelBox< T >( size ) ) );
+
+		// Outside reads as outside the box does
+		m_levels.back()->at( -1, -1, -1 ) = source.at( -1, -1, -1 );
+		vote( l, int3( 0, 0, 0 ), size );
+	}
+}
+
+template< typename T >
+void VoxelLod< T >::update( int3 const &lo, int3 const &hi )
+{
+	int3 l0 = lo, l1 = hi;
+	for( int l = 1; l < level_count() && l0.x < l1.x && l0.y < l1.y && l0.z < l1.z; ++l )
+	{
+		l0 = int3( l0.x >> 1, l0.y >> 1, l0.z >> 1 );
+		l1 = int3( ( l1.x + 1 ) >> 1, ( l1.y + 1 ) >> 1, ( l1.z + 1 ) >> 1 );
+		int3 size = level( l ).size();
+		vote( l, int3( std::max( l0.x, 0 ), std::max( l0.y, 0 ), std::max( l0.z, 0 ) ),
+		      int3( std::min( l1.x, size.x ), std::min( l1.y, size.y ), std::min( l1.z, size.z ) ) );
+	}
+}
+
+template< typename T >
+void VoxelLod< T >::vote( int l, int3 const &lo, int3 const &hi )
+{
+	VoxelBox< T > const &below = level( l - 1 );
+	VoxelBox< T > &above = *m_levels[ l - 1 ];
+	int3 edge = below.size() - int3( 1, 1, 1 );
+
+	int3 v;
+	for( v.z = lo.z; v.z < hi.z; ++v.z )
+		for( v.y = lo.y; v.y < hi.y; ++v.y )
+			for( v.x = lo.x; v.x < hi.x; ++v.x )
+			{
+				// Voxels past the far side of an odd sized level are read
+				// as outside
+				T solid[8];
+				int n = 0;
+				int3 b = v * 2;
+				bool inside = b.x < edge.x && b.y < edge.y && b.z < edge.z;
+				for( int i = 0; i != 8; ++i )
+				{
+					int3 c( b.x + ( i & 1 ), b.y + ( i >> 1 & 1 ), b.z + ( i >> 2 ) );
+					T const &val = inside ? below.fast_at( c ) : below.at( c );
+					if( !( val == T() ) )
+						solid[ n++ ] = val;
+				}
+
+				T result = T();
+				if( n >= 4 )
+				{
+					int best = 0;
+					for( int i = 0; i != n; ++i )
+					{
+						int count = 0;
+						for( int j = 0; j != n; ++j )
+							count += solid[j] == solid[i];
+						if( count > best )
+						{
+							best = count;
+							result = solid[i];
+						}
+					}
+				}
+				above.fast_at( v ) = result;
+			}
+}
+
+#endif //VOXELLOD_H
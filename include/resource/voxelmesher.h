@@ -0,0 +1,363 @@
+#ifndef VOXELMESHER_H
+#define VOXELMESHER_H
+
+#include "common/threadpool.h"
+#include "resource/mesh.h"
+#include "resource/voxelbox.h"
+#include "resource/voxellod.h"
+#include "resource/voxelworld.h"
+#include "math/vec2.h"
+#include "math/vec3.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// CPU side voxel mesh, built without touching GL so it can be made off the
+// render thread and turned into a Mesh later by make_voxel_mesh().
+//
+// Quads cover whole runs of voxel faces, so uvs are in voxel units with one
+// texture repeat per voxel; the shader wraps them into the tile chosen by the
+// voxel type.
+//
+// Meshes built with light have the sunlight and point light levels of the
+// voxel each face looks onto, scaled from 0-15 to 0-255; lights is empty
+// otherwise.
+//
+// Each corner is also darkened by the solid voxels around it, as baked
+// ambient occlusion from 255 for an open corner down to 0 for one tucked
+// into an inside corner.
+struct VoxelMeshData
+{
+	std::vector< float3 > positions;
+	std::vector< char3 > normals;
+	std::vector< char3 > tangents;
+	std::vector< float2 > uvs;
+	std::vector< unsigned char > types;
+	std::vector< uchar2 > lights;
+	std::vector< unsigned char > occlusion;
+	std::vector< unsigned int > indices;
+
+	void clear();
+	int vertex_count() const { return int( positions.size() ); }
+	int quad_count() const { return int( positions.size() / 4 ); }
+
+	// Appends the quad at corner c spanning du and dv, wound so du x dv
+	// faces out, with uvs running from 0 to size
+	void add_quad( float3 const &c, float3 const &du, float3 const &dv, float2 const &size,
+	               char3 const &n, char3 const &t, unsigned char type );
+	// Lights the last quad added with levels packed as in VoxelLightField
+	void light_quad( unsigned char levels );
+	// Occludes the corners of the last quad added, from 0 for an open
+	// corner to 3, in the order they were added. The quad is split along
+	// whichever diagonal is more open, so a single dark corner shades just
+	// its own triangle rather than a band across the quad.
+	void occlude_quad( unsigned char const ao[4] );
+};
+
+// Meshes the voxels in [v0, v1) of vol, which can be anything with an
+// at( int3 ) const returning a voxel type below 256 where zero is empty, such
+// as a VoxelBox or VoxelWorld. Voxels outside the range are read to hide
+// faces against them but aren't meshed.
+//
+// Faces of the same type in the same plane are merged into maximal
+// rectangles, first along one axis then the other, so flat areas become a
+// handful of quads rather than one per voxel face.
+//
+// Given light levels, such as VoxelLightField::levels(), each face is lit by
+// the voxel it looks onto and only faces with the same light are merged.
+//
+// Each face corner is occluded by the two voxels along the edges beside it
+// and the one diagonally across, in the layer the face looks onto. Only
+// faces whose corners are occluded alike are merged, so the shading of a
+// merged quad stays exact.
+template< typename V >
+void greedy_mesh( V const &vol, int3 const &v0, int3 const &v1, VoxelMeshData &out,
+                  VoxelBox< unsigned char > const *light = 0 );
+
+// Meshes the voxels [v0, v1) of the box at a level of lod, in voxels of the
+// box rather than of the level, rounding the range out to whole voxels of
+// the level. Uvs are scaled to match, keeping one texture repeat per voxel
+// of the box.
+template< typename T >
+void greedy_mesh_lod( VoxelLod< T > const &lod, int level, int3 const &v0, int3 const &v1, VoxelMeshData &out );
+
+// Copies the data into a new vertex and index buffer
+Mesh make_voxel_mesh( VoxelMeshData const &data );
+
+// Keeps a mesh per chunk of a volume. Chunks are meshed concurrently on a
+// thread pool into CPU side data, which upload() then turns into meshes on
+// the render thread, as that's the only part that needs GL.
+class VoxelChunkMesher
+{
+public:
+	typedef std::unordered_map< int3, Mesh, ChunkHash > MeshMap;
+
+	explicit VoxelChunkMesher( int chunk_size = 32 );
+
+	int chunk_size() const { return m_chunk_size; }
+
+	// Appends the chunks overlapping the voxels [v0, v1) to chunks
+	void chunks_in( int3 const &v0, int3 const &v1, std::vector< int3 > &chunks ) const;
+
+	// Appends the chunks whose meshes may change with the edits in dirty:
+	// those holding a changed voxel, and neighbours whose faces or lighting
+	// read one. Each chunk is listed once.
+	void dirty_chunks( VoxelDirtyMap const &dirty, std::vector< int3 > &chunks ) const;
+
+	// Meshes the given chunks of vol on the pool, returning once all are
+	// done, lit by light if given. vol and light mustn't change until then.
+	template< typename V >
+	void build( V const &vol, std::vector< int3 > const &chunks, ThreadPool &pool,
+	            VoxelBox< unsigned char > const *light = 0 );
+
+	// As build(), meshing each chunk from the level of lod given in levels
+	template< typename T >
+	void build_lod( VoxelLod< T > const &lod, std::vector< int3 > const &chunks, std::vector< int > const &levels,
+	                ThreadPool &pool );
+
+	// Appends the level to draw each chunk at, by lod_level() of the
+	// distance from eye to the nearest point of the chunk
+	void lod_levels( std::vector< int3 > const &chunks, float3 const &eye, float near, int levels,
+	                 std::vector< int > &out ) const;
+
+	// The level the chunk's mesh was built at, or -1 if it has none, so
+	// only chunks whose level has changed need building again
+	int mesh_level( int3 const &c ) const;
+
+	// Replaces the meshes of chunks built since the last upload. Chunks
+	// with no faces are removed.
+	void upload();
+
+	// Drops anything built since the last upload
+	void discard();
+
+	MeshMap const &meshes() const { return m_meshes; }
+
+private:
+	int m_chunk_size;
+	std::vector< int3 > m_built_chunks;
+	std::vector< int > m_built_levels;
+	std::vector< VoxelMeshData > m_built;
+	MeshMap m_meshes;
+	std::unordered_map< int3, int, ChunkHash > m_mesh_levels;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+// Packed corner occlusion for each ring of eight voxels around the one a
+// face looks onto, two bits a corner, indexed by corner a + 2 * b
+unsigned char const *voxel_occlusion_table();
+}
+
+template< typename V >
+void greedy_mesh( V const &vol, int3 const &v0, int3 const &v1, VoxelMeshData &out,
+                  VoxelBox< unsigned char > const *light )
+{
+	int3 size = v1 - v0;
+
+	// Copy the range and a one voxel border once, so the masks below are
+	// built with plain strides rather than a lookup per face
+	int3 padded = size + int3( 2, 2, 2 );
+	int stride[3] = { 1, padded.x, padded.x * padded.y };
+	std::vector< unsigned char > vox( padded.x * padded.y * padded.z ), lit( light ? vox.size() : 0 );
+	int3 p;
+	int k = 0;
+	for( p.z = v0.z - 1; p.z <= v1.z; ++p.z )
+		for( p.y = v0.y - 1; p.y <= v1.y; ++p.y )
+			for( p.x = v0.x - 1; p.x <= v1.x; ++p.x, ++k )
+			{
+				vox[k] = ( unsigned char )vol.at( p );
+				if( light )
+					lit[k] = light->at( p );
+			}
+
+	unsigned char const *occlusion = detail::voxel_occlusion_table();
+	std::vector< int > mask;
+	for( int d = 0; d != 3; ++d )
+	{
+		// The mask runs along whichever of the other two axes is closer
+		// together in memory. Quads are wound around u and v, which follow
+		// d cyclically so that u x v is along d.
+		int u = ( d + 1 ) % 3, v = ( d + 2 ) % 3;
+		int ma = std::min( u, v ), mb = std::max( u, v );
+		mask.resize( size[ma] * size[mb] );
+
+		// Each plane s lies between voxel layers s - 1 and s along d. A face
+		// of the voxel behind is marked positive and faces the +d direction,
+		// one of the voxel in front is marked negative. The light of the
+		// voxel a face looks onto goes above the type, and above that the
+		// occlusion of its corners, looked up from which of the voxels
+		// ringing that one in the plane are solid.
+		int ring[8] =
+		{
+			-stride[ma] - stride[mb], -stride[mb], stride[ma] - stride[mb], stride[ma],
+			stride[ma] + stride[mb], stride[mb], -stride[ma] + stride[mb], -stride[ma]
+		};
+		for( int s = 0; s <= size[d]; ++s )
+		{
+			bool has_back = s > 0, has_front = s < size[d];
+			int n = 0, faces = 0;
+			for( int j = 0; j != size[mb]; ++j )
+			{
+				int first = ( s + 1 ) * stride[d] + stride[ma] + ( j + 1 ) * stride[mb];
+				unsigned char const *b = &vox[ first ];
+				unsigned char const *a = b - stride[d];
+				for( int i = 0; i != size[ma]; ++i, ++n, a += stride[ma], b += stride[ma] )
+				{
+					int m = 0;
+					unsigned char const *f = 0;
+					if( *a && !*b && has_back )
+						f = b;
+					else if( *b && !*a && has_front )
+						f = a;
+					if( f )
+					{
+						int solid = 0;
+						for( int r = 0; r != 8; ++r )
+							solid |= ( f[ ring[r] ] != 0 ) << r;
+						m = ( f == b ? *a : *b ) | occlusion[ solid ] << 16;
+						if( light )
+							m |= lit[ f - &vox[0] ] << 8;
+						if( f == a )
+							m = -m;
+					}
+					mask[n] = m;
+					faces += m != 0;
+				}
+			}
+
+			// Merge runs of equal mask values into rectangles, clearing
+			// them as they're used, until all the faces are covered
+			n = 0;
+			for( int j = 0; j != size[mb] && faces; ++j )
+				for( int i = 0; i != size[ma]; )
+				{
+					int m = mask[n];
+					if( !m )
+					{
+						++i, ++n;
+						continue;
+					}
+
+					int w = 1;
+					while( i + w < size[ma] && mask[n + w] == m )
+						++w;
+
+					int h = 1;
+					for( ; j + h < size[mb]; ++h )
+					{
+						int row = n + h * size[ma];
+						int k = 0;
+						while( k < w && mask[row + k] == m )
+							++k;
+						if( k < w )
+							break;
+					}
+
+					for( int l = 0; l != h; ++l )
+						for( int k = 0; k != w; ++k )
+							mask[n + l * size[ma] + k] = 0;
+					faces -= w * h;
+
+					float3 c( 0.f, 0.f, 0.f ), du( 0.f, 0.f, 0.f ), dv( 0.f, 0.f, 0.f );
+					c[d] = float( v0[d] + s );
+					c[ma] = float( v0[ma] + i );
+					c[mb] = float( v0[mb] + j );
+					if( u == ma )
+						du[u] = float( w ), dv[v] = float( h );
+					else
+						du[u] = float( h ), dv[v] = float( w );
+
+					// The first edge of a quad runs along ma or mb, which
+					// decides the corner each vertex lands on
+					char3 normal( 0, 0, 0 ), tangent( 0, 0, 0 );
+					int face = m > 0 ? m : -m;
+					bool first_ma = ( m > 0 ) == ( u == ma );
+					unsigned char ao[4];
+					for( int q = 0; q != 4; ++q )
+					{
+						int e1 = q == 1 || q == 2, e2 = q >= 2;
+						int corner = first_ma ? e1 + 2 * e2 : e2 + 2 * e1;
+						ao[q] = ( unsigned char )( ( face >> ( 16 + 2 * corner ) ) & 3 );
+					}
+					if( m > 0 )
+					{
+						normal[d] = 127;
+						tangent[u] = 127;
+						out.add_quad( c, du, dv, float2( du[u], dv[v] ), normal, tangent, ( unsigned char )face );
+					}
+					else
+					{
+						// Swapping the edges flips the winding, and keeps
+						// the tangent frame right handed
+						normal[d] = -127;
+						tangent[v] = 127;
+						out.add_quad( c, dv, du, float2( dv[v], du[u] ), normal, tangent, ( unsigned char )face );
+					}
+					if( light )
+						out.light_quad( ( unsigned char )( face >> 8 ) );
+					out.occlude_quad( ao );
+
+					i += w, n += w;
+				}
+		}
+	}
+}
+
+template< typename V >
+void VoxelChunkMesher::build( V const &vol, std::vector< int3 > const &chunks, ThreadPool &pool,
+                              VoxelBox< unsigned char > const *light )
+{
+	size_t first = m_built.size();
+	m_built_chunks.insert( m_built_chunks.end(), chunks.begin(), chunks.end() );
+	m_built_levels.resize( first + chunks.size(), 0 );
+	m_built.resize( first + chunks.size() );
+
+	int3 size( m_chunk_size, m_chunk_size, m_chunk_size );
+	pool.parallel_for( int( chunks.size() ), [&]( int i )
+	{
+		int3 v0 = chunks[i] * m_chunk_size;
+		greedy_mesh( vol, v0, v0 + size, m_built[first + i], light );
+	} );
+}
+
+template< typename T >
+void VoxelChunkMesher::build_lod( VoxelLod< T > const &lod, std::vector< int3 > const &chunks,
+                                  std::vector< int > const &levels, ThreadPool &pool )
+{
+	size_t first = m_built.size();
+	m_built_chunks.insert( m_built_chunks.end(), chunks.begin(), chunks.end() );
+	m_built_levels.insert( m_built_levels.end(), levels.begin(), levels.end() );
+	m_built.resize( first + chunks.size() );
+
+	int3 size( m_chunk_size, m_chunk_size, m_chunk_size );
+	pool.parallel_for( int( chunks.size() ), [&]( int i )
+	{
+		int3 v0 = chunks[i] * m_chunk_size;
+		greedy_mesh_lod( lod, levels[i], v0, v0 + size, m_built[first + i] );
+	} );
+}
+
+template< typename T >
+void greedy_mesh_lod( VoxelLod< T > const &lod, int level, int3 const &v0, int3 const &v1, VoxelMeshData &out )
+{
+	int first = out.vertex_count();
+	int3 l0( v0.x >> level, v0.y >> level, v0.z >> level );
+	int3 l1( ( v1.x + ( 1 << level ) - 1 ) >> level, ( v1.y + ( 1 << level ) - 1 ) >> level,
+	         ( v1.z + ( 1 << level ) - 1 ) >> level );
+	greedy_mesh( lod.level( level ), l0, l1, out );
+
+	float scale = float( 1 << level );
+	for( int i = first; i != out.vertex_count(); ++i )
+	{
+		out.positions[i] = out.positions[i] * scale;
+		out.uvs[i] = out.uvs[i] * scale;
+	}
+}
+
+#endif //VOXELMESHER_H
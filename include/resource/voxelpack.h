@@ -0,0 +1,427 @@
+#ifndef VOXELPACK_H
+#define VOXELPACK_H
+
+#include "resource/voxelbox.h"
+#include "resource/voxelworld.h"
+#include "math/vec3.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// A box of voxels stored as a palette of the distinct values in it, plus
+// either each voxel's palette index packed into 0, 1, 2, 4, 8 or 16 bits, or
+// runs of equal voxels along x. encode() keeps whichever is smaller.
+template< typename T >
+class PackedVoxelChunk
+{
+public:
+	PackedVoxelChunk() : m_size( 0, 0, 0 ), m_bits( 0 ) {}
+
+	void encode( VoxelBox< T > const &b, bool allow_runs = true );
+	void encode_uniform( int3 const &size, T const &val );
+	void decode( VoxelBox< T > &b ) const;
+
+	// A single voxel, without decoding the rest
+	T get( int x, int y, int z ) const;
+
+	// Appends the encoded chunk to out as bytes, palette values included as
+	// they are in memory, so T mustn't hold pointers
+	void write( std::vector< unsigned char > &out ) const;
+	// Reads back a chunk of the given size from write(). Returns false,
+	// leaving the chunk empty, and the chunk all T(), if the header doesn't fit
+	// the byte count. The indices themselves aren't checked.
+	bool read( int3 const &size, unsigned char const *data, size_t bytes );
+
+	int3 const &size() const { return m_size; }
+	bool uniform() const { return !m_bits; }
+	bool uses_runs() const { return !m_row_start.empty(); }
+	size_t memory() const;
+
+private:
+	struct Run
+	{
+		unsigned short end_x; // One past the run's last voxel
+		unsigned short index;
+	};
+
+	int packed_index( int i ) const
+	{
+		int bit = i * m_bits;
+		return int( ( m_packed[ bit >> 5 ] >> ( bit & 31 ) ) & ( ( 1u << m_bits ) - 1 ) );
+	}
+
+	int3 m_size;
+	std::vector< T > m_palette;
+	int m_bits;
+	std::vector< unsigned int > m_packed;
+	std::vector< unsigned int > m_row_start; // First run of each row, with one past the end last
+	std::vector< Run > m_runs;
+};
+
+// A chunked world of packed chunks, as VoxelWorld but several times smaller
+// when most chunks hold only a few voxel types.
+//
+// at() decodes the chunk it reads into a cache of recently used chunks, so
+// reads in an area already decoded cost a hash lookup. The cache should hold
+// the chunks a sweep passes through before coming back to them, such as a
+// slice of the world for row by row reads. It makes at() unsafe to call from
+// more than one thread at a time; decode() and PackedVoxelChunk::get() don't
+// use it.
+template< typename T >
+class PackedVoxelWorld
+{
+public:
+	static const int chunk_size = VoxelWorld< T >::chunk_size;
+
+	explicit PackedVoxelWorld( T const &empty = T(), bool allow_runs = true, int cache_chunks = 64 );
+
+	T at( int x, int y, int z ) const;
+	T at( int3 const &v ) const;
+
+	// Replaces a chunk with the voxels in b, which must be chunk_size^3
+	void store( int3 const &c, VoxelBox< T > const &b );
+	// Packs every chunk of w
+	void store( VoxelWorld< T > const &w );
+
+	// Writes a whole chunk into b, which must be chunk_size^3. Returns false,
+	// filling b with the empty value, if there's no such chunk.
+	bool decode( int3 const &c, VoxelBox< T > &b ) const;
+
+	PackedVoxelChunk< T > const *chunk( int3 const &c ) const;
+	size_t chunk_count() const { return m_chunks.size(); }
+
+	// Bytes held by the packed chunks, not counting the cache
+	size_t memory() const;
+
+private:
+	struct CacheEntry
+	{
+		CacheEntry() : box( int3( chunk_size, chunk_size, chunk_size ) ), last_use( 0 ), valid( false ) {}
+		int3 chunk;
+		VoxelBox< T > box;
+		unsigned int last_use;
+		bool valid;
+	};
+
+	VoxelBox< T > const &cached( int3 const &c ) const;
+	void uncache( int3 const &c );
+
+	typedef std::unordered_map< int3, PackedVoxelChunk< T >, ChunkHash > ChunkMap;
+
+	ChunkMap m_chunks;
+	T m_empty;
+	bool m_allow_runs;
+
+	mutable std::vector< CacheEntry > m_cache;
+	mutable std::unordered_map< int3, int, ChunkHash > m_cache_index;
+	mutable int m_last;
+	mutable unsigned int m_use_count;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+void PackedVoxelChunk< T >::encode( VoxelBox< T > const &b, bool allow_runs )
+{
+	m_size = b.size();
+	m_palette.clear();
+	m_packed.clear();
+	m_row_start.clear();
+	m_runs.clear();
+
+	// Palette indices of every voxel, and the runs they'd make along x
+	int count = m_size.x * m_size.y * m_size.z;
+	std::vector< int > indices( count );
+	std::vector< Run > runs;
+	std::vector< unsigned int > row_start;
+	int n = 0, prev = -1;
+	for( int z = 0; z != m_size.z; ++z )
+		for( int y = 0; y != m_size.y; ++y )
+		{
+			row_start.push_back( ( unsigned int )runs.size() );
+			for( int x = 0; x != m_size.x; ++x, ++n )
+			{
+				T const &v = b.fast_at( x, y, z );
+				int index = prev >= 0 && m_palette[ prev ] == v ? prev :
+				            int( std::find( m_palette.begin(), m_palette.end(), v ) - m_palette.begin() );
+				if( index == int( m_palette.size() ) )
+					m_palette.push_back( v );
+				indices[n] = prev = index;
+
+				if( x && runs.back().index == index )
+					++runs.back().end_x;
+				else
+				{
+					Run r = { ( unsigned short )( x + 1 ), ( unsigned short )index };
+					runs.push_back( r );
+				}
+			}
+		}
+	row_start.push_back( ( unsigned int )runs.size() );
+
+	m_bits = 0;
+	while( ( 1 << m_bits ) < int( m_palette.size() ) )
+		m_bits = m_bits ? m_bits * 2 : 1;
+
+	size_t packed_words = ( size_t( count ) * m_bits + 31 ) / 32;
+	size_t run_bytes = runs.size() * sizeof( Run ) + row_start.size() * sizeof( unsigned int );
+	if( m_bits && allow_runs && run_bytes < packed_words * sizeof( unsigned int ) )
+	{
+		m_runs.swap( runs );
+		m_row_start.swap( row_start );
+		return;
+	}
+
+	m_packed.assign( packed_words, 0u );
+	for( int i = 0; i != count && m_bits; ++i )
+	{
+		int bit = i * m_bits;
+		m_packed[ bit >> 5 ] |= unsigned( indices[i] ) << ( bit & 31 );
+	}
+}
+
+template< typename T >
+void PackedVoxelChunk< T >::encode_uniform( int3 const &size, T const &val )
+{
+	m_size = size;
+	m_palette.assign( 1, val );
+	m_bits = 0;
+	m_packed.clear();
+	m_row_start.clear();
+	m_runs.clear();
+}
+
+template< typename T >
+void PackedVoxelChunk< T >::decode( VoxelBox< T > &b ) const
+{
+	// A linear VoxelBox stores voxels in the order they were packed
+	T *out = &b.fast_at( 0, 0, 0 );
+	int count = m_size.x * m_size.y * m_size.z;
+
+	if( !m_bits )
+	{
+		std::fill( out, out + count, m_palette[0] );
+	}
+	else if( uses_runs() )
+	{
+		for( int row = 0; row != m_size.y * m_size.z; ++row, out += m_size.x )
+		{
+			int x = 0;
+			for( unsigned int r = m_row_start[ row ]; r != m_row_start[ row + 1 ]; ++r )
+			{
+				std::fill( out + x, out + m_runs[r].end_x, m_palette[ m_runs[r].index ] );
+				x = m_runs[r].end_x;
+			}
+		}
+	}
+	else
+	{
+		// A word at a time, shifting each index down in turn
+		unsigned int mask = ( 1u << m_bits ) - 1;
+		int per_word = 32 / m_bits;
+		for( size_t w = 0; w != m_packed.size(); ++w )
+		{
+			unsigned int bits = m_packed[w];
+			int n = std::min( per_word, count );
+			for( int k = 0; k != n; ++k, bits >>= m_bits )
+				*out++ = m_palette[ bits & mask ];
+			count -= n;
+		}
+	}
+}
+
+template< typename T >
+T PackedVoxelChunk< T >::get( int x, int y, int z ) const
+{
+	if( !m_bits )
+		return m_palette[0];
+
+	int row = y + m_size.y * z;
+	if( !uses_runs() )
+		return m_palette[ packed_index( x + m_size.x * row ) ];
+
+	// The first run ending after x
+	Run const *first = &m_runs[0] + m_row_start[ row ];
+	Run const *last = &m_runs[0] + m_row_start[ row + 1 ];
+	Run const *r = std::upper_bound( first, last, x, []( int x, Run const &r ) { return x < int( r.end_x ); } );
+	return m_palette[ r->index ];
+}
+
+template< typename T >
+void PackedVoxelChunk< T >::write( std::vector< unsigned char > &out ) const
+{
+	// Palette size, index bits and run count, then the palette, then either
+	// the row starts and runs or the packed indices
+	unsigned int counts[3] = { ( unsigned int )m_palette.size(), ( unsigned int )m_bits, ( unsigned int )m_runs.size() };
+	size_t at = out.size();
+	size_t bytes = sizeof( counts ) + m_palette.size() * sizeof( T ) + m_packed.size() * sizeof( unsigned int ) +
+	               m_row_start.size() * sizeof( unsigned int ) + m_runs.size() * sizeof( Run );
+	out.resize( at + bytes );
+
+	unsigned char *p = &out[ at ];
+	auto put = [&p]( void const *src, size_t n ) { if( n ) memcpy( p, src, n ); p += n; };
+	put( counts, sizeof( counts ) );
+	put( m_palette.data(), m_palette.size() * sizeof( T ) );
+	put( m_row_start.data(), m_row_start.size() * sizeof( unsigned int ) );
+	put( m_runs.data(), m_runs.size() * sizeof( Run ) );
+	put( m_packed.data(), m_packed.size() * sizeof( unsigned int ) );
+}
+
+template< typename T >
+bool PackedVoxelChunk< T >::read( int3 const &size, unsigned char const *data, size_t bytes )
+{
+	encode_uniform( size, T() );
+
+	unsigned int counts[3];
+	if( bytes < sizeof( counts ) )
+		return false;
+	memcpy( counts, data, sizeof( counts ) );
+
+	size_t count = size_t( size.x ) * size.y * size.z, rows = size_t( size.y ) * size.z;
+	size_t words = counts[2] ? 0 : ( count * counts[1] + 31 ) / 32;
+	size_t row_starts = counts[2] ? rows + 1 : 0;
+	bool valid_bits = counts[1] == 0 || counts[1] == 1 || counts[1] == 2 || counts[1] == 4 || counts[1] == 8 || counts[1] == 16;
+	if( !valid_bits || !counts[0] || counts[0] > ( 1u << counts[1] ) ||
+	    bytes != sizeof( counts ) + counts[0] * sizeof( T ) + words * sizeof( unsigned int ) +
+	             row_starts * sizeof( unsigned int ) + counts[2] * sizeof( Run ) )
+		return false;
+
+	m_palette.resize( counts[0] );
+	m_row_start.resize( row_starts );
+	m_runs.resize( counts[2] );
+	m_packed.resize( words );
+	unsigned char const *p = data + sizeof( counts );
+	auto get = [&p]( void *dst, size_t n ) { if( n ) memcpy( dst, p, n ); p += n; };
+	get( m_palette.data(), m_palette.size() * sizeof( T ) );
+	get( m_row_start.data(), m_row_start.size() * sizeof( unsigned int ) );
+	get( m_runs.data(), m_runs.size() * sizeof( Run ) );
+	get( m_packed.data(), m_packed.size() * sizeof( unsigned int ) );
+	m_bits = int( counts[1] );
+	return true;
+}
+
+template< typename T >
+size_t PackedVoxelChunk< T >::memory() const
+{
+	return sizeof( *this ) + m_palette.size() * sizeof( T ) + m_packed.size() * sizeof( unsigned int ) +
+	       m_row_start.size() * sizeof( unsigned int ) + m_runs.size() * sizeof( Run );
+}
+
+template< typename T >
+PackedVoxelWorld< T >::PackedVoxelWorld( T const &empty, bool allow_runs, int cache_chunks )
+	: m_empty( empty ), m_allow_runs( allow_runs ), m_cache( std::max( cache_chunks, 1 ) ), m_last( 0 ), m_use_count( 0 )
+{
+}
+
+template< typename T >
+T PackedVoxelWorld< T >::at( int x, int y, int z ) const
+{
+	int3 v( x, y, z );
+	return cached( VoxelWorld< T >::chunk_of( v ) ).fast_at( VoxelWorld< T >::local_of( v ) );
+}
+
+template< typename T >
+T PackedVoxelWorld< T >::at( int3 const &v ) const
+{
+	return at( v.x, v.y, v.z );
+}
+
+template< typename T >
+void PackedVoxelWorld< T >::store( int3 const &c, VoxelBox< T > const &b )
+{
+	m_chunks[c].encode( b, m_allow_runs );
+	uncache( c );
+}
+
+template< typename T >
+void PackedVoxelWorld< T >::store( VoxelWorld< T > const &w )
+{
+	w.for_each_chunk( [this]( int3 const &c, typename VoxelWorld< T >::Chunk const &chunk )
+	{
+		if( chunk.uniform() )
+		{
+			m_chunks[c].encode_uniform( int3( chunk_size, chunk_size, chunk_size ), chunk.value );
+			uncache( c );
+		}
+		else
+			store( c, *chunk.box );
+	} );
+}
+
+template< typename T >
+bool PackedVoxelWorld< T >::decode( int3 const &c, VoxelBox< T > &b ) const
+{
+	typename ChunkMap::const_iterator i = m_chunks.find( c );
+	if( i == m_chunks.end() )
+	{
+		fill( b, m_empty, 0, 0, 0, chunk_size, chunk_size, chunk_size );
+		return false;
+	}
+	i->second.decode( b );
+	return true;
+}
+
+template< typename T >
+PackedVoxelChunk< T > const *PackedVoxelWorld< T >::chunk( int3 const &c ) const
+{
+	typename ChunkMap::const_iterator i = m_chunks.find( c );
+	return i == m_chunks.end() ? 0 : &i->second;
+}
+
+template< typename T >
+size_t PackedVoxelWorld< T >::memory() const
+{
+	size_t bytes = 0;
+	for( typename ChunkMap::const_iterator i = m_chunks.begin(); i != m_chunks.end(); ++i )
+		bytes += sizeof( int3 ) + i->second.memory();
+	return bytes;
+}
+
+template< typename T >
+VoxelBox< T > const &PackedVoxelWorld< T >::cached( int3 const &c ) const
+{
+	if( m_cache[ m_last ].valid && m_cache[ m_last ].chunk == c )
+		return m_cache[ m_last ].box;
+
+	std::unordered_map< int3, int, ChunkHash >::const_iterator i = m_cache_index.find( c );
+	if( i != m_cache_index.end() )
+	{
+		m_last = i->second;
+		m_cache[ m_last ].last_use = ++m_use_count;
+		return m_cache[ m_last ].box;
+	}
+
+	// Decode into the least recently used entry
+	int oldest = 0;
+	for( int e = 0; e != int( m_cache.size() ) && m_cache[ oldest ].valid; ++e )
+		if( !m_cache[e].valid || m_cache[e].last_use < m_cache[ oldest ].last_use )
+			oldest = e;
+
+	CacheEntry &e = m_cache[ oldest ];
+	if( e.valid )
+		m_cache_index.erase( e.chunk );
+	decode( c, e.box );
+	e.chunk = c;
+	e.valid = true;
+	e.last_use = ++m_use_count;
+	m_cache_index[c] = oldest;
+	m_last = oldest;
+	return e.box;
+}
+
+template< typename T >
+void PackedVoxelWorld< T >::uncache( int3 const &c )
+{
+	std::unordered_map< int3, int, ChunkHash >::iterator i = m_cache_index.find( c );
+	if( i != m_cache_index.end() )
+	{
+		m_cache[ i->second ].valid = false;
+		m_cache_index.erase( i );
+	}
+}
+
+#endif //VOXELPACK_H
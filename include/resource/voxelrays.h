@@ -0,0 +1,221 @@
+#ifndef VOXELRAYS_H
+#define VOXELRAYS_H
+
+#include "math/simd.h"
+#include "math/vec3.h"
+
+#include <float.h>
+#include <math.h>
+
+struct VoxelRay
+{
+	float3 origin;
+	float3 dir; // Distances are in units of its length
+	float max_distance;
+};
+
+struct VoxelRayHit
+{
+	bool hit;
+	int3 voxel;     // The voxel that stopped the ray
+	int3 normal;    // Out of the face the ray entered through, zero if it started inside
+	float distance; // To where the ray entered the voxel, or max_distance if nothing was hit
+};
+
+// Walks each ray through the voxels of vol, which can be anything with an
+// at( int3 ) const such as a VoxelBox or VoxelWorld, until stop( value ) is
+// true for a voxel it passes through or it has gone max_distance.
+//
+// Rays are walked simd::wide_width at a time, the steps of every ray in a
+// packet worked out together. When a ray stops, the next one waiting takes
+// its lane, so a packet stays full until the rays run out rather than
+// waiting on its longest ray. Voxel reads are still made one ray at a time.
+template< typename V, typename F >
+void trace_rays( V const &vol, VoxelRay const *rays, VoxelRayHit *hits, int count, F stop );
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+namespace detail
+{
+
+// A packet's rays, lane by lane. The walk keeps them in registers, writing
+// them here to read single lanes and to start new rays in lanes whose rays
+// have stopped.
+struct VoxelRayLanes
+{
+	static const int width = simd::wide_width;
+
+	// Starts lane n on ray r
+	void start( int n, VoxelRay const &r, int index );
+	// Parks lane n on a ray that never steps
+	void park( int n );
+
+	float cell[3][ width ];  // The voxel each ray is in
+	float step[3][ width ];  // Towards the next voxel, +-1
+	float delta[3][ width ]; // Distance between planes
+	float next[3][ width ];  // Distance to the next plane
+	float entered[3][ width ];
+	float t[ width ];        // Distance to where the ray entered the voxel
+	float max_distance[ width ];
+	int ray[ width ];
+};
+
+inline void VoxelRayLanes::start( int n, VoxelRay const &r, int index )
+{
+	for( int i = 0; i != 3; ++i )
+	{
+		float o = r.origin[i], d = r.dir[i];
+		cell[i][n] = floorf( o );
+		step[i][n] = d > 0.f ? 1.f : -1.f;
+		if( d > FLT_MIN || d < -FLT_MIN )
+		{
+			delta[i][n] = 1.f / fabsf( d );
+			next[i][n] = ( cell[i][n] + ( d > 0.f ? 1.f : 0.f ) - o ) / d;
+		}
+		else
+			delta[i][n] = next[i][n] = FLT_MAX;
+		entered[i][n] = 0.f;
+	}
+	t[n] = 0.f;
+	max_distance[n] = r.max_distance;
+	ray[n] = index;
+}
+
+inline void VoxelRayLanes::park( int n )
+{
+	for( int i = 0; i != 3; ++i )
+	{
+		cell[i][n] = step[i][n] = entered[i][n] = 0.f;
+		delta[i][n] = next[i][n] = FLT_MAX;
+	}
+	t[n] = 0.f;
+	max_distance[n] = -1.f;
+	ray[n] = -1;
+}
+
+}
+
+template< typename V, typename F >
+void trace_rays( V const &vol, VoxelRay const *rays, VoxelRayHit *hits, int count, F stop )
+{
+	using simd::fwide;
+	const int width = simd::wide_width;
+
+	detail::VoxelRayLanes lanes;
+	int waiting = 0, live = 0;
+	for( int n = 0; n != width; ++n )
+	{
+		if( waiting < count )
+		{
+			lanes.start( n, rays[ waiting ], waiting );
+			++waiting;
+			live |= 1 << n;
+		}
+		else
+			lanes.park( n );
+	}
+
+	fwide cell[3], step[3], delta[3], next[3], entered[3], t, max_distance;
+	auto load = [&]()
+	{
+		for( int i = 0; i != 3; ++i )
+		{
+			cell[i] = fwide::load( lanes.cell[i] );
+			step[i] = fwide::load( lanes.step[i] );
+			delta[i] = fwide::load( lanes.delta[i] );
+			next[i] = fwide::load( lanes.next[i] );
+			entered[i] = fwide::load( lanes.entered[i] );
+		}
+		t = fwide::load( lanes.t );
+		max_distance = fwide::load( lanes.max_distance );
+	};
+	auto store = [&]()
+	{
+		for( int i = 0; i != 3; ++i )
+		{
+			step[i].store( lanes.step[i] );
+			delta[i].store( lanes.delta[i] );
+			next[i].store( lanes.next[i] );
+			entered[i].store( lanes.entered[i] );
+		}
+		max_distance.store( lanes.max_distance );
+	};
+	load();
+
+	fwide one( 1.f ), all = one <= one;
+	while( live )
+	{
+		// Test the voxel each ray is in. A ray that stops hands its lane to
+		// the next one waiting, whose first voxel is tested straight away.
+		for( int i = 0; i != 3; ++i )
+			cell[i].store( lanes.cell[i] );
+		t.store( lanes.t );
+		int ended = live & ~movemask( t <= max_distance );
+		bool stored = false;
+		for( int n = 0; n != width; ++n )
+		{
+			while( live & ( 1 << n ) )
+			{
+				int3 v( int( lanes.cell[0][n] ), int( lanes.cell[1][n] ), int( lanes.cell[2][n] ) );
+				if( !( ended & ( 1 << n ) ) && !stop( vol.at( v ) ) )
+					break;
+
+				if( !stored )
+				{
+					store();
+					stored = true;
+				}
+
+				VoxelRayHit &h = hits[ lanes.ray[n] ];
+				if( ended & ( 1 << n ) )
+				{
+					h.hit = false;
+					h.voxel = h.normal = int3( 0, 0, 0 );
+					h.distance = lanes.max_distance[n];
+				}
+				else
+				{
+					h.hit = true;
+					h.voxel = v;
+					h.normal = int3( int( lanes.entered[0][n] ), int( lanes.entered[1][n] ), int( lanes.entered[2][n] ) );
+					h.distance = lanes.t[n];
+				}
+
+				ended &= ~( 1 << n );
+				if( waiting < count )
+				{
+					lanes.start( n, rays[ waiting ], waiting );
+					++waiting;
+					if( lanes.t[n] > lanes.max_distance[n] )
+						ended |= 1 << n;
+				}
+				else
+				{
+					lanes.park( n );
+					live &= ~( 1 << n );
+				}
+			}
+		}
+		if( stored )
+			load();
+
+		// Every ray steps along whichever axis reaches a plane first, ties
+		// going to the later axis as in traverse()
+		fwide x_first = ( next[0] < next[1] ) & ( next[0] < next[2] );
+		fwide y_first = andnot( x_first, next[1] < next[2] );
+		fwide z_first = andnot( x_first | y_first, all );
+		fwide axis[3] = { x_first, y_first, z_first };
+
+		t = min( min( next[0], next[1] ), next[2] );
+		for( int i = 0; i != 3; ++i )
+		{
+			cell[i] = cell[i] + ( axis[i] & step[i] );
+			next[i] = next[i] + ( axis[i] & delta[i] );
+			entered[i] = axis[i] & -step[i];
+		}
+	}
+}
+
+#endif //VOXELRAYS_H
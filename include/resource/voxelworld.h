@@ -0,0 +1,441 @@
+#ifndef VOXELWORLD_H
+#define VOXELWORLD_H
+
+#include "resource/voxelbox.h"
+#include "math/vec3.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Hash for maps keyed by chunk coordinate
+struct ChunkHash
+{
+	size_t operator()( int3 const &c ) const
+	{
+		return size_t( c.x ) * 73856093u ^ size_t( c.y ) * 19349663u ^ size_t( c.z ) * 83492791u;
+	}
+};
+
+// The voxels [lo, hi)
+struct VoxelRange
+{
+	VoxelRange() {}
+	VoxelRange( int3 const &lo, int3 const &hi ) : lo( lo ), hi( hi ) {}
+
+	// Grows the range to cover r as well
+	void add( VoxelRange const &r );
+
+	int3 lo, hi;
+};
+
+// Per chunk, the bounds of the voxels changed within it
+typedef std::unordered_map< int3, VoxelRange, ChunkHash > VoxelDirtyMap;
+
+// An unbounded voxel world paged in chunk_size^3 chunks. Chunks that have
+// never been written read as the world's empty value and take no storage, and
+// chunks filled with a single value (all air, all stone) are kept as just that
+// value until something different is written into them.
+//
+// The non-const at() and fast_at() return references that may be written
+// through, so at() makes the chunk dense first. Read through a const world,
+// or write with set(), to keep uniform chunks uniform.
+//
+// Writes are recorded per chunk in dirty() until clear_dirty(), so meshes and
+// lighting can be updated for just the changed area. A non-const at() counts
+// as a write; writes through fast_at() aren't seen and need mark_dirty().
+template< typename T >
+class VoxelWorld
+{
+public:
+	static const int chunk_bits = 5;
+	static const int chunk_size = 1 << chunk_bits;
+	static const int chunk_mask = chunk_size - 1;
+
+	typedef VoxelBox< T > Box;
+
+	struct Chunk
+	{
+		Chunk( T const &val ) : value( val ) {}
+		bool uniform() const { return !box; }
+
+		T value; // Every voxel's value while the chunk is uniform
+		std::unique_ptr< Box > box;
+	};
+
+	explicit VoxelWorld( T const &empty = T() );
+
+	T &at( int x, int y, int z );
+	T const &at( int x, int y, int z ) const;
+	T &at( int3 const &v );
+	T const &at( int3 const &v ) const;
+
+	// As at(), but the chunk containing v must already be resident, and dense
+	// for the non-const version
+	T &fast_at( int x, int y, int z );
+	T const &fast_at( int x, int y, int z ) const;
+	T &fast_at( int3 const &v );
+	T const &fast_at( int3 const &v ) const;
+
+	void set( int x, int y, int z, T const &val );
+	void set( int3 const &v, T const &val );
+
+	T const &empty() const { return m_empty; }
+
+	static int3 chunk_of( int3 const &v ) { return int3( v.x >> chunk_bits, v.y >> chunk_bits, v.z >> chunk_bits ); }
+	static int3 local_of( int3 const &v ) { return int3( v.x & chunk_mask, v.y & chunk_mask, v.z & chunk_mask ); }
+
+	// Null if the chunk at chunk coordinate c has never been written
+	Chunk const *chunk( int3 const &c ) const;
+	Box &make_dense( int3 const &c );
+	void set_uniform( int3 const &c, T const &val );
+
+	// Turns dense chunks that hold a single value back into uniform ones, and
+	// drops uniform chunks holding the empty value
+	void compact();
+
+	VoxelDirtyMap const &dirty() const { return m_dirty; }
+	void mark_dirty( VoxelRange const &r );
+	void clear_dirty() { m_dirty.clear(); }
+
+	template< typename F >
+	void for_each_chunk( F func ) const; // func( int3 const &c, Chunk const & )
+
+	size_t chunk_count() const { return m_chunks.size(); }
+	size_t dense_chunk_count() const;
+
+private:
+	typedef std::unordered_map< int3, Chunk, ChunkHash > ChunkMap;
+
+	ChunkMap m_chunks;
+	VoxelDirtyMap m_dirty;
+	T m_empty;
+};
+
+template< typename T >
+void fill( VoxelWorld< T > &w, T const &val,
+           int x0, int y0, int z0,
+           int x1, int y1, int z1 );
+
+// Appends the index of each light whose radius reaches a changed voxel. L is
+// anything with a float4 position and a float radius, such as Light or
+// SceneLight.
+template< typename L >
+void lights_touching( VoxelDirtyMap const &dirty, L const *lights, int count, std::vector< int > &out );
+
+// Steps a ray through the world as traverse() does, passing each voxel's value
+// to func( int3 const &voxel, float3 const &position, T const &value )
+template< typename T, typename F >
+void traverse( VoxelWorld< T > const &w, float3 position, float3 const &dir, F &func );
+
+////////////////////////////////////////////////////////////////////////////////
+// Implementation
+////////////////////////////////////////////////////////////////////////////////
+
+inline void VoxelRange::add( VoxelRange const &r )
+{
+	for( int i = 0; i != 3; ++i )
+	{
+		lo[i] = std::min( lo[i], r.lo[i] );
+		hi[i] = std::max( hi[i], r.hi[i] );
+	}
+}
+
+template< typename T >
+VoxelWorld< T >::VoxelWorld( T const &empty )
+	: m_empty( empty )
+{
+}
+
+template< typename T >
+T &VoxelWorld< T >::at( int x, int y, int z )
+{
+	int3 v( x, y, z );
+	mark_dirty( VoxelRange( v, v + int3( 1, 1, 1 ) ) );
+	return make_dense( chunk_of( v ) ).fast_at( local_of( v ) );
+}
+
+template< typename T >
+T const &VoxelWorld< T >::at( int x, int y, int z ) const
+{
+	int3 v( x, y, z );
+	typename ChunkMap::const_iterator i = m_chunks.find( chunk_of( v ) );
+	if( i == m_chunks.end() )
+		return m_empty;
+	else if( i->second.uniform() )
+		return i->second.value;
+	else
+		return i->second.box->fast_at( local_of( v ) );
+}
+
+template< typename T >
+T &VoxelWorld< T >::at( int3 const &v )
+{
+	return at( v.x, v.y, v.z );
+}
+
+template< typename T >
+T const &VoxelWorld< T >::at( int3 const &v ) const
+{
+	return at( v.x, v.y, v.z );
+}
+
+template< typename T >
+T &VoxelWorld< T >::fast_at( int x, int y, int z )
+{
+	int3 v( x, y, z );
+	return m_chunks.find( chunk_of( v ) )->second.box->fast_at( local_of( v ) );
+}
+
+template< typename T >
+T const &VoxelWorld< T >::fast_at( int x, int y, int z ) const
+{
+	int3 v( x, y, z );
+	Chunk const &c = m_chunks.find( chunk_of( v ) )->second;
+	return c.uniform() ? c.value : c.box->fast_at( local_of( v ) );
+}
+
+template< typename T >
+T &VoxelWorld< T >::fast_at( int3 const &v )
+{
+	return fast_at( v.x, v.y, v.z );
+}
+
+template< typename T >
+T const &VoxelWorld< T >::fast_at( int3 const &v ) const
+{
+	return fast_at( v.x, v.y, v.z );
+}
+
+template< typename T >
+void VoxelWorld< T >::set( int x, int y, int z, T const &val )
+{
+	int3 v( x, y, z );
+	int3 c = chunk_of( v );
+	typename ChunkMap::iterator i = m_chunks.find( c );
+	if( i == m_chunks.end() )
+	{
+		if( val == m_empty )
+			return;
+	}
+	else if( i->second.uniform() )
+	{
+		if( val == i->second.value )
+			return;
+	}
+	else
+	{
+		T &voxel = i->second.box->fast_at( local_of( v ) );
+		if( voxel == val )
+			return;
+		voxel = val;
+		mark_dirty( VoxelRange( v, v + int3( 1, 1, 1 ) ) );
+		return;
+	}
+	make_dense( c ).fast_at( local_of( v ) ) = val;
+	mark_dirty( VoxelRange( v, v + int3( 1, 1, 1 ) ) );
+}
+
+template< typename T >
+void VoxelWorld< T >::set( int3 const &v, T const &val )
+{
+	set( v.x, v.y, v.z, val );
+}
+
+template< typename T >
+typename VoxelWorld< T >::Chunk const *VoxelWorld< T >::chunk( int3 const &c ) const
+{
+	typename ChunkMap::const_iterator i = m_chunks.find( c );
+	return i == m_chunks.end() ? 0 : &i->second;
+}
+
+template< typename T >
+typename VoxelWorld< T >::Box &VoxelWorld< T >::make_dense( int3 const &c )
+{
+	typename ChunkMap::iterator i = m_chunks.find( c );
+	if( i == m_chunks.end() )
+		i = m_chunks.insert( typename ChunkMap::value_type( c, Chunk( m_empty ) ) ).first;
+
+	Chunk &chunk = i->second;
+	if( chunk.uniform() )
+		chunk.box.reset( new Box( int3( chunk_size, chunk_size, chunk_size ), chunk.value ) );
+	return *chunk.box;
+}
+
+template< typename T >
+void VoxelWorld< T >::set_uniform( int3 const &c, T const &val )
+{
+	typename ChunkMap::iterator i = m_chunks.find( c );
+	if( i == m_chunks.end() ? val == m_empty : i->second.uniform() && i->second.value == val )
+		return;
+
+	int3 lo = c * chunk_size;
+	mark_dirty( VoxelRange( lo, lo + int3( chunk_size, chunk_size, chunk_size ) ) );
+
+	if( val == m_empty )
+	{
+		m_chunks.erase( i );
+	}
+	else if( i == m_chunks.end() )
+	{
+		m_chunks.insert( typename ChunkMap::value_type( c, Chunk( val ) ) );
+	}
+	else
+	{
+		i->second.value = val;
+		i->second.box.reset();
+	}
+}
+
+template< typename T >
+void VoxelWorld< T >::compact()
+{
+	for( typename ChunkMap::iterator i = m_chunks.begin(); i != m_chunks.end(); )
+	{
+		Chunk &chunk = i->second;
+		if( !chunk.uniform() )
+		{
+			T const *first = &chunk.box->fast_at( 0, 0, 0 );
+			T const *last = first + chunk_size * chunk_size * chunk_size;
+			if( std::find_if( first + 1, last, [first]( T const &v ) { return !( v == *first ); } ) == last )
+			{
+				chunk.value = *first;
+				chunk.box.reset();
+			}
+		}
+
+		if( chunk.uniform() && chunk.value == m_empty )
+			i = m_chunks.erase( i );
+		else
+			++i;
+	}
+}
+
+template< typename T >
+void VoxelWorld< T >::mark_dirty( VoxelRange const &r )
+{
+	int3 c0 = chunk_of( r.lo );
+	int3 c1 = chunk_of( r.hi - int3( 1, 1, 1 ) );
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+			{
+				int3 lo = c * chunk_size;
+				VoxelRange clipped( lo, lo + int3( chunk_size, chunk_size, chunk_size ) );
+				for( int i = 0; i != 3; ++i )
+				{
+					clipped.lo[i] = std::max( clipped.lo[i], r.lo[i] );
+					clipped.hi[i] = std::min( clipped.hi[i], r.hi[i] );
+				}
+
+				typename VoxelDirtyMap::iterator d = m_dirty.find( c );
+				if( d == m_dirty.end() )
+					m_dirty.insert( VoxelDirtyMap::value_type( c, clipped ) );
+				else
+					d->second.add( clipped );
+			}
+}
+
+template< typename T >
+template< typename F >
+void VoxelWorld< T >::for_each_chunk( F func ) const
+{
+	for( typename ChunkMap::const_iterator i = m_chunks.begin(); i != m_chunks.end(); ++i )
+		func( i->first, i->second );
+}
+
+template< typename T >
+size_t VoxelWorld< T >::dense_chunk_count() const
+{
+	size_t n = 0;
+	for( typename ChunkMap::const_iterator i = m_chunks.begin(); i != m_chunks.end(); ++i )
+		if( !i->second.uniform() )
+			++n;
+	return n;
+}
+
+template< typename T >
+void fill( VoxelWorld< T > &w, T const &val,
+           int x0, int y0, int z0,
+           int x1, int y1, int z1 )
+{
+	if( x0 >= x1 || y0 >= y1 || z0 >= z1 )
+		return;
+
+	typedef VoxelWorld< T > World;
+	int3 lo( x0, y0, z0 ), hi( x1, y1, z1 );
+	int3 c0 = World::chunk_of( lo );
+	int3 c1 = World::chunk_of( hi - int3( 1, 1, 1 ) );
+
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+			{
+				// The part of the region within this chunk, in chunk coordinates
+				int3 base = c * World::chunk_size;
+				int3 l0, l1;
+				bool whole = true;
+				for( int i = 0; i != 3; ++i )
+				{
+					l0[i] = std::max( lo[i] - base[i], 0 );
+					l1[i] = std::min( hi[i] - base[i], int( World::chunk_size ) );
+					whole = whole && l0[i] == 0 && l1[i] == World::chunk_size;
+				}
+
+				if( whole )
+				{
+					w.set_uniform( c, val );
+					continue;
+				}
+
+				typename World::Chunk const *chunk = w.chunk( c );
+				if( chunk ? chunk->uniform() && chunk->value == val : val == w.empty() )
+					continue;
+
+				w.mark_dirty( VoxelRange( base + l0, base + l1 ) );
+				typename World::Box &b = w.make_dense( c );
+				for( int z = l0.z; z < l1.z; ++z )
+					for( int y = l0.y; y < l1.y; ++y )
+					{
+						T *row = &b.fast_at( l0.x, y, z );
+						std::fill( row, row + ( l1.x - l0.x ), val );
+					}
+			}
+}
+
+template< typename L >
+void lights_touching( VoxelDirtyMap const &dirty, L const *lights, int count, std::vector< int > &out )
+{
+	for( int l = 0; l != count; ++l )
+	{
+		float3 p( lights[l].position.x, lights[l].position.y, lights[l].position.z );
+		float r2 = lights[l].radius * lights[l].radius;
+		for( VoxelDirtyMap::const_iterator d = dirty.begin(); d != dirty.end(); ++d )
+		{
+			// Distance from the light to the nearest point of the range
+			float dist2 = 0.f;
+			for( int i = 0; i != 3; ++i )
+			{
+				float e = std::max( std::max( float( d->second.lo[i] ) - p[i], p[i] - float( d->second.hi[i] ) ), 0.f );
+				dist2 += e * e;
+			}
+			if( dist2 < r2 )
+			{
+				out.push_back( l );
+				break;
+			}
+		}
+	}
+}
+
+template< typename T, typename F >
+void traverse( VoxelWorld< T > const &w, float3 position, float3 const &dir, F &func )
+{
+	auto step = [&w, &func]( int3 const &ip, float3 const &p ) { return func( ip, p, w.at( ip ) ); };
+	traverse( position, dir, step );
+}
+
+#endif //VOXELWORLD_H
@@ -0,0 +1,119 @@
+#include "common/mappedfile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile()
+	: m_data( 0 ), m_size( 0 ), m_open( false ), m_file( INVALID_HANDLE_VALUE ), m_mapping( 0 )
+{
+}
+
+bool MappedFile::open( char const *filename )
+{
+	close();
+
+	m_file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if( m_file == INVALID_HANDLE_VALUE )
+		return false;
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( m_file, &size ) )
+	{
+		close();
+		return false;
+	}
+	m_size = size_t( size.QuadPart );
+	m_open = true;
+	if( !m_size )
+		return true;
+
+	m_mapping = CreateFileMappingA( m_file, 0, PAGE_READONLY, 0, 0, 0 );
+	if( m_mapping )
+		m_data = ( unsigned char const * )MapViewOfFile( m_mapping, FILE_MAP_READ, 0, 0, 0 );
+	if( !m_data )
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( m_data )
+		UnmapViewOfFile( m_data );
+	if( m_mapping )
+		CloseHandle( m_mapping );
+	if( m_file != INVALID_HANDLE_VALUE )
+		CloseHandle( m_file );
+	m_data = 0;
+	m_size = 0;
+	m_open = false;
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = 0;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: m_data( 0 ), m_size( 0 ), m_open( false ), m_file( -1 )
+{
+}
+
+bool MappedFile::open( char const *filename )
+{
+	close();
+
+	m_file = ::open( filename, O_RDONLY );
+	if( m_file < 0 )
+		return false;
+
+	struct stat st;
+	if( fstat( m_file, &st ) != 0 )
+	{
+		close();
+		return false;
+	}
+	m_size = size_t( st.st_size );
+	m_open = true;
+	if( !m_size )
+		return true;
+
+	void *data = mmap( 0, m_size, PROT_READ, MAP_SHARED, m_file, 0 );
+	if( data == MAP_FAILED )
+	{
+		close();
+		return false;
+	}
+	m_data = ( unsigned char const * )data;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if( m_data )
+		munmap( ( void * )m_data, m_size );
+	if( m_file >= 0 )
+		::close( m_file );
+	m_data = 0;
+	m_size = 0;
+	m_open = false;
+	m_file = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	close();
+}
@@ -0,0 +1,60 @@
+#include "common/threadpool.h"
+
+ThreadPool::ThreadPool( int threads )
+	: m_pending( 0 ), m_stop( false )
+{
+	if( threads <= 0 )
+		threads = std::max( int( std::thread::hardware_concurrency() ), 1 );
+
+	for( int i = 0; i != threads; ++i )
+		m_threads.push_back( std::thread( &ThreadPool::worker, this ) );
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_stop = true;
+	}
+	m_job_ready.notify_all();
+	for( auto t = m_threads.begin(); t != m_threads.end(); ++t )
+		t->join();
+}
+
+void ThreadPool::run( std::function< void() > job )
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mutex );
+		m_jobs.push_back( std::move( job ) );
+		++m_pending;
+	}
+	m_job_ready.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock< std::mutex > lock( m_mutex );
+	m_all_done.wait( lock, [this]() { return m_pending == 0; } );
+}
+
+void ThreadPool::worker()
+{
+	for( ;; )
+	{
+		std::function< void() > job;
+		{
+			std::unique_lock< std::mutex > lock( m_mutex );
+			m_job_ready.wait( lock, [this]() { return m_stop || !m_jobs.empty(); } );
+			if( m_jobs.empty() )
+				return;
+			job = std::move( m_jobs.front() );
+			m_jobs.pop_front();
+		}
+
+		job();
+
+		std::lock_guard< std::mutex > lock( m_mutex );
+		if( --m_pending == 0 )
+			m_all_done.notify_all();
+	}
+}
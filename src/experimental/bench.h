@@ -0,0 +1,35 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Timing shared by the benchmarks in this directory
+
+#include <algorithm>
+#include <chrono>
+
+class Timer
+{
+public:
+	Timer() : m_start( std::chrono::high_resolution_clock::now() ) {}
+	double ms() const
+	{
+		return std::chrono::duration< double, std::milli >( std::chrono::high_resolution_clock::now() - m_start ).count();
+	}
+private:
+	std::chrono::high_resolution_clock::time_point m_start;
+};
+
+// Best of several runs, to keep the comparison stable on a busy machine
+template< typename F >
+double time_ms( F f, int runs = 5 )
+{
+	double best = 1e30;
+	for( int r = 0; r != runs; ++r )
+	{
+		Timer t;
+		f();
+		best = std::min( best, t.ms() );
+	}
+	return best;
+}
+
+#endif // BENCH_H
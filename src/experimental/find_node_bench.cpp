@@ -0,0 +1,71 @@
+// Compares looking up every node of a loaded model by name, as the loader does
+// for each bone and animation channel, with find_node()'s name index against
+// the visitor it used to run over the whole tree for each name. Each name is
+// given to two nodes, and it checks both find the same one of them.
+//
+// g++ -O2 -std=c++11 -I../../include find_node_bench.cpp -L<build dir> -lgrt -lGL -ldl -pthread -o find_node_bench
+
+#include "bench.h"
+#include "resource/scenenode.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// find_node as it was, visiting every node and keeping the last match
+class NodeFinder : public SceneNodeVisitor
+{
+public:
+	NodeFinder( char const *name ) : name( name ) {}
+	virtual void visit( SceneNode &n ) override { if( n.name() == name ) node = SceneNode::Ptr( &n ); }
+	SceneNode::Ptr node;
+	std::string name;
+};
+
+int main()
+{
+	printf( "%8s %14s %14s\n", "nodes", "visitor ms", "index ms" );
+	for( int count = 250; count <= 4000; count *= 4 )
+	{
+		// A tree of nodes named in pairs, each under a random earlier one
+		std::mt19937 rng( 3 );
+		std::vector< SceneNode::Ptr > nodes;
+		std::vector< std::string > names;
+		SceneNode::Ptr root( new SceneNode );
+		for( int i = 0; i != count; ++i )
+		{
+			SceneNode::Ptr n( new SceneNode );
+			names.push_back( "bone_" + std::to_string( i % ( count / 2 ) ) );
+			n->name( names.back() );
+			n->set_parent( i ? nodes[ rng() % i ].get() : root.get() );
+			nodes.push_back( n );
+		}
+
+		std::vector< SceneNode::Ptr > old_found( count ), new_found( count );
+		double visitor_ms = time_ms( [&]()
+		{
+			for( int i = 0; i != count; ++i )
+			{
+				NodeFinder finder( names[i].c_str() );
+				visit_scene( *root, finder );
+				old_found[i] = finder.node;
+			}
+		}, 3 );
+		double index_ms = time_ms( [&]()
+		{
+			// A rename drops the index, so each run builds it again
+			root->name( "root" );
+			root->name( "" );
+			for( int i = 0; i != count; ++i )
+				new_found[i] = find_node( *root, names[i].c_str() );
+		} );
+
+		bool same = true;
+		for( int i = 0; i != count; ++i )
+			same = same && old_found[i].get() == new_found[i].get() && new_found[i]->name() == names[i];
+		printf( "%8d %14.3f %14.3f  %.0fx %s\n", count, visitor_ms, index_ms, visitor_ms / index_ms, same ? "" : "MISMATCH" );
+	}
+	return 0;
+}
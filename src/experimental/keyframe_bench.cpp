@@ -0,0 +1,83 @@
+// Compares sampling keyframes with a cursor per channel, KeyData::get( time,
+// cursor ), against the binary search get( time ) does for every sample, for
+// 1000 skeletons of 60 channels playing one shared clip from different start
+// times. Also times sampling at random times, where each sample is a seek,
+// and checks both give the same values.
+//
+// g++ -O2 -std=c++11 -I../../include keyframe_bench.cpp -o keyframe_bench
+
+#include "bench.h"
+#include "resource/animation.h"
+
+#include <math.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+const int skeletons = 1000, rotations = 40, positions = 20;
+const double clip_length = 10.0, key_rate = 30.0, frame_rate = 60.0;
+const int frames = 60;
+
+int main()
+{
+	// A ten second clip keyed at 30Hz, shared by every skeleton
+	std::mt19937 rng( 2 );
+	std::uniform_real_distribution< float > angle( -1.f, 1.f );
+	std::vector< KeyData< floatq > > rotation_keys( rotations );
+	std::vector< KeyData< float3 > > position_keys( positions );
+	int keys = int( clip_length * key_rate );
+	for( int c = 0; c != rotations; ++c )
+		for( int k = 0; k != keys; ++k )
+		{
+			float a = angle( rng );
+			rotation_keys[c].push_back( k / key_rate, floatq( 0.f, sinf( a ), 0.f, cosf( a ) ) );
+		}
+	for( int c = 0; c != positions; ++c )
+		for( int k = 0; k != keys; ++k )
+			position_keys[c].push_back( k / key_rate, float3( angle( rng ), angle( rng ), angle( rng ) ) );
+
+	std::uniform_real_distribution< double > start( 0.0, clip_length - frames / frame_rate );
+	std::vector< double > starts( skeletons );
+	for( int s = 0; s != skeletons; ++s )
+		starts[s] = start( rng );
+
+	std::vector< int > cursors( skeletons * ( rotations + positions ) );
+	auto play = [&]( bool cursor, bool seek, double &sum )
+	{
+		std::uniform_real_distribution< double > anywhere( 0.0, clip_length );
+		std::mt19937 seeks( 4 );
+		std::fill( cursors.begin(), cursors.end(), 0 );
+		sum = 0.0;
+		for( int f = 0; f != frames; ++f )
+			for( int s = 0; s != skeletons; ++s )
+			{
+				double time = seek ? anywhere( seeks ) : starts[s] + f / frame_rate;
+				int *cursor_of = &cursors[ s * ( rotations + positions ) ];
+				for( int c = 0; c != rotations; ++c )
+				{
+					floatq q = cursor ? rotation_keys[c].get( time, cursor_of[c] ) : rotation_keys[c].get( time );
+					sum += q.y;
+				}
+				for( int c = 0; c != positions; ++c )
+				{
+					float3 p = cursor ? position_keys[c].get( time, cursor_of[ rotations + c ] ) : position_keys[c].get( time );
+					sum += p.x;
+				}
+			}
+	};
+
+	int samples = frames * skeletons * ( rotations + positions );
+	printf( "%d skeletons x %d channels, %d frames, %d keys per channel\n\n", skeletons, rotations + positions, frames, keys );
+	printf( "%-12s %16s %14s\n", "", "binary search ms", "cursor ms" );
+	char const *names[2] = { "playing", "seeking" };
+	for( int seek = 0; seek != 2; ++seek )
+	{
+		double search_sum, cursor_sum;
+		double search_ms = time_ms( [&]() { play( false, seek != 0, search_sum ); } );
+		double cursor_ms = time_ms( [&]() { play( true, seek != 0, cursor_sum ); } );
+		printf( "%-12s %16.2f %14.2f  %.2fx, %.1f ns a sample %s\n", names[seek], search_ms, cursor_ms,
+		        search_ms / cursor_ms, cursor_ms * 1e6 / samples, search_sum == cursor_sum ? "" : "MISMATCH" );
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+// Compares the SIMD float44 specializations against the generic mat44 template.
+//
+// The generic code is instantiated on a float wrapper that the specializations
+// don't match, so both versions are built from the same source in one binary.
+//
+// g++ -O2 -std=c++11 -I../../include mat44_bench.cpp -o mat44_bench
+
+#include "bench.h"
+#include "math/mat44.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+struct scalar
+{
+	scalar() {}
+	scalar( float f ) : f( f ) {}
+	operator float() const { return f; }
+	scalar &operator*=( scalar s ) { f *= s.f; return *this; }
+	float f;
+};
+
+typedef mat44< scalar > scalar44;
+typedef vec4< scalar > scalar4;
+
+float random_float() { return rand() / float( RAND_MAX ) * 2.f - 1.f; }
+
+float44 random_matrix()
+{
+	float44 m;
+	for( int c = 0; c != 4; ++c )
+		for( int r = 0; r != 4; ++r )
+			m[c][r] = random_float();
+	return m;
+}
+
+float max_difference( float44 const &a, scalar44 const &b )
+{
+	float d = 0.f;
+	for( int c = 0; c != 4; ++c )
+		for( int r = 0; r != 4; ++r )
+			d = std::max( d, std::abs( a[c][r] - b[c][r] ) );
+	return d;
+}
+
+template< typename M, typename F >
+double run( std::vector< M > const &ms, std::vector< M > &out, int reps, F f )
+{
+	Timer timer;
+	size_t n = ms.size();
+	for( int r = 0; r != reps; ++r )
+		for( size_t i = 0; i != n; ++i )
+			out[i] = f( ms[i], ms[( i + r ) % n] );
+	return timer.ms();
+}
+
+int main()
+{
+	const int count = 1024, reps = 2000;
+	std::vector< float44 > fm( count );
+	std::vector< scalar44 > sm( count );
+	for( int i = 0; i != count; ++i )
+	{
+		fm[i] = random_matrix();
+		sm[i] = scalar44( fm[i] );
+	}
+
+	float err = 0.f;
+	for( int i = 0; i + 1 < count; ++i )
+	{
+		err = std::max( err, max_difference( fm[i] * fm[i + 1], sm[i] * sm[i + 1] ) );
+		err = std::max( err, max_difference( transpose( fm[i] ), transpose( sm[i] ) ) );
+		err = std::max( err, max_difference( inverse( fm[i] ) * fm[i], inverse( sm[i] ) * sm[i] ) );
+		float4 fv = fm[i] * fm[i + 1].t;
+		scalar4 sv = sm[i] * sm[i + 1].t;
+		for( int r = 0; r != 4; ++r )
+			err = std::max( err, std::abs( fv[r] - sv[r] ) );
+	}
+	printf( "max difference %g\n", err );
+
+	std::vector< float44 > fout( count );
+	std::vector< scalar44 > sout( count );
+
+	printf( "%-12s %10s %10s %8s\n", "op", "generic ms", "simd ms", "speedup" );
+
+	double g = run( sm, sout, reps, []( scalar44 const &a, scalar44 const &b ) { return a * b; } );
+	double s = run( fm, fout, reps, []( float44 const &a, float44 const &b ) { return a * b; } );
+	printf( "%-12s %10.2f %10.2f %8.2f\n", "mat * mat", g, s, g / s );
+
+	g = run( sm, sout, reps, []( scalar44 const &a, scalar44 const &b ) { scalar44 r( a ); r.t = a * b.t; return r; } );
+	s = run( fm, fout, reps, []( float44 const &a, float44 const &b ) { float44 r( a ); r.t = a * b.t; return r; } );
+	printf( "%-12s %10.2f %10.2f %8.2f\n", "mat * vec", g, s, g / s );
+
+	g = run( sm, sout, reps, []( scalar44 const &a, scalar44 const & ) { return transpose( a ); } );
+	s = run( fm, fout, reps, []( float44 const &a, float44 const & ) { return transpose( a ); } );
+	printf( "%-12s %10.2f %10.2f %8.2f\n", "transpose", g, s, g / s );
+
+	g = run( sm, sout, reps, []( scalar44 const &a, scalar44 const & ) { return inverse( a ); } );
+	s = run( fm, fout, reps, []( float44 const &a, float44 const & ) { return inverse( a ); } );
+	printf( "%-12s %10.2f %10.2f %8.2f\n", "inverse", g, s, g / s );
+
+	printf( "checksum %g\n", float( fout[count / 2].t.w ) + float( sout[count / 2].t.w ) );
+	return 0;
+}
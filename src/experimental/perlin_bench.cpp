@@ -0,0 +1,45 @@
+// Compares perlin_batch and fbm_batch against calling the scalar versions per
+// point. The batch functions are only vectorised when built with AVX2.
+//
+// g++ -O2 -mavx2 -std=c++11 -I../../include perlin_bench.cpp ../math/perlin.cpp -o perlin_bench
+
+#include "bench.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+float random_float() { return rand() / float( RAND_MAX ) * 64.f - 32.f; }
+
+float max_difference( std::vector< float > const &a, std::vector< float > const &b )
+{
+	float d = 0.f;
+	for( size_t i = 0; i != a.size(); ++i )
+		d = std::max( d, std::abs( a[i] - b[i] ) );
+	return d;
+}
+
+int main()
+{
+	const size_t count = 1 << 20;
+	const int octaves = 4;
+	std::vector< float3 > pts( count );
+	for( auto &p : pts )
+		p = float3( random_float(), random_float(), random_float() );
+
+	std::vector< float > scalar( count ), batch( count );
+
+	printf( "%-8s %10s %10s %8s %12s\n", "", "scalar ms", "batch ms", "speedup", "max diff" );
+
+	double scalar_ms = time_ms( [&]() { for( size_t i = 0; i != count; ++i ) scalar[i] = perlin( pts[i] ); } );
+	double batch_ms = time_ms( [&]() { perlin_batch( &pts[0], &batch[0], count ); } );
+	printf( "%-8s %10.2f %10.2f %8.2f %12g\n", "perlin", scalar_ms, batch_ms, scalar_ms / batch_ms, max_difference( scalar, batch ) );
+
+	scalar_ms = time_ms( [&]() { for( size_t i = 0; i != count; ++i ) scalar[i] = fbm( pts[i], octaves ); } );
+	batch_ms = time_ms( [&]() { fbm_batch( &pts[0], &batch[0], count, octaves ); } );
+	printf( "%-8s %10.2f %10.2f %8.2f %12g\n", "fbm", scalar_ms, batch_ms, scalar_ms / batch_ms, max_difference( scalar, batch ) );
+	return 0;
+}
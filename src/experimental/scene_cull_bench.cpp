@@ -0,0 +1,89 @@
+// Compares culling many mesh bounds against a camera frustum with an AABBTree
+// against testing every box with FrustumCuller, as PPRenderer used to, for a
+// city of meshes seen from inside it looking along a street. The tree tests
+// the boxes of leaves it can't take whole with FrustumCuller too. Also times
+// refitting the tree after some of the meshes move, and checks both find the
+// same meshes visible, as does listing the handles of those the tree finds.
+//
+// g++ -O2 -std=c++11 -I../../include scene_cull_bench.cpp ../math/aabbtree.cpp ../math/frustum.cpp -o scene_cull_bench
+
+#include "bench.h"
+#include "math/aabbtree.h"
+#include "math/frustum.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int count_bits( std::vector< unsigned int > const &v )
+{
+	int n = 0;
+	for( size_t i = 0; i != v.size(); ++i )
+		for( unsigned int w = v[i]; w; w &= w - 1 )
+			++n;
+	return n;
+}
+
+int main()
+{
+	const float city = 2000.f;
+	float44 camera_from_world = inverse( look_at( float4( 1000.f, 2.f, 0.f, 1.f ), float4( 1000.f, 2.f, 100.f, 1.f ) ) );
+	Frustum frustum( perspective( 1.0f, 16.f / 9.f, 0.1f, 500.f ) * camera_from_world );
+
+	printf( "%8s %9s %12s %10s %12s %14s\n", "meshes", "visible", "flat ms", "tree ms", "nodes tested", "refit 10% ms" );
+	for( int count = 10000; count <= 160000; count *= 4 )
+	{
+		std::mt19937 rng( 5 );
+		std::uniform_real_distribution< float > along( 0.f, city ), size( 0.5f, 4.f );
+		std::vector< AABB > boxes( count );
+		for( int i = 0; i != count; ++i )
+		{
+			boxes[i].mid = float3( along( rng ), size( rng ), along( rng ) );
+			boxes[i].half_size = float3( size( rng ), size( rng ), size( rng ) );
+		}
+
+		AABBArray flat;
+		for( int i = 0; i != count; ++i )
+			flat.push_back( boxes[i] );
+		std::vector< unsigned int > flat_visible, tree_visible;
+		double flat_ms = time_ms( [&]() { FrustumCuller( frustum ).cull( flat, flat_visible ); } );
+
+		AABBTree tree;
+		for( int i = 0; i != count; ++i )
+			tree.insert( boxes[i] );
+		tree.rebuild();
+		double tree_ms = time_ms( [&]() { tree.cull( frustum, tree_visible ); } );
+		int tested = tree.tested();
+
+		// Handles are given out in order, so bit i means box i in both
+		bool same = flat_visible == tree_visible;
+		std::vector< int > handles;
+		tree.cull( frustum, handles );
+		same = same && int( handles.size() ) == count_bits( tree_visible );
+		for( size_t i = 0; i != handles.size(); ++i )
+			same = same && FrustumCuller::is_visible( tree_visible, handles[i] );
+
+		std::uniform_int_distribution< int > which( 0, count - 1 );
+		std::uniform_real_distribution< float > step( -1.f, 1.f );
+		double refit_ms = time_ms( [&]()
+		{
+			for( int k = 0; k != count / 10; ++k )
+			{
+				int i = which( rng );
+				boxes[i].mid += float3( step( rng ), 0.f, step( rng ) );
+				tree.move( i, boxes[i] );
+			}
+		} );
+		flat.clear();
+		for( int i = 0; i != count; ++i )
+			flat.push_back( boxes[i] );
+		FrustumCuller( frustum ).cull( flat, flat_visible );
+		tree.cull( frustum, tree_visible );
+		same = same && flat_visible == tree_visible;
+
+		printf( "%8d %9d %12.3f %10.3f %12d %14.3f  %.1fx %s\n", count, count_bits( flat_visible ), flat_ms, tree_ms,
+		        tested, refit_ms, flat_ms / tree_ms, same ? "" : "MISMATCH" );
+	}
+	return 0;
+}
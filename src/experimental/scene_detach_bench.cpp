@@ -0,0 +1,74 @@
+// Times despawning and respawning entities under a wide scene root with
+// SceneNode::set_parent, whose detach now swaps the last child into the gap,
+// against the std::remove over the siblings it used to do, for roots with
+// more and more children. The old way is timed on a bare vector of children,
+// without the rest of set_parent's work. The entities are meshes, so it also
+// times set_parent once the root's mesh list is kept up to date.
+//
+// g++ -O2 -std=c++11 -I../../include scene_detach_bench.cpp -L<build dir> -lgrt -lGL -ldl -pthread -o scene_detach_bench
+
+#include "bench.h"
+#include "resource/scenenode.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+int main()
+{
+	const int churn = 1000;
+	printf( "%10s %22s %22s %22s\n", "children", "std::remove ms", "set_parent ms", "listed set_parent ms" );
+	for( int width = 1000; width <= 64000; width *= 4 )
+	{
+		std::mt19937 rng( 1 );
+		SceneNode::Ptr root( new SceneNode );
+		std::vector< SceneNode::Ptr > entities;
+		for( int i = 0; i != width; ++i )
+		{
+			entities.push_back( SceneNode::Ptr( new SceneMesh ) );
+			entities.back()->set_parent( root.get() );
+		}
+		std::vector< int > which( churn );
+		for( int i = 0; i != churn; ++i )
+			which[i] = int( rng() % width );
+
+		std::vector< SceneNode::Ptr > children( entities );
+		double remove_ms = time_ms( [&]()
+		{
+			for( int i = 0; i != churn; ++i )
+			{
+				SceneNode::Ptr p = entities[ which[i] ];
+				children.erase( std::remove( children.begin(), children.end(), p ), children.end() );
+				children.push_back( p );
+			}
+		} );
+
+		double set_parent_ms = time_ms( [&]()
+		{
+			for( int i = 0; i != churn; ++i )
+			{
+				entities[ which[i] ]->set_parent( 0 );
+				entities[ which[i] ]->set_parent( root.get() );
+			}
+		} );
+
+		root->meshes();
+		double listed_ms = time_ms( [&]()
+		{
+			for( int i = 0; i != churn; ++i )
+			{
+				entities[ which[i] ]->set_parent( 0 );
+				entities[ which[i] ]->set_parent( root.get() );
+			}
+		} );
+
+		// Every entity still under the root once
+		int under = 0;
+		for( auto c = root->begin(); c != root->end(); ++c )
+			++under;
+		bool same = under == width && int( root->meshes().size() ) == width;
+		printf( "%10d %22.3f %22.3f %22.3f  %s\n", width, remove_ms, set_parent_ms, listed_ms, same ? "" : "MISMATCH" );
+	}
+	return 0;
+}
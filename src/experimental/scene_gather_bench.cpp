@@ -0,0 +1,77 @@
+// Compares gathering the meshes and lights of a scene each frame from the
+// lists SceneNode keeps against a visitor run over every node, as PPRenderer
+// used to, for a scene of mostly plain nodes with a mesh in ten. Also times
+// the frame after a node is added, which updates the lists in place, and
+// checks both find the same meshes and lights.
+//
+// g++ -O2 -std=c++11 -I../../include scene_gather_bench.cpp -L<build dir> -lgrt -lGL -ldl -pthread -o scene_gather_bench
+
+#include "bench.h"
+#include "resource/scenenode.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+class Gatherer : public SceneNodeVisitor
+{
+public:
+	virtual void visit( SceneMesh &m ) override { meshes.push_back( &m ); }
+	virtual void visit( SceneLight &l ) override { lights.push_back( &l ); }
+	std::vector< SceneMesh * > meshes;
+	std::vector< SceneLight * > lights;
+};
+
+int main()
+{
+	printf( "%8s %14s %14s %16s\n", "nodes", "visitor ms", "lists ms", "after add ms" );
+	for( int count = 5000; count <= 80000; count *= 4 )
+	{
+		std::mt19937 rng( 9 );
+		std::vector< SceneNode::Ptr > nodes;
+		SceneNode::Ptr root( new SceneNode );
+		for( int i = 0; i != count; ++i )
+		{
+			SceneNode::Ptr n;
+			if( i % 10 == 0 )
+				n.set( new SceneMesh );
+			else if( i % 500 == 1 )
+				n.set( new SceneLight );
+			else
+				n.set( new SceneNode );
+			n->set_parent( i ? nodes[ rng() % i ].get() : root.get() );
+			nodes.push_back( n );
+		}
+
+		Gatherer g;
+		double visitor_ms = time_ms( [&]()
+		{
+			g.meshes.clear();
+			g.lights.clear();
+			visit_scene( *root, g );
+		} );
+
+		std::vector< SceneMesh * > meshes;
+		std::vector< SceneLight * > lights;
+		double lists_ms = time_ms( [&]()
+		{
+			meshes = root->meshes();
+			lights = root->lights();
+		} );
+		bool same = meshes == g.meshes && lights == g.lights;
+
+		SceneNode::Ptr extra( new SceneMesh );
+		double added_ms = time_ms( [&]()
+		{
+			extra->set_parent( 0 );
+			extra->set_parent( nodes[ count / 2 ].get() );
+			meshes = root->meshes();
+			lights = root->lights();
+		} );
+
+		printf( "%8d %14.3f %14.3f %16.3f  %.0fx %s\n", count, visitor_ms, lists_ms, added_ms, visitor_ms / lists_ms,
+		        same ? "" : "MISMATCH" );
+	}
+	return 0;
+}
@@ -0,0 +1,60 @@
+// Compares the cost of a noise value plus normal-perturbation gradient:
+// perlin() and simplex() with the gradient found by forward differences,
+// against simplex_batch() returning the analytic gradient in the same pass.
+//
+// g++ -O2 -std=c++11 -I../../include simplex_bench.cpp ../math/perlin.cpp ../math/simplex.cpp -o simplex_bench
+
+#include "bench.h"
+#include "math/perlin.h"
+#include "math/simplex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+float random_float() { return rand() / float( RAND_MAX ) * 64.f - 32.f; }
+
+template< typename N >
+void differences( std::vector< float3 > const &pts, std::vector< float > &out, std::vector< float3 > &grad, N noise )
+{
+	const float h = 1.f / 64.f;
+	for( size_t i = 0; i != pts.size(); ++i )
+	{
+		float3 p = pts[i];
+		float v = noise( p );
+		out[i] = v;
+		grad[i] = float3( noise( float3( p.x + h, p.y, p.z ) ) - v,
+		                  noise( float3( p.x, p.y + h, p.z ) ) - v,
+		                  noise( float3( p.x, p.y, p.z + h ) ) - v ) * ( 1.f / h );
+	}
+}
+
+int main()
+{
+	const size_t count = 1 << 20;
+	std::vector< float3 > pts( count );
+	for( auto &p : pts )
+		p = float3( random_float(), random_float(), random_float() );
+
+	std::vector< float > out( count ), analytic( count );
+	std::vector< float3 > grad( count ), analytic_grad( count );
+
+	double perlin_ms = time_ms( [&]() { differences( pts, out, grad, []( float3 p ) { return perlin( p ); } ); } );
+	double simplex_ms = time_ms( [&]() { differences( pts, out, grad, []( float3 p ) { return simplex( p ); } ); } );
+	double value_ms = time_ms( [&]() { simplex_batch( &pts[0], &analytic[0], 0, count ); } );
+	double analytic_ms = time_ms( [&]() { simplex_batch( &pts[0], &analytic[0], &analytic_grad[0], count ); } );
+
+	float err = 0.f;
+	for( size_t i = 0; i != count; ++i )
+		for( int c = 0; c != 3; ++c )
+			err = std::max( err, std::abs( grad[i][c] - analytic_grad[i][c] ) );
+
+	printf( "%-28s %10.2f ms\n", "perlin + differences", perlin_ms );
+	printf( "%-28s %10.2f ms\n", "simplex + differences", simplex_ms );
+	printf( "%-28s %10.2f ms\n", "simplex_batch value only", value_ms );
+	printf( "%-28s %10.2f ms\n", "simplex_batch + gradient", analytic_ms );
+	printf( "max gradient difference %g\n", err );
+	return 0;
+}
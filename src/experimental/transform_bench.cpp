@@ -0,0 +1,214 @@
+// Compares working out world transforms for 50,000 nodes in a TransformHierarchy
+// against the way SceneNode used to, each node holding its own transforms and
+// walking up its parents for them, marking its descendants dirty when moved.
+// The nodes are 500 skeletons of 100 bones under one scene root, allocated in
+// a shuffled order as nodes loaded one model at a time end up about the heap.
+// Each frame moves some or all of the bones, then reads every world
+// transform. The flat update is timed on one thread and shared out over a
+// thread pool. Also checks they all give the same transforms.
+//
+// g++ -O2 -std=c++11 -I../../include transform_bench.cpp ../resource/transformhierarchy.cpp
+//     ../common/threadpool.cpp -pthread -o transform_bench
+
+#include "bench.h"
+#include "resource/transformhierarchy.h"
+#include "common/threadpool.h"
+#include "math/mat33.h"
+
+#include <math.h>
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+// SceneNode's transforms as they were
+struct OldNode
+{
+	OldNode() : m_position( 0.f, 0.f, 0.f ), m_scale( 1.f, 1.f, 1.f ), m_dirty( false ), m_local_dirty( false ), m_parent( 0 ) {}
+
+	void set_parent( OldNode *parent )
+	{
+		m_parent = parent;
+		parent->m_children.push_back( this );
+		set_dirty();
+	}
+
+	float44 const &world_from_local()
+	{
+		if( m_dirty )
+		{
+			if( m_parent )
+				m_world_from_local = m_parent->world_from_local() * parent_from_local();
+			else
+				m_world_from_local = parent_from_local();
+			m_dirty = false;
+		}
+		return m_world_from_local;
+	}
+
+	float44 const &parent_from_local()
+	{
+		if( m_local_dirty )
+		{
+			float44 r;
+			to_matrix( m_rotation, r );
+			m_parent_from_local = r * ::scale( float4( m_scale, 1.0f ) );
+			m_parent_from_local.t.xyz() = m_position;
+			m_local_dirty = false;
+		}
+		return m_parent_from_local;
+	}
+
+	void rotation( floatq const &q )
+	{
+		if( q != m_rotation )
+		{
+			set_dirty();
+			m_local_dirty = true;
+			m_rotation = q;
+		}
+	}
+
+	void position( float3 const &p )
+	{
+		if( p != m_position )
+		{
+			set_dirty();
+			m_local_dirty = true;
+			m_position = p;
+		}
+	}
+
+	void set_dirty()
+	{
+		if( m_dirty )
+			return;
+		m_dirty = true;
+		for( size_t i = 0; i != m_children.size(); ++i )
+			m_children[i]->set_dirty();
+	}
+
+	float44 m_parent_from_local;
+	float44 m_world_from_local;
+	floatq m_rotation;
+	float3 m_position;
+	float3 m_scale;
+	bool m_dirty;
+	bool m_local_dirty;
+	std::vector< OldNode * > m_children;
+	OldNode *m_parent;
+};
+
+const int skeletons = 500, bones = 100;
+const int count = skeletons * bones;
+
+// Each bone's parent is an earlier bone of its skeleton, the first is a
+// child of the scene root
+int bone_parent( int b, std::mt19937 &rng )
+{
+	return b == 0 ? -1 : int( rng() % ( b < 4 ? b : 4 ) ) + ( b < 4 ? 0 : b - 4 );
+}
+
+floatq turn( float angle )
+{
+	return floatq( 0.f, sinf( angle * 0.5f ), 0.f, cosf( angle * 0.5f ) );
+}
+
+int main()
+{
+	std::mt19937 rng( 11 );
+	std::vector< int > parent( count );
+	for( int s = 0; s != skeletons; ++s )
+		for( int b = 0; b != bones; ++b )
+		{
+			int p = bone_parent( b, rng );
+			parent[ s * bones + b ] = p < 0 ? -1 : s * bones + p;
+		}
+
+	// Allocated in a shuffled order, then linked up
+	std::vector< int > order( count );
+	for( int i = 0; i != count; ++i )
+		order[i] = i;
+	std::shuffle( order.begin(), order.end(), rng );
+	std::vector< std::unique_ptr< OldNode > > old( count );
+	for( int i = 0; i != count; ++i )
+		old[ order[i] ].reset( new OldNode );
+
+	TransformHierarchy hierarchy;
+	std::vector< int > handle( count );
+	for( int i = 0; i != count; ++i )
+		handle[ order[i] ] = hierarchy.create();
+
+	OldNode old_root;
+	int root = hierarchy.create();
+	for( int i = 0; i != count; ++i )
+	{
+		float3 p( float( rng() % 100 ) * 0.01f, 0.5f, 0.f );
+		old[i]->position( p );
+		hierarchy.position( handle[i], p );
+		old[i]->set_parent( parent[i] >= 0 ? old[ parent[i] ].get() : &old_root );
+		hierarchy.set_parent( handle[i], parent[i] >= 0 ? handle[ parent[i] ] : root );
+	}
+	Timer first;
+	hierarchy.update();
+	printf( "%d nodes reordered and updated in %.2f ms\n\n", count, first.ms() );
+
+	ThreadPool pool;
+	printf( "%-22s %12s %12s %12s  (%d threads)\n", "each frame", "old ms", "flat ms", "pooled ms", pool.thread_count() );
+	for( int every = 1; every <= 16; every *= 4 )
+	{
+		int frame = 0;
+		float4 sum_old, sum_new, sum_pooled;
+		auto pose = [&]( int i ) { return turn( float( frame + i % 7 ) * 0.01f ); };
+
+		double old_ms = time_ms( [&]()
+		{
+			++frame;
+			for( int i = 0; i < count; i += every )
+				old[i]->rotation( pose( i ) );
+			float4 sum( 0.f, 0.f, 0.f, 0.f );
+			for( int i = 0; i != count; ++i )
+				sum += old[i]->world_from_local().t;
+			sum_old = sum;
+		} );
+		frame = 0;
+		double new_ms = time_ms( [&]()
+		{
+			++frame;
+			for( int i = 0; i < count; i += every )
+				hierarchy.rotation( handle[i], pose( i ) );
+			hierarchy.update();
+			float4 sum( 0.f, 0.f, 0.f, 0.f );
+			for( int i = 0; i != count; ++i )
+				sum += hierarchy.world( handle[i] ).t;
+			sum_new = sum;
+		} );
+		frame = 0;
+		double pooled_ms = time_ms( [&]()
+		{
+			++frame;
+			for( int i = 0; i < count; i += every )
+				hierarchy.rotation( handle[i], pose( i ) );
+			hierarchy.update( root, pool );
+			float4 sum( 0.f, 0.f, 0.f, 0.f );
+			for( int i = 0; i != count; ++i )
+				sum += hierarchy.world( handle[i] ).t;
+			sum_pooled = sum;
+		} );
+
+		float worst = 0.f;
+		for( int i = 0; i != count; ++i )
+		{
+			float4 d = old[i]->world_from_local().t - hierarchy.world( handle[i] ).t;
+			worst = std::max( worst, std::max( std::max( fabsf( d.x ), fabsf( d.y ) ), fabsf( d.z ) ) );
+		}
+
+		char what[32];
+		snprintf( what, sizeof( what ), "1 in %d bones moved", every );
+		bool same = fabsf( sum_old.x - sum_new.x ) < 1e-2f * count && fabsf( sum_old.x - sum_pooled.x ) < 1e-2f * count;
+		printf( "%-22s %12.2f %12.2f %12.2f  %.2fx, worst difference %g %s\n", what, old_ms, new_ms, pooled_ms,
+		        old_ms / std::min( new_ms, pooled_ms ), worst, same ? "" : "MISMATCH" );
+	}
+	return 0;
+}
@@ -0,0 +1,65 @@
+// Times VoxelChunkMesher::build on a 256^3 noise terrain with an increasing
+// number of threads, against meshing the same chunks one after another.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_chunk_bench.cpp ../resource/voxelmesher.cpp ../common/threadpool.cpp
+//     ../math/perlin.cpp -L<build dir> -lgrt -lGL -ldl -pthread -o voxel_chunk_bench
+
+#include "bench.h"
+#include "common/threadpool.h"
+#include "resource/voxelmesher.h"
+#include "resource/voxelworld.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+
+typedef unsigned char Voxel;
+
+int main()
+{
+	const int size = 256;
+	VoxelWorld< Voxel > world;
+	for( int z = 0; z != size; ++z )
+		for( int x = 0; x != size; ++x )
+		{
+			int h = size / 2 + int( 48.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+			fill( world, Voxel( 2 ), x, 0, z, x + 1, h - 3, z + 1 );
+			fill( world, Voxel( 3 ), x, h - 3, z, x + 1, h, z + 1 );
+			world.set( x, h, z, Voxel( 1 ) );
+		}
+	world.compact();
+	VoxelWorld< Voxel > const &vol = world;
+
+	VoxelChunkMesher mesher;
+	std::vector< int3 > chunks;
+	mesher.chunks_in( int3( 0, 0, 0 ), int3( size, size, size ), chunks );
+	printf( "%d chunks, %d dense\n", int( chunks.size() ), int( world.dense_chunk_count() ) );
+
+	std::vector< VoxelMeshData > data( chunks.size() );
+	int c = mesher.chunk_size();
+	double serial = time_ms( [&]()
+	{
+		for( size_t i = 0; i != chunks.size(); ++i )
+		{
+			data[i].clear();
+			greedy_mesh( vol, chunks[i] * c, chunks[i] * c + int3( c, c, c ), data[i] );
+		}
+	} );
+
+	int quads = 0;
+	for( size_t i = 0; i != data.size(); ++i )
+		quads += data[i].quad_count();
+	printf( "%d quads\n\n%8s %10s %8s\n", quads, "threads", "ms", "speedup" );
+	printf( "%8s %10.2f %8.2f\n", "serial", serial, 1.0 );
+
+	// The calling thread works alongside the pool, so a pool of n - 1
+	// threads meshes n chunks at a time
+	int cores = std::max( int( std::thread::hardware_concurrency() ), 1 );
+	for( int n = 2; n <= std::max( cores, 4 ); n *= 2 )
+	{
+		ThreadPool pool( n - 1 );
+		double ms = time_ms( [&]() { mesher.build( vol, chunks, pool ); mesher.discard(); } );
+		printf( "%8d %10.2f %8.2f%s\n", n, ms, serial / ms, n > cores ? "  (more threads than cores)" : "" );
+	}
+	return 0;
+}
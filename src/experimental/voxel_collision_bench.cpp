@@ -0,0 +1,251 @@
+// Compares sweeping boxes through a VoxelOccupancy against the voxel test
+// app's uncollide(), which pushes two spheres out of the voxels around them
+// with a bounds checked at() per voxel, for a crowd of bodies walking about a
+// noise terrain. Also checks no swept body ends up overlapping a solid voxel.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_collision_bench.cpp ../resource/voxelcollision.cpp
+//     ../common/threadpool.cpp ../math/perlin.cpp -pthread -o voxel_collision_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+#include "resource/voxelcollision.h"
+#include "common/threadpool.h"
+#include "math/perlin.h"
+
+#include <math.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+typedef unsigned char Voxel;
+
+const int3 world_size( 256, 64, 256 );
+const float dt = 1.f / 60.f;
+const float radius = 0.4f, height = 1.5f;
+
+void terrain( VoxelBox< Voxel > &b )
+{
+	for( int z = 0; z != world_size.z; ++z )
+		for( int x = 0; x != world_size.x; ++x )
+		{
+			int h = 24 + int( 16.f * fbm( float3( x / 48.f, 0.5f, z / 48.f ), 4 ) );
+			for( int y = 0; y != world_size.y; ++y )
+				b.at( x, y, z ) = y <= h ? 2 : 0;
+		}
+	// Pillars to walk into
+	for( int i = 0; i != 400; ++i )
+	{
+		int x = ( i * 97 ) % 250 + 2, z = ( i * 61 ) % 250 + 2;
+		fill( b, Voxel( 3 ), x, 0, z, x + 2, 48, z + 2 );
+	}
+}
+
+// The app's collision, for comparison
+struct SphereCollider
+{
+	VoxelBox< Voxel > const &m_voxels;
+
+	static int manhattan( int3 const &v ) { return abs( v.x ) + abs( v.y ) + abs( v.z ); }
+
+	bool uncollide( int3 const &b, float3 &c, float r ) const
+	{
+		float3 bmin( (float)b.x, (float)b.y, (float)b.z );
+		float3 bmax( (float)b.x + 1.f, (float)b.y + 1.f, (float)b.z + 1.f );
+		float dmin2 = 0;
+		float3 offset( 0, 0, 0 );
+		for( int i = 0; i < 3; i++ )
+		{
+			if( c[i] < bmin[i] )
+			{
+				offset[i] = ( c[i] - bmin[i] );
+				dmin2 += offset[i] * offset[i];
+			}
+			else if( c[i] > bmax[i] )
+			{
+				offset[i] = ( c[i] - bmax[i] );
+				dmin2 += offset[i] * offset[i];
+			}
+		}
+		if( dmin2 <= r * r )
+		{
+			float d = sqrtf( dmin2 );
+			if( d > 0.f )
+				c += offset * ( ( r - d ) / d );
+			return true;
+		}
+		return false;
+	}
+
+	bool uncollide( float3 &c, float r ) const
+	{
+		int3 b( (int)floor(c.x), (int)floor(c.y), (int)floor(c.z) );
+		int3 b0( (int)floor(c.x-r), (int)floor(c.y-r), (int)floor(c.z-r) );
+		int3 b1( (int)floor(c.x+r), (int)floor(c.y+r), (int)floor(c.z+r) );
+
+		int3 face_cube[3], edge_cube[3], corner_cube;
+		int n_face = 0, n_edge = 0, n_corner = 0;
+		bool test_edge[3] = {true, true, true};
+
+		bool collided = false;
+		for( int z = b0.z; z <= b1.z; ++z )
+			for( int y = b0.y; y <= b1.y; ++y )
+				for( int x = b0.x; x <= b1.x; ++x )
+				{
+					int3 v( x, y, z );
+					switch( manhattan( v - b ) )
+					{
+					case 1: face_cube[n_face++] = v; break;
+					case 2: edge_cube[n_edge++] = v; break;
+					case 3: corner_cube = v; n_corner = 1; break;
+					};
+				}
+
+		for( int f = 0; f < n_face; ++f )
+			if( m_voxels.at( face_cube[f] ) != 0 )
+			{
+				collided = uncollide( face_cube[f], c, r ) || collided;
+				for( int e = 0; e < n_edge; ++e )
+					if( manhattan( face_cube[f] - edge_cube[e] ) == 1 )
+						test_edge[e] = false;
+				n_corner = 0;
+			}
+		for( int e = 0; e < n_edge; ++e )
+			if( test_edge[e] && m_voxels.at( edge_cube[e] ) != 0 )
+			{
+				collided = uncollide( edge_cube[e], c, r ) || collided;
+				n_corner = 0;
+			}
+		if( n_corner && m_voxels.at( corner_cube ) != 0 )
+			collided = uncollide( corner_cube, c, r ) || collided;
+		return collided;
+	}
+
+	void step( float3 &pos, float3 &vel ) const
+	{
+		float3 p = pos + dt * vel;
+		p.y += radius;
+		uncollide( p, radius );
+		p.y += height - radius;
+		uncollide( p, radius );
+		p.y -= height;
+		vel = ( p - pos ) / dt;
+		pos = p;
+	}
+};
+
+struct Walker
+{
+	float3 pos, vel;
+};
+
+// Bodies standing somewhere open, each walking its own way
+std::vector< Walker > walkers( VoxelBox< Voxel > const &b, int count )
+{
+	std::mt19937 rng( 7 );
+	std::uniform_real_distribution< float > along( 2.f, 254.f ), angle( 0.f, 6.2831853f );
+	std::vector< Walker > w;
+	while( int( w.size() ) != count )
+	{
+		float3 p( along( rng ), 0.f, along( rng ) );
+		int y = world_size.y - 4;
+		while( y > 0 && !b.at( int( p.x ), y - 1, int( p.z ) ) )
+			--y;
+		p.y = float( y ) + 0.5f;
+		if( b.at( int( p.x - radius ), y, int( p.z - radius ) ) || b.at( int( p.x + radius ), y, int( p.z + radius ) ) ||
+		    b.at( int( p.x - radius ), y, int( p.z + radius ) ) || b.at( int( p.x + radius ), y, int( p.z - radius ) ) )
+			continue;
+		float a = angle( rng );
+		Walker k = { p, float3( 3.f * cosf( a ), 0.f, 3.f * sinf( a ) ) };
+		w.push_back( k );
+	}
+	return w;
+}
+
+void accelerate( Walker &w )
+{
+	w.vel.y -= 10.f * dt;
+}
+
+int main()
+{
+	VoxelBox< Voxel > b( world_size );
+	b.at( -1, -1, -1 ) = 0;
+	terrain( b );
+	auto solid = []( Voxel v ) { return v != 0; };
+
+	VoxelOccupancy occ;
+	double build_ms = time_ms( [&]() { occ.clear(); occ.update( b, solid, int3( 0, 0, 0 ), world_size ); } );
+	printf( "occupancy of %dx%dx%d built in %.2f ms, %d chunks\n\n", world_size.x, world_size.y, world_size.z,
+	        build_ms, int( occ.chunk_count() ) );
+
+	const int ticks = 60;
+	ThreadPool pool;
+	printf( "%8s %14s %14s %14s  (%d ticks, %d threads)\n", "bodies", "uncollide ms", "sweep ms", "pooled ms", ticks, pool.thread_count() );
+	for( int count = 100; count <= 1600; count *= 4 )
+	{
+		std::vector< Walker > start = walkers( b, count );
+
+		SphereCollider spheres = { b };
+		double sphere_ms = time_ms( [&]()
+		{
+			std::vector< Walker > w = start;
+			for( int t = 0; t != ticks; ++t )
+				for( int i = 0; i != count; ++i )
+				{
+					accelerate( w[i] );
+					spheres.step( w[i].pos, w[i].vel );
+				}
+		} );
+
+		std::vector< VoxelBody > bodies( count );
+		int overlaps = 0;
+		auto run = [&]( ThreadPool *p )
+		{
+			std::vector< Walker > w = start;
+			for( int t = 0; t != ticks; ++t )
+			{
+				for( int i = 0; i != count; ++i )
+				{
+					accelerate( w[i] );
+					VoxelBody &body = bodies[i];
+					body.lo = w[i].pos - float3( radius, 0.f, radius );
+					body.hi = w[i].pos + float3( radius, height + radius, radius );
+					body.move = w[i].vel * dt;
+				}
+				sweep( occ, bodies.data(), count, p );
+				for( int i = 0; i != count; ++i )
+				{
+					VoxelBody const &body = bodies[i];
+					float3 pos = body.lo + float3( radius, 0.f, radius );
+					for( int a = 0; a != 3; ++a )
+						if( body.blocked[a] )
+							w[i].vel[a] = a == 1 ? 0.f : -w[i].vel[a];
+					w[i].pos = pos;
+				}
+			}
+		};
+		double sweep_ms = time_ms( [&]() { run( 0 ); } );
+		double pooled_ms = time_ms( [&]() { run( &pool ); } );
+
+		// Every body should be clear of the terrain after its last step
+		for( int i = 0; i != count; ++i )
+		{
+			VoxelBody const &body = bodies[i];
+			int3 v;
+			for( v.z = int( floorf( body.lo.z ) ); v.z < body.hi.z; ++v.z )
+				for( v.y = int( floorf( body.lo.y ) ); v.y < body.hi.y; ++v.y )
+					for( v.x = int( floorf( body.lo.x ) ); v.x < body.hi.x; ++v.x )
+						overlaps += b.at( v ) != 0;
+		}
+
+		printf( "%8d %14.2f %14.2f %14.2f  %.2fx, %d overlapping voxels\n", count, sphere_ms, sweep_ms, pooled_ms,
+		        sphere_ms / sweep_ms, overlaps );
+	}
+
+	// Digging a hole updates just the voxels changed
+	fill( b, Voxel( 0 ), 100, 10, 100, 104, 30, 104 );
+	double edit_ms = time_ms( [&]() { occ.update( b, solid, int3( 100, 10, 100 ), int3( 104, 30, 104 ) ); } );
+	printf( "\nupdating a 4x20x4 edit: %.3f ms\n", edit_ms );
+	return 0;
+}
@@ -0,0 +1,105 @@
+// Startup and save costs of VoxelWorldFile on terrains of two sizes: opening
+// and loading the region around a viewer against loading every chunk, and
+// saving a small edit against writing the whole world. The files are read
+// back from the page cache straight after writing, so this measures the
+// format rather than the disk.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_file_bench.cpp ../common/mappedfile.cpp ../math/perlin.cpp -o voxel_file_bench
+
+#include "bench.h"
+#include "resource/voxelfile.h"
+#include "resource/voxelworld.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+typedef unsigned char Voxel;
+
+const int height = 256;
+const char *filename = "voxel_file_bench.grtv";
+
+void terrain( VoxelWorld< Voxel > &world, int size )
+{
+	for( int z = 0; z != size; ++z )
+		for( int x = 0; x != size; ++x )
+		{
+			int h = height / 2 + int( 48.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+			fill( world, Voxel( 2 ), x, 0, z, x + 1, h - 3, z + 1 );
+			fill( world, Voxel( 3 ), x, h - 3, z, x + 1, h, z + 1 );
+			world.set( x, h, z, Voxel( 1 ) );
+		}
+	for( int i = 0; i != size * size * 4; ++i )
+	{
+		int3 v( rand() % size, rand() % ( height / 2 ), rand() % size );
+		if( static_cast< VoxelWorld< Voxel > const & >( world ).at( v ) == 2 )
+			world.set( v, Voxel( 4 ) );
+	}
+	world.compact();
+}
+
+long file_size()
+{
+	FILE *f = fopen( filename, "rb" );
+	fseek( f, 0, SEEK_END );
+	long size = ftell( f );
+	fclose( f );
+	return size;
+}
+
+void run( int size )
+{
+	VoxelWorld< Voxel > world;
+	terrain( world, size );
+	VoxelWorld< Voxel > const &vol = world;
+
+	double write_ms = time_ms( [&]() { VoxelWorldFile< Voxel >::write( filename, world ); } );
+	long bytes = file_size();
+
+	// A 128 wide view around the middle of the terrain's surface
+	int3 lo( size / 2 - 64, height / 2 - 64, size / 2 - 64 ), hi = lo + int3( 128, 128, 128 );
+	double open_ms = time_ms( [&]() { VoxelWorldFile< Voxel > f; f.open( filename ); } );
+	double view_ms = time_ms( [&]() { VoxelWorldFile< Voxel > f; f.open( filename ); f.load( lo, hi ); } );
+	double all_ms = time_ms( [&]() { VoxelWorldFile< Voxel > f; f.open( filename ); f.load( int3( 0, 0, 0 ), int3( size, height, size ) ); } );
+
+	// Everything read back through at() should match
+	VoxelWorldFile< Voxel > file;
+	file.open( filename );
+	int bad = 0;
+	for( int z = 0; z < size; z += 3 )
+		for( int y = 0; y < height; ++y )
+			for( int x = 0; x < size; ++x )
+				bad += file.at( x, y, z ) != vol.at( x, y, z );
+
+	// Dig a small hole, save it, and check it reads back
+	int3 dig( size / 2, height / 2 - 8, size / 2 );
+	Timer save_timer;
+	file.fill( dig, dig + int3( 8, 8, 8 ), Voxel( 0 ) );
+	int saved_chunks = int( file.unsaved_count() );
+	bool saved = file.save();
+	double save_ms = save_timer.ms();
+	long grown = file_size() - bytes;
+	fill( world, Voxel( 0 ), dig.x, dig.y, dig.z, dig.x + 8, dig.y + 8, dig.z + 8 );
+
+	VoxelWorldFile< Voxel > reopened;
+	reopened.open( filename );
+	for( int z = dig.z - 40; z < dig.z + 40; ++z )
+		for( int y = dig.y - 40; y < dig.y + 40; ++y )
+			for( int x = dig.x - 40; x < dig.x + 40; ++x )
+				bad += reopened.at( x, y, z ) != vol.at( x, y, z );
+
+	printf( "%d x %d x %d, %d chunks, %.1f MB file, written in %.1f ms\n",
+	        size, height, size, int( file.file_chunk_count() ), bytes / 1048576.0, write_ms );
+	printf( "  open %.3f ms, open + 128^3 view %.2f ms, open + everything %.1f ms\n", open_ms, view_ms, all_ms );
+	printf( "  saving an 8^3 edit: %d chunks in %.2f ms, file grew %ld bytes, %s\n\n",
+	        saved_chunks, save_ms, grown, saved && !bad ? "reads back the same" : "MISMATCH" );
+}
+
+int main()
+{
+	run( 256 );
+	run( 1024 );
+	remove( filename );
+	return 0;
+}
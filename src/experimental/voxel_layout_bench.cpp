@@ -0,0 +1,111 @@
+// Compares VoxelBox storage layouts on the two access patterns the voxel app
+// leans on: the six neighbour face scan of meshing, and the 3x3x3 block of
+// voxels read around a body for collision.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_layout_bench.cpp ../math/perlin.cpp -o voxel_layout_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef unsigned char Voxel;
+
+const int size = 256;
+
+template< typename L >
+void terrain( VoxelBox< Voxel, L > &b )
+{
+	for( int z = 0; z != size; ++z )
+		for( int x = 0; x != size; ++x )
+		{
+			int h = size / 2 + int( 48.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+			for( int y = 0; y != size; ++y )
+				b.fast_at( x, y, z ) = y > h ? 0 : y == h ? 1 : y > h - 4 ? 3 : 2;
+		}
+}
+
+// Exposed faces of the interior voxels, reading neighbours by coordinate
+template< typename L >
+int faces_by_coordinate( VoxelBox< Voxel, L > const &b )
+{
+	int3 adj[6] = { int3( 1, 0, 0 ), int3( -1, 0, 0 ), int3( 0, 1, 0 ), int3( 0, -1, 0 ), int3( 0, 0, 1 ), int3( 0, 0, -1 ) };
+	int faces = 0;
+	int3 v;
+	for( v.z = 1; v.z < size - 1; ++v.z )
+		for( v.y = 1; v.y < size - 1; ++v.y )
+			for( v.x = 1; v.x < size - 1; ++v.x )
+				if( b.fast_at( v ) )
+					for( int i = 0; i != 6; ++i )
+						faces += !b.fast_at( v + adj[i] );
+	return faces;
+}
+
+// The same, stepping to neighbours from the voxel's storage index
+template< typename L >
+int faces_by_neighbour( VoxelBox< Voxel, L > const &b )
+{
+	int faces = 0;
+	int3 v;
+	for( v.z = 1; v.z < size - 1; ++v.z )
+		for( v.y = 1; v.y < size - 1; ++v.y )
+			for( v.x = 1; v.x < size - 1; ++v.x )
+			{
+				int i = b.index( v );
+				if( b.at_index( i ) )
+					for( int a = 0; a != 3; ++a )
+						faces += !b.at_index( b.neighbour( i, a, 1 ) ) + !b.at_index( b.neighbour( i, a, -1 ) );
+			}
+	return faces;
+}
+
+// Solid voxels in the 3x3x3 block around each body
+template< typename L >
+int collisions( VoxelBox< Voxel, L > const &b, std::vector< int3 > const &bodies )
+{
+	int hits = 0;
+	for( size_t n = 0; n != bodies.size(); ++n )
+	{
+		int3 c = bodies[n];
+		for( int z = c.z - 1; z <= c.z + 1; ++z )
+			for( int y = c.y - 1; y <= c.y + 1; ++y )
+				for( int x = c.x - 1; x <= c.x + 1; ++x )
+					hits += b.fast_at( x, y, z ) != 0;
+	}
+	return hits;
+}
+
+template< typename L >
+void run( char const *name, std::vector< int3 > const &bodies )
+{
+	VoxelBox< Voxel, L > b( size, size, size );
+	terrain( b );
+
+	int faces = 0, neighbour_faces = 0, hits = 0;
+	double coord_ms = time_ms( [&]() { faces = faces_by_coordinate( b ); } );
+	double neighbour_ms = time_ms( [&]() { neighbour_faces = faces_by_neighbour( b ); } );
+	double collide_ms = time_ms( [&]() { hits = collisions( b, bodies ); } );
+	printf( "%-8s %12.2f %12.2f %12.2f %10d %10d %8d\n", name, coord_ms, neighbour_ms, collide_ms, faces, neighbour_faces, hits );
+}
+
+int main()
+{
+	// Bodies scattered around the surface, where collisions happen
+	std::vector< int3 > bodies( 1 << 20 );
+	for( size_t i = 0; i != bodies.size(); ++i )
+	{
+		int x = 1 + rand() % ( size - 2 ), z = 1 + rand() % ( size - 2 );
+		int h = size / 2 + int( 48.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+		bodies[i] = int3( x, std::min( std::max( h + rand() % 5 - 2, 1 ), size - 2 ), z );
+	}
+
+	printf( "%-8s %12s %12s %12s %10s %10s %8s\n", "layout", "scan xyz ms", "scan nbr ms", "collide ms", "faces", "faces", "hits" );
+	run< LinearLayout >( "linear", bodies );
+	run< MortonLayout >( "morton", bodies );
+	run< BrickLayout<> >( "brick", bodies );
+	return 0;
+}
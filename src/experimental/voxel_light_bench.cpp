@@ -0,0 +1,139 @@
+// Costs of VoxelLightField on a 128^3 terrain with caves: lighting from
+// scratch against the incremental updates for a new light, a removed light
+// and dug and filled voxels, checking each against a relight from scratch,
+// and what baking the light does to greedy mesh size.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_light_bench.cpp ../resource/voxellight.cpp ../resource/voxelmesher.cpp
+//     ../math/perlin.cpp -L<build dir> -lgrt -lGL -ldl -pthread -o voxel_light_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+#include "resource/voxellight.h"
+#include "resource/voxelmesher.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+typedef unsigned char Voxel;
+
+const int size = 128;
+
+struct Light
+{
+	int3 v;
+	int level;
+};
+
+bool opaque( Voxel v ) { return v != 0; }
+
+void relight( VoxelLightField &f, VoxelBox< Voxel > const &vol, std::vector< Light > const &lights )
+{
+	f.light_sun( vol, opaque );
+	for( size_t i = 0; i != lights.size(); ++i )
+		f.add_light( vol, opaque, lights[i].v, lights[i].level );
+}
+
+bool same( VoxelLightField const &a, VoxelLightField const &b )
+{
+	int3 v;
+	for( v.z = 0; v.z != size; ++v.z )
+		for( v.y = 0; v.y != size; ++v.y )
+			for( v.x = 0; v.x != size; ++v.x )
+				if( a.levels().fast_at( v ) != b.levels().fast_at( v ) )
+					return false;
+	return true;
+}
+
+void report( char const *name, double ms, VoxelLightField &f, VoxelBox< Voxel > const &vol, std::vector< Light > const &lights )
+{
+	VoxelLightField check( int3( size, size, size ) );
+	relight( check, vol, lights );
+	printf( "%-22s %8.3f ms  %3d chunks changed  %s\n", name, ms, int( f.changed().size() ),
+	        same( f, check ) ? "matches relight" : "DIFFERS FROM RELIGHT" );
+	f.clear_changed();
+}
+
+int main()
+{
+	VoxelBox< Voxel > vol( size, size, size );
+	vol.at( -1, -1, -1 ) = 0; // Sets the value read outside the box
+	for( int z = 0; z != size; ++z )
+		for( int x = 0; x != size; ++x )
+		{
+			int h = size / 2 + int( 24.f * fbm( float3( x / 48.f, 0.5f, z / 48.f ), 5 ) );
+			for( int y = 0; y != size; ++y )
+			{
+				bool cave = fbm( float3( x / 16.f, y / 16.f, z / 16.f ), 3 ) > 0.25f;
+				vol.at( x, y, z ) = y <= h && !cave ? ( y == h ? 1 : 2 ) : 0;
+			}
+		}
+
+	// Lights in open voxels down in the caves, one held back to add later
+	std::vector< Light > lights;
+	for( int i = 0; lights.size() != 65; ++i )
+	{
+		int3 v( ( i * 37 ) % size, 8 + ( i * 13 ) % ( size / 2 - 16 ), ( i * 71 ) % size );
+		if( !vol.at( v ) )
+		{
+			Light l = { v, 14 };
+			lights.push_back( l );
+		}
+	}
+
+	Light extra = lights.back();
+	lights.pop_back();
+
+	VoxelLightField field( int3( size, size, size ) );
+	Timer full;
+	relight( field, vol, lights );
+	printf( "%-22s %8.3f ms\n", "light from scratch", full.ms() );
+	field.clear_changed();
+
+	lights.push_back( extra );
+	Timer add;
+	field.add_light( vol, opaque, extra.v, extra.level );
+	report( "add a light", add.ms(), field, vol, lights );
+
+	lights.pop_back();
+	Timer remove;
+	field.remove_light( vol, opaque, extra.v );
+	report( "remove a light", remove.ms(), field, vol, lights );
+
+	// Dig a shaft down from the surface, then fill it back in
+	int3 top( size / 2, size - 1, size / 2 );
+	while( !vol.at( top ) )
+		top.y--;
+	std::vector< int3 > shaft;
+	for( int3 v = top; v.y > top.y - 12; v.y-- )
+		shaft.push_back( v );
+
+	Timer dig;
+	for( size_t i = 0; i != shaft.size(); ++i )
+	{
+		vol.at( shaft[i] ) = 0;
+		field.voxel_changed( vol, opaque, shaft[i] );
+	}
+	report( "dig 12 voxel shaft", dig.ms(), field, vol, lights );
+
+	Timer refill;
+	for( size_t i = 0; i != shaft.size(); ++i )
+	{
+		vol.at( shaft[i] ) = 2;
+		field.voxel_changed( vol, opaque, shaft[i] );
+	}
+	report( "fill it back in", refill.ms(), field, vol, lights );
+
+	// Light splits merged faces where it changes
+	VoxelMeshData unlit, lit;
+	Timer unlit_time;
+	greedy_mesh( vol, int3( 0, 0, 0 ), int3( size, size, size ), unlit );
+	double unlit_ms = unlit_time.ms();
+	Timer lit_time;
+	greedy_mesh( vol, int3( 0, 0, 0 ), int3( size, size, size ), lit, &field.levels() );
+	double lit_ms = lit_time.ms();
+	printf( "\ngreedy mesh unlit %7d quads %7.2f ms\n", unlit.quad_count(), unlit_ms );
+	printf( "greedy mesh lit   %7d quads %7.2f ms\n", lit.quad_count(), lit_ms );
+	return 0;
+}
@@ -0,0 +1,93 @@
+// Compares meshing every chunk in view at full detail against meshing each at
+// the level VoxelChunkMesher::lod_levels() picks from a VoxelLod pyramid, as
+// the view distance grows over a noise terrain.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_lod_bench.cpp ../resource/voxelmesher.cpp ../math/perlin.cpp
+//     -L<build dir> -lgrt -lGL -ldl -pthread -o voxel_lod_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+#include "resource/voxellod.h"
+#include "resource/voxelmesher.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+
+typedef unsigned char Voxel;
+
+const int3 world_size( 512, 64, 512 );
+
+void terrain( VoxelBox< Voxel > &b )
+{
+	for( int z = 0; z != world_size.z; ++z )
+		for( int x = 0; x != world_size.x; ++x )
+		{
+			int h = 24 + int( 20.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+			for( int y = 0; y != world_size.y; ++y )
+				b.at( x, y, z ) = y > h ? 0 : y == h ? 1 : y > h - 4 ? 3 : 2;
+		}
+}
+
+int main()
+{
+	VoxelBox< Voxel > b( world_size );
+	b.at( -1, -1, -1 ) = 0;
+	terrain( b );
+
+	const int levels = 5;
+	double build_ms = time_ms( [&]() { VoxelLod< Voxel > lod( b, levels ); }, 3 );
+	VoxelLod< Voxel > lod( b, levels );
+	printf( "%d level pyramid of %dx%dx%d built in %.1f ms\n", lod.level_count(), world_size.x, world_size.y,
+	        world_size.z, build_ms );
+
+	fill( b, Voxel( 0 ), 200, 10, 200, 208, 40, 208 );
+	double update_ms = time_ms( [&]() { lod.update( int3( 200, 10, 200 ), int3( 208, 40, 208 ) ); } );
+	printf( "updated for an 8x30x8 edit in %.3f ms\n\n", update_ms );
+
+	// The eye above the middle of the terrain, full detail within near
+	VoxelChunkMesher mesher( 32 );
+	float3 eye( 256.f, 50.f, 256.f );
+	const float near = 48.f;
+
+	printf( "%6s %7s %12s %10s %12s %10s %s\n", "view", "chunks", "full quads", "ms", "lod quads", "ms", "chunks per level" );
+	for( float view = 64.f; view <= 256.f; view *= 2.f )
+	{
+		std::vector< int3 > all, chunks;
+		mesher.chunks_in( int3( 0, 0, 0 ), world_size, all );
+		for( size_t i = 0; i != all.size(); ++i )
+		{
+			float3 lo( all[i] * 32 ), hi( ( all[i] + int3( 1, 1, 1 ) ) * 32 );
+			float3 nearest( std::min( std::max( eye.x, lo.x ), hi.x ), std::min( std::max( eye.y, lo.y ), hi.y ),
+			                std::min( std::max( eye.z, lo.z ), hi.z ) );
+			if( length( nearest - eye ) < view )
+				chunks.push_back( all[i] );
+		}
+		std::vector< int > chosen;
+		mesher.lod_levels( chunks, eye, near, lod.level_count(), chosen );
+
+		VoxelMeshData full, coarse;
+		double full_ms = time_ms( [&]()
+		{
+			full.clear();
+			for( size_t i = 0; i != chunks.size(); ++i )
+				greedy_mesh( b, chunks[i] * 32, chunks[i] * 32 + int3( 32, 32, 32 ), full );
+		}, 3 );
+		double lod_ms = time_ms( [&]()
+		{
+			coarse.clear();
+			for( size_t i = 0; i != chunks.size(); ++i )
+				greedy_mesh_lod( lod, chosen[i], chunks[i] * 32, chunks[i] * 32 + int3( 32, 32, 32 ), coarse );
+		}, 3 );
+
+		int per_level[ levels ] = {};
+		for( size_t i = 0; i != chosen.size(); ++i )
+			++per_level[ chosen[i] ];
+		printf( "%6.0f %7d %12d %10.1f %12d %10.1f ", view, int( chunks.size() ), full.quad_count(), full_ms,
+		        coarse.quad_count(), lod_ms );
+		for( int l = 0; l != levels; ++l )
+			printf( " %d", per_level[l] );
+		printf( "\n" );
+	}
+	return 0;
+}
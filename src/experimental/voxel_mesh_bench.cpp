@@ -0,0 +1,112 @@
+// Compares greedy_mesh against the one quad per face mesher used by the voxel
+// test app, on a 64^3 level carved like the app's and on a noise terrain.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_mesh_bench.cpp ../resource/voxelmesher.cpp ../math/perlin.cpp
+//     -L<build dir> -lgrt -lGL -ldl -o voxel_mesh_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+#include "resource/voxelmesher.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+
+typedef unsigned char Voxel;
+
+// The app's mesher: a quad for every solid voxel face next to an empty voxel
+void naive_mesh( VoxelBox< Voxel > const &vol, int3 const &v0, int3 const &v1, VoxelMeshData &out )
+{
+	int3 adj[6] = { int3( 1, 0, 0 ), int3( -1, 0, 0 ), int3( 0, 1, 0 ), int3( 0, -1, 0 ), int3( 0, 0, 1 ), int3( 0, 0, -1 ) };
+	int3 v;
+	for( v.z = v0.z; v.z < v1.z; ++v.z )
+		for( v.y = v0.y; v.y < v1.y; ++v.y )
+			for( v.x = v0.x; v.x < v1.x; ++v.x )
+			{
+				Voxel type = vol.at( v );
+				if( !type )
+					continue;
+				for( int i = 0; i != 6; ++i )
+				{
+					if( vol.at( v + adj[i] ) )
+						continue;
+					int d = i / 2, u = ( d + 1 ) % 3, w = ( d + 2 ) % 3;
+					float3 c( v ), du( 0.f, 0.f, 0.f ), dv( 0.f, 0.f, 0.f );
+					du[u] = 1.f;
+					dv[w] = 1.f;
+					char3 n( 127 * adj[i] ), t( 0, 0, 0 );
+					if( i & 1 )
+					{
+						t[w] = 127;
+						out.add_quad( c, dv, du, float2( 1.f, 1.f ), n, t, type );
+					}
+					else
+					{
+						c[d] += 1.f;
+						t[u] = 127;
+						out.add_quad( c, du, dv, float2( 1.f, 1.f ), n, t, type );
+					}
+				}
+			}
+}
+
+void carved_level( VoxelBox< Voxel > &b )
+{
+	fill( b, Voxel( 2 ), 0, 0, 0, 64, 64, 64 );
+	fill( b, Voxel( 0 ), 10, 10, 10, 20, 16, 30 );
+	fill( b, Voxel( 4 ), 14, 10, 25, 26, 11, 26 );
+	fill( b, Voxel( 0 ), 15, 10, 1, 16, 13, 40 );
+	fill( b, Voxel( 0 ), 3, 10, 3, 40, 12, 4 );
+}
+
+void terrain_level( VoxelBox< Voxel > &b )
+{
+	for( int z = 0; z != 64; ++z )
+		for( int x = 0; x != 64; ++x )
+		{
+			int h = 24 + int( 12.f * fbm( float3( x / 32.f, 0.5f, z / 32.f ), 4 ) );
+			for( int y = 0; y != 64; ++y )
+				b.at( x, y, z ) = y > h ? 0 : y == h ? 1 : y > h - 4 ? 3 : 2;
+		}
+}
+
+void compare( char const *name, VoxelBox< Voxel > const &b )
+{
+	int3 v0( 0, 0, 0 ), v1( 64, 64, 64 );
+	VoxelMeshData naive, greedy;
+	double naive_ms = time_ms( [&]() { naive.clear(); naive_mesh( b, v0, v1, naive ); } );
+	double greedy_ms = time_ms( [&]() { greedy.clear(); greedy_mesh( b, v0, v1, greedy ); } );
+
+	// Both should cover the same area of each face direction
+	double area[2][6] = {};
+	VoxelMeshData const *meshes[2] = { &naive, &greedy };
+	for( int m = 0; m != 2; ++m )
+		for( int q = 0; q != meshes[m]->quad_count(); ++q )
+		{
+			char3 n = meshes[m]->normals[q * 4];
+			int dir = n.x ? 0 : n.y ? 2 : 4;
+			if( n[dir / 2] < 0 )
+				++dir;
+			float2 uv = meshes[m]->uvs[q * 4 + 2];
+			area[m][dir] += uv.x * uv.y;
+		}
+	bool same = std::equal( area[0], area[0] + 6, area[1] );
+
+	printf( "%-8s %10s %10s %10s\n", name, "quads", "vertices", "ms" );
+	printf( "%-8s %10d %10d %10.2f\n", "naive", naive.quad_count(), naive.vertex_count(), naive_ms );
+	printf( "%-8s %10d %10d %10.2f\n", "greedy", greedy.quad_count(), greedy.vertex_count(), greedy_ms );
+	printf( "%-8s %10.1fx %9s %10.2fx  face area %s\n\n", "ratio", double( naive.quad_count() ) / greedy.quad_count(), "",
+	        naive_ms / greedy_ms, same ? "matches" : "DIFFERS" );
+}
+
+int main()
+{
+	VoxelBox< Voxel > b( 64, 64, 64 );
+	b.at( -1, -1, -1 ) = 0; // Sets the value read outside the box
+	carved_level( b );
+	compare( "carved", b );
+
+	terrain_level( b );
+	compare( "terrain", b );
+	return 0;
+}
@@ -0,0 +1,93 @@
+// Memory and access cost of PackedVoxelWorld against VoxelWorld and a dense
+// box, on a 256^3 terrain with a sprinkling of ore through the stone.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_pack_bench.cpp ../math/perlin.cpp -o voxel_pack_bench
+
+#include "bench.h"
+#include "resource/voxelpack.h"
+#include "resource/voxelworld.h"
+#include "math/perlin.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+typedef unsigned char Voxel;
+
+const int size = 256;
+
+size_t world_memory( VoxelWorld< Voxel > const &w )
+{
+	size_t bytes = 0;
+	w.for_each_chunk( [&bytes]( int3 const &, VoxelWorld< Voxel >::Chunk const &c )
+	{
+		bytes += sizeof( int3 ) + sizeof( c );
+		if( !c.uniform() )
+			bytes += sizeof( *c.box ) + c.box->size().x * c.box->size().y * c.box->size().z * sizeof( Voxel );
+	} );
+	return bytes;
+}
+
+int main()
+{
+	VoxelWorld< Voxel > world;
+	for( int z = 0; z != size; ++z )
+		for( int x = 0; x != size; ++x )
+		{
+			int h = size / 2 + int( 48.f * fbm( float3( x / 64.f, 0.5f, z / 64.f ), 5 ) );
+			fill( world, Voxel( 2 ), x, 0, z, x + 1, h - 3, z + 1 );
+			fill( world, Voxel( 3 ), x, h - 3, z, x + 1, h, z + 1 );
+			world.set( x, h, z, Voxel( 1 ) );
+		}
+	for( int i = 0; i != size * size * 4; ++i )
+	{
+		int3 v( rand() % size, rand() % ( size / 2 ), rand() % size );
+		if( static_cast< VoxelWorld< Voxel > const & >( world ).at( v ) == 2 )
+			world.set( v, Voxel( 4 ) );
+	}
+	world.compact();
+	VoxelWorld< Voxel > const &vol = world;
+
+	PackedVoxelWorld< Voxel > packed, bits_only( 0, false );
+	double pack_ms = time_ms( [&]() { packed.store( world ); } );
+	bits_only.store( world );
+
+	int runs = 0;
+	world.for_each_chunk( [&]( int3 const &c, VoxelWorld< Voxel >::Chunk const & ) { runs += packed.chunk( c )->uses_runs(); } );
+
+	size_t dense = size_t( size ) * size * size;
+	printf( "%-24s %12s %10s\n", "", "bytes", "reduction" );
+	printf( "%-24s %12zu %10.1f\n", "dense box", dense, 1.0 );
+	printf( "%-24s %12zu %10.1f\n", "VoxelWorld", world_memory( world ), double( dense ) / world_memory( world ) );
+	printf( "%-24s %12zu %10.1f\n", "packed, bits only", bits_only.memory(), double( dense ) / bits_only.memory() );
+	printf( "%-24s %12zu %10.1f\n", "packed, bits or runs", packed.memory(), double( dense ) / packed.memory() );
+	printf( "%d of %d chunks use runs, packing took %.2f ms\n\n", runs, int( world.chunk_count() ), pack_ms );
+
+	std::vector< int3 > chunks;
+	world.for_each_chunk( [&]( int3 const &c, VoxelWorld< Voxel >::Chunk const & ) { chunks.push_back( c ); } );
+	VoxelBox< Voxel > box( VoxelWorld< Voxel >::chunk_size, VoxelWorld< Voxel >::chunk_size, VoxelWorld< Voxel >::chunk_size );
+	double decode_ms = time_ms( [&]() { for( size_t i = 0; i != chunks.size(); ++i ) packed.decode( chunks[i], box ); } );
+	printf( "decode all chunks %.2f ms, %.0f MB/s\n", decode_ms, chunks.size() * 32768.0 / decode_ms / 1000.0 );
+
+	// Coherent reads, a row at a time as a mesher or light pass would
+	int sum_world = 0, sum_packed = 0;
+	double world_ms = time_ms( [&]()
+	{
+		sum_world = 0;
+		for( int z = 0; z != size; ++z )
+			for( int y = 0; y != size; ++y )
+				for( int x = 0; x != size; ++x )
+					sum_world += vol.at( x, y, z );
+	} );
+	double packed_ms = time_ms( [&]()
+	{
+		sum_packed = 0;
+		for( int z = 0; z != size; ++z )
+			for( int y = 0; y != size; ++y )
+				for( int x = 0; x != size; ++x )
+					sum_packed += packed.at( x, y, z );
+	} );
+	printf( "read every voxel: VoxelWorld %.2f ms, packed %.2f ms (%s)\n", world_ms, packed_ms, sum_world == sum_packed ? "same" : "DIFFERENT" );
+	return 0;
+}
@@ -0,0 +1,134 @@
+// Compares the VoxelBox region operations against writing a voxel at a time
+// through the bounds checked at(), as fill() used to, for a world sized fill
+// and for many brush strokes partly off the edge of the box. Also checks
+// both give the same voxels.
+//
+// g++ -O2 -std=c++11 -I../../include voxel_region_bench.cpp ../resource/voxelbox.cpp -o voxel_region_bench
+
+#include "bench.h"
+#include "resource/voxelbox.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+typedef unsigned char Voxel;
+
+// A voxel at a time, skipping voxels outside the box
+template< typename B, typename F >
+void each_voxel( B &dst, int3 const &at, B const &src, int3 const &lo, int3 const &hi, F f )
+{
+	int3 v;
+	for( v.z = lo.z; v.z < hi.z; ++v.z )
+		for( v.y = lo.y; v.y < hi.y; ++v.y )
+			for( v.x = lo.x; v.x < hi.x; ++v.x )
+			{
+				int3 d = v - lo + at;
+				if( d.x < 0 || d.y < 0 || d.z < 0 || d.x >= dst.size().x || d.y >= dst.size().y || d.z >= dst.size().z ||
+				    v.x < 0 || v.y < 0 || v.z < 0 || v.x >= src.size().x || v.y >= src.size().y || v.z >= src.size().z )
+					continue;
+				f( dst.at( d ), src.at( v ) );
+			}
+}
+
+template< typename B >
+bool same( B const &a, B const &b )
+{
+	int3 v;
+	for( v.z = 0; v.z != a.size().z; ++v.z )
+		for( v.y = 0; v.y != a.size().y; ++v.y )
+			for( v.x = 0; v.x != a.size().x; ++v.x )
+				if( a.at( v ) != b.at( v ) )
+					return false;
+	return true;
+}
+
+struct Stroke
+{
+	int3 at, lo, hi;
+};
+
+template< typename L >
+void run( char const *name )
+{
+	typedef VoxelBox< Voxel, L > Box;
+	const int3 size( 256, 128, 256 );
+	Box a( size, 0 ), b( size, 0 );
+	a.at( -1, -1, -1 ) = b.at( -1, -1, -1 ) = 0;
+
+	// A brush of noise, stamped all over including off the edges
+	Box brush( int3( 24, 24, 24 ), 0 );
+	std::mt19937 rng( 3 );
+	for( int z = 0; z != 24; ++z )
+		for( int y = 0; y != 24; ++y )
+			for( int x = 0; x != 24; ++x )
+				brush.fast_at( x, y, z ) = rng() % 3 ? Voxel( 1 + rng() % 4 ) : 0;
+	std::vector< Stroke > strokes( 5000 );
+	std::uniform_int_distribution< int > px( -16, size.x ), py( -16, size.y ), pz( -16, size.z );
+	for( size_t i = 0; i != strokes.size(); ++i )
+	{
+		Stroke s = { int3( px( rng ), py( rng ), pz( rng ) ), int3( 0, 0, 0 ), int3( 24, 24, 24 ) };
+		strokes[i] = s;
+	}
+
+	printf( "%s\n%-24s %12s %12s\n", name, "", "per voxel ms", "region ms" );
+
+	double voxel_ms = time_ms( [&]()
+	{
+		for( int z = 0; z < size.z; ++z )
+			for( int y = 0; y < size.y / 2; ++y )
+				for( int x = 0; x < size.x; ++x )
+					a.at( x, y, z ) = 2;
+	} );
+	double region_ms = time_ms( [&]() { fill( b, Voxel( 2 ), int3( 0, 0, 0 ), int3( size.x, size.y / 2, size.z ) ); } );
+	printf( "%-24s %12.2f %12.2f  %.1fx %s\n", "fill half the box", voxel_ms, region_ms, voxel_ms / region_ms,
+	        same( a, b ) ? "" : "MISMATCH" );
+
+	auto strokes_with = [&]( Box &box, int op, bool region )
+	{
+		for( size_t i = 0; i != strokes.size(); ++i )
+		{
+			Stroke const &s = strokes[i];
+			if( region )
+			{
+				if( op == 0 )
+					fill( box, Voxel( 3 ), s.at, s.at + s.hi );
+				else if( op == 1 )
+					blit( box, s.at, brush, s.lo, s.hi );
+				else if( op == 2 )
+					merge( box, s.at, brush, s.lo, s.hi );
+				else
+					subtract( box, s.at, brush, s.lo, s.hi );
+			}
+			else if( op == 0 )
+				each_voxel( box, s.at, box, s.at, s.at + s.hi, []( Voxel &d, Voxel const & ) { d = 3; } );
+			else
+				each_voxel( box, s.at, brush, s.lo, s.hi, [op]( Voxel &d, Voxel const &v )
+				{
+					d = op == 1 ? v : op == 2 ? ( v ? v : d ) : ( v ? 0 : d );
+				} );
+		}
+	};
+
+	char const *names[4] = { "5000 24^3 fills", "5000 24^3 blits", "5000 24^3 unions", "5000 24^3 subtracts" };
+	for( int op = 0; op != 4; ++op )
+	{
+		voxel_ms = time_ms( [&]() { strokes_with( a, op, false ); } );
+		region_ms = time_ms( [&]() { strokes_with( b, op, true ); } );
+		printf( "%-24s %12.2f %12.2f  %.1fx %s\n", names[op], voxel_ms, region_ms, voxel_ms / region_ms,
+		        same( a, b ) ? "" : "MISMATCH" );
+	}
+
+	Box part = extract( b, int3( 200, 100, 200 ), int3( 300, 140, 300 ) );
+	bool part_ok = part.size() == int3( 100, 40, 100 ) && part.at( 0, 0, 0 ) == b.at( 200, 100, 200 ) &&
+	               part.at( 99, 39, 99 ) == 0 && part.at( -1, 0, 0 ) == 0;
+	printf( "extract %s\n\n", part_ok ? "ok" : "MISMATCH" );
+}
+
+int main()
+{
+	run< LinearLayout >( "LinearLayout" );
+	run< MortonLayout >( "MortonLayout" );
+	return 0;
+}
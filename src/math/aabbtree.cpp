@@ -0,0 +1,213 @@
+#include "math/aabbtree.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Up to this many boxes are tested together rather than split further,
+	// one AVX or two SSE registers of them. Larger leaves cull no faster but
+	// make moving a box refit more.
+	const int leaf_size = 8;
+
+	float3 min( float3 const &a, float3 const &b )
+	{
+		return float3( std::min( a.x, b.x ), std::min( a.y, b.y ), std::min( a.z, b.z ) );
+	}
+
+	float3 max( float3 const &a, float3 const &b )
+	{
+		return float3( std::max( a.x, b.x ), std::max( a.y, b.y ), std::max( a.z, b.z ) );
+	}
+}
+
+AABBTree::AABBTree() : m_rebuild( false ), m_moves( 0 ), m_tested( 0 ) {}
+
+int AABBTree::insert( AABB const &box )
+{
+	int handle;
+	if( m_free.empty() )
+	{
+		handle = int( m_boxes.size() );
+		m_boxes.push_back( box );
+		m_leaf.push_back( -1 );
+	}
+	else
+	{
+		handle = m_free.back();
+		m_free.pop_back();
+		m_boxes[ handle ] = box;
+	}
+	m_leaf[ handle ] = 0;
+	m_rebuild = true;
+	return handle;
+}
+
+void AABBTree::remove( int handle )
+{
+	m_leaf[ handle ] = -1;
+	m_free.push_back( handle );
+	m_rebuild = true;
+}
+
+void AABBTree::move( int handle, AABB const &box )
+{
+	m_boxes[ handle ] = box;
+	if( m_rebuild )
+		return;
+	++m_moves;
+
+	// Refit the leaf from its boxes, then each node above from its children,
+	// stopping once a node's box doesn't change
+	int n = m_leaf[ handle ];
+	Node &leaf = m_nodes[n];
+	leaf.lo = float3( 1e30f, 1e30f, 1e30f );
+	leaf.hi = float3( -1e30f, -1e30f, -1e30f );
+	for( int i = leaf.first; i != leaf.last; ++i )
+	{
+		if( m_order[i] == handle )
+			m_sorted.set( i, box );
+		AABB const &b = m_boxes[ m_order[i] ];
+		leaf.lo = min( leaf.lo, b.mid - b.half_size );
+		leaf.hi = max( leaf.hi, b.mid + b.half_size );
+	}
+	for( n = leaf.parent; n >= 0; n = m_nodes[n].parent )
+	{
+		Node &node = m_nodes[n];
+		Node const &l = m_nodes[ n + 1 ], &r = m_nodes[ node.right ];
+		float3 lo = min( l.lo, r.lo ), hi = max( l.hi, r.hi );
+		if( lo == node.lo && hi == node.hi )
+			break;
+		node.lo = lo;
+		node.hi = hi;
+	}
+}
+
+void AABBTree::rebuild()
+{
+	m_order.clear();
+	for( size_t h = 0; h != m_boxes.size(); ++h )
+		if( m_leaf[h] >= 0 )
+			m_order.push_back( int( h ) );
+	m_centres.resize( m_boxes.size() );
+	for( size_t i = 0; i != m_order.size(); ++i )
+		m_centres[ m_order[i] ] = m_boxes[ m_order[i] ].mid;
+
+	m_nodes.clear();
+	if( !m_order.empty() )
+		build( -1, 0, int( m_order.size() ) );
+	m_sorted.clear();
+	m_sorted.reserve( m_order.size() );
+	for( size_t i = 0; i != m_order.size(); ++i )
+		m_sorted.push_back( m_boxes[ m_order[i] ] );
+	m_rebuild = false;
+	m_moves = 0;
+}
+
+int AABBTree::build( int parent, int first, int last )
+{
+	int n = int( m_nodes.size() );
+	m_nodes.push_back( Node() );
+	float3 lo( 1e30f, 1e30f, 1e30f ), hi( -1e30f, -1e30f, -1e30f );
+	float3 clo = lo, chi = hi;
+	for( int i = first; i != last; ++i )
+	{
+		AABB const &b = m_boxes[ m_order[i] ];
+		lo = min( lo, b.mid - b.half_size );
+		hi = max( hi, b.mid + b.half_size );
+		clo = min( clo, b.mid );
+		chi = max( chi, b.mid );
+	}
+
+	int right = -1;
+	if( last - first > leaf_size )
+	{
+		// Halve the boxes across the longest extent of their centres
+		float3 extent = chi - clo;
+		int axis = extent.x > extent.y ? ( extent.x > extent.z ? 0 : 2 ) : ( extent.y > extent.z ? 1 : 2 );
+		int mid = ( first + last ) / 2;
+		std::vector< float3 > const &centres = m_centres;
+		std::nth_element( m_order.begin() + first, m_order.begin() + mid, m_order.begin() + last,
+		                  [&centres, axis]( int a, int b ) { return centres[a][axis] < centres[b][axis]; } );
+		build( n, first, mid );
+		right = build( n, mid, last );
+	}
+	else
+		for( int i = first; i != last; ++i )
+			m_leaf[ m_order[i] ] = n;
+
+	Node &node = m_nodes[n];
+	node.lo = lo;
+	node.hi = hi;
+	node.parent = parent;
+	node.right = right;
+	node.first = first;
+	node.last = last;
+	return n;
+}
+
+void AABBTree::prepare()
+{
+	if( m_rebuild || m_moves > int( m_order.size() ) )
+		rebuild();
+	m_tested = 0;
+}
+
+void AABBTree::cull( Frustum const &f, std::vector< unsigned int > &visible )
+{
+	prepare();
+	visible.assign( ( m_boxes.size() + 31 ) / 32, 0 );
+	std::vector< int > const &order = m_order;
+	auto take = [&visible, &order]( int i ) { visible[ order[i] / 32 ] |= 1u << ( order[i] % 32 ); };
+	if( !m_nodes.empty() )
+		cull( 0, 0x3f, FrustumCuller( f ), take );
+}
+
+void AABBTree::cull( Frustum const &f, std::vector< int > &handles )
+{
+	prepare();
+	handles.clear();
+	std::vector< int > const &order = m_order;
+	auto take = [&handles, &order]( int i ) { handles.push_back( order[i] ); };
+	if( !m_nodes.empty() )
+		cull( 0, 0x3f, FrustumCuller( f ), take );
+}
+
+template< typename Take >
+void AABBTree::cull( int n, int planes, FrustumCuller const &c, Take &take )
+{
+	Node const &node = m_nodes[n];
+	++m_tested;
+
+	// Only the planes the parent straddled need testing, and the box is
+	// wholly inside once it is inside all of them
+	float3 mid = ( node.lo + node.hi ) * 0.5f, half = ( node.hi - node.lo ) * 0.5f;
+	for( int i = 0; i != 6; ++i )
+		if( planes >> i & 1 )
+		{
+			float4 const &p = c.frustum().plane( i );
+			float m = dot( mid, p.xyz() ) + p.w;
+			float r = dot( half, abs( p.xyz() ) );
+			if( m + r < 0.f )
+				return;
+			if( m - r >= 0.f )
+				planes &= ~( 1 << i );
+		}
+
+	if( !planes )
+	{
+		for( int i = node.first; i != node.last; ++i )
+			take( i );
+	}
+	else if( node.right >= 0 )
+	{
+		cull( n + 1, planes, c, take );
+		cull( node.right, planes, c, take );
+	}
+	else
+	{
+		unsigned int in = c.cull( m_sorted, node.first, node.last - node.first, planes );
+		for( int i = node.first; in; ++i, in >>= 1 )
+			if( in & 1 )
+				take( i );
+	}
+}
@@ -1,4 +1,8 @@
 #include "math/frustum.h"
+#include "math/simd.h"
+
+#include <math.h>
+#include <algorithm>
 
 
 Frustum::Frustum( float44 const &m )
@@ -48,3 +52,106 @@ bool Frustum::intersect_aabb( AABB const &aabb ) const
      }
 	 return true;
 }
+
+AABB transform_aabb( float44 const &m, AABB const &box )
+{
+	AABB r;
+	r.mid = ( m * float4( box.mid, 1.f ) ).xyz();
+	r.half_size = abs( m.i.xyz() ) * box.half_size.x + abs( m.j.xyz() ) * box.half_size.y +
+	              abs( m.k.xyz() ) * box.half_size.z;
+	return r;
+}
+
+void AABBArray::clear()
+{
+	mid_x.clear(); mid_y.clear(); mid_z.clear();
+	half_x.clear(); half_y.clear(); half_z.clear();
+}
+
+void AABBArray::reserve( size_t size )
+{
+	mid_x.reserve( size ); mid_y.reserve( size ); mid_z.reserve( size );
+	half_x.reserve( size ); half_y.reserve( size ); half_z.reserve( size );
+}
+
+void AABBArray::set( size_t i, AABB const &aabb )
+{
+	mid_x[i] = aabb.mid.x;
+	mid_y[i] = aabb.mid.y;
+	mid_z[i] = aabb.mid.z;
+	half_x[i] = aabb.half_size.x;
+	half_y[i] = aabb.half_size.y;
+	half_z[i] = aabb.half_size.z;
+}
+
+void AABBArray::push_back( AABB const &aabb )
+{
+	mid_x.push_back( aabb.mid.x );
+	mid_y.push_back( aabb.mid.y );
+	mid_z.push_back( aabb.mid.z );
+	half_x.push_back( aabb.half_size.x );
+	half_y.push_back( aabb.half_size.y );
+	half_z.push_back( aabb.half_size.z );
+}
+
+FrustumCuller::FrustumCuller( Frustum const &f ) : m_frustum( f )
+{
+}
+
+void FrustumCuller::cull( AABBArray const &boxes, std::vector< unsigned int > &visible ) const
+{
+	size_t count = boxes.size();
+	visible.resize( ( count + 31 ) / 32 );
+	for( size_t i = 0; i < count; i += 32 )
+		visible[i / 32] = cull( boxes, i, std::min( count - i, size_t( 32 ) ) );
+}
+
+unsigned int FrustumCuller::cull( AABBArray const &boxes, size_t first, size_t count, int planes ) const
+{
+	using namespace simd;
+	const int all_lanes = ( 1 << wide_width ) - 1;
+
+	// Same test as Frustum::intersect_aabb with a lane per box. A group stops
+	// testing planes as soon as every box in it is outside one of them. The
+	// last group is copied out and padded if it would run past the end.
+	unsigned int visible = 0;
+	for( size_t i = 0; i < count; i += wide_width )
+	{
+		size_t at = first + i;
+		float const *mid_x = &boxes.mid_x[at], *mid_y = &boxes.mid_y[at], *mid_z = &boxes.mid_z[at];
+		float const *half_x = &boxes.half_x[at], *half_y = &boxes.half_y[at], *half_z = &boxes.half_z[at];
+		int lanes = int( std::min( count - i, size_t( wide_width ) ) );
+		float tail[6][wide_width];
+		if( at + wide_width > boxes.size() )
+		{
+			for( int l = 0; l != wide_width; ++l )
+			{
+				bool in = l < lanes;
+				tail[0][l] = in ? mid_x[l] : 0.f;
+				tail[1][l] = in ? mid_y[l] : 0.f;
+				tail[2][l] = in ? mid_z[l] : 0.f;
+				tail[3][l] = in ? half_x[l] : 0.f;
+				tail[4][l] = in ? half_y[l] : 0.f;
+				tail[5][l] = in ? half_z[l] : 0.f;
+			}
+			mid_x = tail[0]; mid_y = tail[1]; mid_z = tail[2];
+			half_x = tail[3]; half_y = tail[4]; half_z = tail[5];
+		}
+
+		fwide mx = fwide::load( mid_x ), hx = fwide::load( half_x );
+		fwide my = fwide::load( mid_y ), hy = fwide::load( half_y );
+		fwide mz = fwide::load( mid_z ), hz = fwide::load( half_z );
+
+		int outside = 0;
+		for( int p = 0; p < 6 && outside != all_lanes; ++p )
+			if( planes >> p & 1 )
+			{
+				float4 const &plane = m_frustum.plane( p );
+				fwide m = madd( mx, fwide( plane.x ), madd( my, fwide( plane.y ), madd( mz, fwide( plane.z ), fwide( plane.w ) ) ) );
+				fwide n = madd( hx, fwide( fabsf( plane.x ) ), madd( hy, fwide( fabsf( plane.y ) ), hz * fwide( fabsf( plane.z ) ) ) );
+				outside |= movemask( m + n < fwide( 0.f ) );
+			}
+		visible |= ( unsigned int )( ~outside & all_lanes & ( ( 1 << lanes ) - 1 ) ) << i;
+	}
+	return visible;
+}
@@ -1,4 +1,8 @@
 #include "math/perlin.h"
+#include "math/simd.h"
+
+#include <algorithm>
+
 // Permutation table
 
 namespace
@@ -37,19 +41,112 @@ void init_tables()
 		grad4d[i] = kkf[permutation[i]];
 }
 
+// Built during static initialisation so perlin() needn't check on every call
+struct TableInit { TableInit() { init_tables(); } } table_init;
+
 inline  float  fade( float t ) { return t * t * ( 3 - 2 * t ); }
 inline  float  plerp( float t, float a, float b ) { return  a + t * ( b - a ); }
 inline  int    fastfloor( float x ) { return x > 0 ? ( int )x : ( int )x - 1; }
+
+#if defined( GRT_SIMD_AVX ) && defined( __AVX2__ )
+
+// With AVX2 the table lookups can be gathered and perlin() evaluated for eight
+// points at once. Without gathers the lookups dominate and have to be done
+// lane by lane, which measured no faster than calling perlin() per point, so
+// the batch functions below fall back to that.
+#define PERLIN_WIDE
+
+using simd::f8;
+
+inline  f8     fade( f8 t ) { return t * t * ( f8( 3.f ) - f8( 2.f ) * t ); }
+inline  f8     plerp( f8 t, f8 a, f8 b ) { return madd( t, b - a, a ); }
+
+f8 perlin_wide( f8 x, f8 y, f8 z )
+{
+	f8 fx = floor( x ), fy = floor( y ), fz = floor( z );
+	f8 u = fade( x - fx );
+	f8 v = fade( y - fy );
+	f8 w = fade( z - fz );
+
+	__m256i mask = _mm256_set1_epi32( 255 );
+	__m256i X = _mm256_and_si256( _mm256_cvttps_epi32( fx.v ), mask );
+	__m256i Y = _mm256_and_si256( _mm256_cvttps_epi32( fy.v ), mask );
+	__m256i Z = _mm256_and_si256( _mm256_cvttps_epi32( fz.v ), mask );
+	__m256i A  = _mm256_add_epi32( _mm256_i32gather_epi32( permutation, X, 4 ), Y );
+	__m256i B  = _mm256_add_epi32( _mm256_i32gather_epi32( permutation + 1, X, 4 ), Y );
+	__m256i AA = _mm256_add_epi32( _mm256_i32gather_epi32( permutation, A, 4 ), Z );
+	__m256i AB = _mm256_add_epi32( _mm256_i32gather_epi32( permutation + 1, A, 4 ), Z );
+	__m256i BA = _mm256_add_epi32( _mm256_i32gather_epi32( permutation, B, 4 ), Z );
+	__m256i BB = _mm256_add_epi32( _mm256_i32gather_epi32( permutation + 1, B, 4 ), Z );
+	return plerp( w, plerp( v, plerp( u, _mm256_i32gather_ps( grad4d, AA, 4 ), _mm256_i32gather_ps( grad4d, BA, 4 ) ),
+	                           plerp( u, _mm256_i32gather_ps( grad4d, AB, 4 ), _mm256_i32gather_ps( grad4d, BB, 4 ) ) ),
+	                 plerp( v, plerp( u, _mm256_i32gather_ps( grad4d + 1, AA, 4 ), _mm256_i32gather_ps( grad4d + 1, BA, 4 ) ),
+	                           plerp( u, _mm256_i32gather_ps( grad4d + 1, AB, 4 ), _mm256_i32gather_ps( grad4d + 1, BB, 4 ) ) ) );
 }
 
-float perlin( float3 point )
+template< bool Turbulence >
+f8 octaves_wide( f8 x, f8 y, f8 z, int octaves, float lacunarity, float gain )
+{
+	f8 sum( 0.f );
+	float amplitude = 1.f;
+	for( int i = 0; i != octaves; ++i )
+	{
+		f8 n = perlin_wide( x, y, z );
+		sum = madd( f8( amplitude ), Turbulence ? abs( n ) : n, sum );
+		x = x * f8( lacunarity );
+		y = y * f8( lacunarity );
+		z = z * f8( lacunarity );
+		amplitude *= gain;
+	}
+	return sum;
+}
+
+// Runs f over pts eight at a time, padding the last group by repeating the
+// final point.
+template< typename F >
+void batch( float3 const *pts, float *out, size_t n, F const &f )
+{
+	for( size_t i = 0; i < n; i += 8 )
+	{
+		float x[8], y[8], z[8], r[8];
+		for( int l = 0; l != 8; ++l )
+		{
+			float3 const &p = pts[ std::min( i + l, n - 1 ) ];
+			x[l] = p.x;
+			y[l] = p.y;
+			z[l] = p.z;
+		}
+		f8 result = f( f8::load( x ), f8::load( y ), f8::load( z ) );
+		if( i + 8 <= n )
+			result.store( out + i );
+		else
+		{
+			result.store( r );
+			std::copy( r, r + ( n - i ), out + i );
+		}
+	}
+}
+
+#endif
+
+template< bool Turbulence >
+float octaves( float3 v, int octaves, float lacunarity, float gain )
 {
-	static bool init = false;
-	if( !init )
+	float sum = 0.f;
+	float amplitude = 1.f;
+	for( int i = 0; i != octaves; ++i )
 	{
-		init_tables();
-		init = true;
+		float n = perlin( v );
+		sum += amplitude * ( Turbulence ? ( n < 0.f ? -n : n ) : n );
+		v = v * lacunarity;
+		amplitude *= gain;
 	}
+	return sum;
+}
+}
+
+float perlin( float3 point )
+{
 	int X = fastfloor( point.x );
 	int Y = fastfloor( point.y );
 	int Z = fastfloor( point.z );
@@ -82,3 +179,43 @@ float perlin( float3 point )
 	                     plerp( u, grad4d[AB + 1],
 	                            grad4d[BB + 1] ) ) );
 }
+
+float fbm( float3 v, int n, float lacunarity, float gain )
+{
+	return octaves< false >( v, n, lacunarity, gain );
+}
+
+float turbulence( float3 v, int n, float lacunarity, float gain )
+{
+	return octaves< true >( v, n, lacunarity, gain );
+}
+
+void perlin_batch( float3 const *pts, float *out, size_t n )
+{
+#if defined( PERLIN_WIDE )
+	batch( pts, out, n, []( f8 x, f8 y, f8 z ) { return perlin_wide( x, y, z ); } );
+#else
+	for( size_t i = 0; i != n; ++i )
+		out[i] = perlin( pts[i] );
+#endif
+}
+
+void fbm_batch( float3 const *pts, float *out, size_t n, int octaves, float lacunarity, float gain )
+{
+#if defined( PERLIN_WIDE )
+	batch( pts, out, n, [=]( f8 x, f8 y, f8 z ) { return octaves_wide< false >( x, y, z, octaves, lacunarity, gain ); } );
+#else
+	for( size_t i = 0; i != n; ++i )
+		out[i] = fbm( pts[i], octaves, lacunarity, gain );
+#endif
+}
+
+void turbulence_batch( float3 const *pts, float *out, size_t n, int octaves, float lacunarity, float gain )
+{
+#if defined( PERLIN_WIDE )
+	batch( pts, out, n, [=]( f8 x, f8 y, f8 z ) { return octaves_wide< true >( x, y, z, octaves, lacunarity, gain ); } );
+#else
+	for( size_t i = 0; i != n; ++i )
+		out[i] = turbulence( pts[i], octaves, lacunarity, gain );
+#endif
+}
@@ -0,0 +1,241 @@
+#include "math/simplex.h"
+
+// Simplex noise after Stefan Gustavson's "Simplex noise demystified", with
+// the gradient summed analytically alongside the value. Every dimension uses
+// a falloff radius of 0.5 so corner kernels reach zero before the edge of
+// the simplex; the 0.6 often quoted for 3D and 4D leaves seams in the value
+// and makes the gradient jump.
+
+namespace
+{
+// Ken Perlin's permutation table, as used by perlin()
+const unsigned char perm[256] =
+{
+	151,160,137,91,90,15,131,13,201,95,96,53,194,233,7,225,140,36,103,30,
+	69,142,8,99,37,240,21,10,23,190,6,148,247,120,234,75,0,26,197,62,94,
+	252,219,203,117,35,11,32,57,177,33,88,237,149,56,87,174,20,125,136,171,
+	168,68,175,74,165,71,134,139,48,27,166,77,146,158,231,83,111,229,122,
+	60,211,133,230,220,105,92,41,55,46,245,40,244,102,143,54,65,25,63,161,
+	1,216,80,73,209,76,132,187,208,89,18,169,200,196,135,130,116,188,159,
+	86,164,100,109,198,173,186,3,64,52,217,226,250,124,123,5,202,38,147,
+	118,126,255,82,85,212,207,206,59,227,47,16,58,17,182,189,28,42,223,183,
+	170,213,119,248,152,2,44,154,163,70,221,153,101,155,167,43,172,9,129,
+	22,39,253,19,98,108,110,79,113,224,232,178,185,112,104,218,246,97,228,
+	251,34,242,193,238,210,144,12,191,179,162,241,81,51,145,235,249,14,239,
+	107,49,192,214,31,181,199,106,157,184,84,204,176,115,121,50,45,127,4,
+	150,254,138,236,205,93,222,114,67,29,24,72,243,141,128,195,78,66,215,
+	61,156,180
+};
+
+const float grad2[8][2] =
+{
+	{1,1}, {-1,1}, {1,-1}, {-1,-1}, {1,0}, {-1,0}, {0,1}, {0,-1}
+};
+
+const float grad3[12][3] =
+{
+	{1,1,0}, {-1,1,0}, {1,-1,0}, {-1,-1,0},
+	{1,0,1}, {-1,0,1}, {1,0,-1}, {-1,0,-1},
+	{0,1,1}, {0,-1,1}, {0,1,-1}, {0,-1,-1}
+};
+
+const float grad4[32][4] =
+{
+	{0,1,1,1},  {0,1,1,-1},  {0,1,-1,1},  {0,1,-1,-1},
+	{0,-1,1,1}, {0,-1,1,-1}, {0,-1,-1,1}, {0,-1,-1,-1},
+	{1,0,1,1},  {1,0,1,-1},  {1,0,-1,1},  {1,0,-1,-1},
+	{-1,0,1,1}, {-1,0,1,-1}, {-1,0,-1,1}, {-1,0,-1,-1},
+	{1,1,0,1},  {1,1,0,-1},  {1,-1,0,1},  {1,-1,0,-1},
+	{-1,1,0,1}, {-1,1,0,-1}, {-1,-1,0,1}, {-1,-1,0,-1},
+	{1,1,1,0},  {1,1,-1,0},  {1,-1,1,0},  {1,-1,-1,0},
+	{-1,1,1,0}, {-1,1,-1,0}, {-1,-1,1,0}, {-1,-1,-1,0}
+};
+
+// The permutation repeated so a masked coordinate plus a hash can index it
+// directly, and for 3D with the gradient index already reduced mod 12
+unsigned char perm2[512];
+unsigned char perm12[512];
+
+void init_tables()
+{
+	for( int i = 0; i != 512; ++i )
+	{
+		perm2[i] = perm[i & 255];
+		perm12[i] = perm[i & 255] % 12;
+	}
+}
+
+// Built during static initialisation so the noise functions needn't check
+struct TableInit { TableInit() { init_tables(); } } table_init;
+
+inline  int    fastfloor( float x ) { int i = ( int )x; return x < i ? i - 1 : i; }
+
+// Contribution of the simplex corner at offset d with gradient g, adding the
+// derivative of ( falloff - |d|^2 )^4 * ( g . d ) to grad if it isn't null.
+template< int N >
+inline float corner( float const *d, float const *g, float falloff, float *grad )
+{
+	float t = falloff, gd = 0.f;
+	for( int k = 0; k != N; ++k )
+	{
+		t -= d[k] * d[k];
+		gd += g[k] * d[k];
+	}
+	// Clamped rather than branched on, as whether a corner contributes is
+	// close to random and mispredicting it costs more than the arithmetic
+	t = t > 0.f ? t : 0.f;
+
+	float t2 = t * t, t4 = t2 * t2;
+	if( grad )
+		for( int k = 0; k != N; ++k )
+			grad[k] += t4 * g[k] - 8.f * t2 * t * gd * d[k];
+	return t4 * gd;
+}
+
+float noise2( float const *p, float *grad )
+{
+	const float F2 = 0.36602540378f; // ( sqrt( 3 ) - 1 ) / 2
+	const float G2 = 0.21132486540f; // ( 3 - sqrt( 3 ) ) / 6
+
+	// Skew into the simplex grid to find the cell
+	float s = ( p[0] + p[1] ) * F2;
+	int i = fastfloor( p[0] + s );
+	int j = fastfloor( p[1] + s );
+	float t = ( i + j ) * G2;
+	float d0[2] = { p[0] - ( i - t ), p[1] - ( j - t ) };
+
+	// Which of the two triangles in the cell
+	int i1 = d0[0] > d0[1] ? 1 : 0;
+	int j1 = 1 - i1;
+
+	float d1[2] = { d0[0] - i1 + G2, d0[1] - j1 + G2 };
+	float d2[2] = { d0[0] - 1.f + 2.f * G2, d0[1] - 1.f + 2.f * G2 };
+
+	i &= 255, j &= 255;
+	int g0 = perm2[ i +      perm2[j] ] & 7;
+	int g1 = perm2[ i + i1 + perm2[ j + j1 ] ] & 7;
+	int g2 = perm2[ i + 1 +  perm2[ j + 1 ] ] & 7;
+
+	if( grad )
+		grad[0] = grad[1] = 0.f;
+	float n = corner< 2 >( d0, grad2[g0], 0.5f, grad ) +
+	          corner< 2 >( d1, grad2[g1], 0.5f, grad ) +
+	          corner< 2 >( d2, grad2[g2], 0.5f, grad );
+
+	const float scale = 70.f;
+	if( grad )
+		grad[0] *= scale, grad[1] *= scale;
+	return n * scale;
+}
+
+float noise3( float const *p, float *grad )
+{
+	const float F3 = 1.f / 3.f;
+	const float G3 = 1.f / 6.f;
+
+	float s = ( p[0] + p[1] + p[2] ) * F3;
+	int i = fastfloor( p[0] + s );
+	int j = fastfloor( p[1] + s );
+	int k = fastfloor( p[2] + s );
+	float t = ( i + j + k ) * G3;
+	float x0 = p[0] - ( i - t ), y0 = p[1] - ( j - t ), z0 = p[2] - ( k - t );
+
+	// Which of the six tetrahedra in the cell, without branching: the second
+	// and third corners step along the largest then the next largest offset.
+	int xy = x0 >= y0, yz = y0 >= z0, xz = x0 >= z0;
+	int i1 = xy & xz, j1 = ( !xy ) & yz, k1 = ( !yz ) & ( !xz );
+	int i2 = xy | xz, j2 = ( !xy ) | yz, k2 = !( yz & xz );
+
+	float x1 = x0 - i1 + G3,        y1 = y0 - j1 + G3,        z1 = z0 - k1 + G3;
+	float x2 = x0 - i2 + 2.f * G3,  y2 = y0 - j2 + 2.f * G3,  z2 = z0 - k2 + 2.f * G3;
+	float x3 = x0 - 1.f + 3.f * G3, y3 = y0 - 1.f + 3.f * G3, z3 = z0 - 1.f + 3.f * G3;
+
+	i &= 255, j &= 255, k &= 255;
+	float const *g0 = grad3[ perm12[ i +      perm2[ j +      perm2[k] ] ] ];
+	float const *g1 = grad3[ perm12[ i + i1 + perm2[ j + j1 + perm2[ k + k1 ] ] ] ];
+	float const *g2 = grad3[ perm12[ i + i2 + perm2[ j + j2 + perm2[ k + k2 ] ] ] ];
+	float const *g3 = grad3[ perm12[ i + 1 +  perm2[ j + 1 +  perm2[ k + 1 ] ] ] ];
+
+	float d[4][3] = { { x0, y0, z0 }, { x1, y1, z1 }, { x2, y2, z2 }, { x3, y3, z3 } };
+	if( grad )
+		grad[0] = grad[1] = grad[2] = 0.f;
+	float n = corner< 3 >( d[0], g0, 0.5f, grad ) +
+	          corner< 3 >( d[1], g1, 0.5f, grad ) +
+	          corner< 3 >( d[2], g2, 0.5f, grad ) +
+	          corner< 3 >( d[3], g3, 0.5f, grad );
+
+	const float scale = 76.f;
+	if( grad )
+		for( int c = 0; c != 3; ++c )
+			grad[c] *= scale;
+	return n * scale;
+}
+
+float noise4( float const *p, float *grad )
+{
+	const float F4 = 0.30901699437f; // ( sqrt( 5 ) - 1 ) / 4
+	const float G4 = 0.13819660113f; // ( 5 - sqrt( 5 ) ) / 20
+
+	float s = ( p[0] + p[1] + p[2] + p[3] ) * F4;
+	int c[4];
+	for( int a = 0; a != 4; ++a )
+		c[a] = fastfloor( p[a] + s );
+	float t = ( c[0] + c[1] + c[2] + c[3] ) * G4;
+	float d0[4];
+	for( int a = 0; a != 4; ++a )
+		d0[a] = p[a] - ( c[a] - t );
+
+	// Rank the offsets to find which of the 24 simplices in the cell we're in;
+	// the corners step along the axes in decreasing order of rank.
+	int rank[4] = { 0, 0, 0, 0 };
+	for( int a = 0; a != 4; ++a )
+		for( int b = a + 1; b != 4; ++b )
+			++rank[ d0[a] > d0[b] ? a : b ];
+
+	for( int a = 0; a != 4; ++a )
+		c[a] &= 255;
+
+	float d[5][4];
+	int g[5];
+	for( int v = 0; v != 5; ++v )
+	{
+		int o[4];
+		for( int a = 0; a != 4; ++a )
+		{
+			o[a] = rank[a] >= 4 - v ? 1 : 0;
+			d[v][a] = d0[a] - o[a] + v * G4;
+		}
+		g[v] = perm2[ c[0] + o[0] + perm2[ c[1] + o[1] + perm2[ c[2] + o[2] + perm2[ c[3] + o[3] ] ] ] ] & 31;
+	}
+
+	if( grad )
+		grad[0] = grad[1] = grad[2] = grad[3] = 0.f;
+	float n = 0.f;
+	for( int v = 0; v != 5; ++v )
+		n += corner< 4 >( d[v], grad4[ g[v] ], 0.5f, grad );
+
+	const float scale = 62.f;
+	if( grad )
+		for( int a = 0; a != 4; ++a )
+			grad[a] *= scale;
+	return n * scale;
+}
+}
+
+float simplex( float2 v ) { return noise2( &v.x, 0 ); }
+float simplex( float3 v ) { return noise3( &v.x, 0 ); }
+float simplex( float4 v ) { return noise4( &v.x, 0 ); }
+
+float simplex( float2 v, float2 &grad ) { return noise2( &v.x, &grad.x ); }
+float simplex( float3 v, float3 &grad ) { return noise3( &v.x, &grad.x ); }
+float simplex( float4 v, float4 &grad ) { return noise4( &v.x, &grad.x ); }
+
+void simplex_batch( float3 const *pts, float *out, float3 *grad, size_t n )
+{
+	if( grad )
+		for( size_t i = 0; i != n; ++i )
+			out[i] = noise3( &pts[i].x, &grad[i].x );
+	else
+		for( size_t i = 0; i != n; ++i )
+			out[i] = noise3( &pts[i].x, 0 );
+}
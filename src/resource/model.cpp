@@ -7,20 +7,6 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-class BoneFixer : public SceneNodeVisitor
-{
-public:
-	BoneFixer( SceneNode & n ) : root( n ) {}
-
-    virtual void visit( SceneMesh & n ) override
-	{
-		for( auto &bone : n.mesh.bones )
-			n.bones.push_back( find_node( root, bone.node_name.c_str() ) );
-	}
-
-	SceneNode &root;
-};
-
 class AILoader
 {
 public:
@@ -31,8 +17,7 @@ public:
 		load_materials();
 		m_root.set( new SceneNode );
 		load_node( *m_scene->mRootNode )->set_parent( m_root.get() );
-		BoneFixer fixer( *m_root );
-		visit_scene( *m_root, fixer );
+		fix_bones();
 		load_animations();
 	}
 	~AILoader()
@@ -47,35 +32,45 @@ public:
 	{
 	public:
 		AnimatePosition( SceneNode::Ptr const &node, KeyData< float3 >::Ptr const &data )
-			: m_node( node ), m_data( data ) {}
-        virtual void update( double time ) override { if( m_node ) m_node->position( m_data->get( time ) ); }
+			: m_node( node ), m_data( data ), m_cursor( 0 ) {}
+        virtual void update( double time ) override { if( m_node ) m_node->position( m_data->get( time, m_cursor ) ); }
 	private:
 		SceneNode::Ptr m_node;
 		KeyData< float3 >::Ptr m_data;
+		int m_cursor;
 	};
 
 	class AnimateScale : public Animation
 	{
 	public:
 		AnimateScale( SceneNode::Ptr const &node, KeyData< float3 >::Ptr const &data )
-			: m_node( node ), m_data( data ) {}
-        virtual void update( double time ) override { if( m_node ) m_node->scale( m_data->get( time ) ); }
+			: m_node( node ), m_data( data ), m_cursor( 0 ) {}
+        virtual void update( double time ) override { if( m_node ) m_node->scale( m_data->get( time, m_cursor ) ); }
 	private:
 		SceneNode::Ptr m_node;
 		KeyData< float3 >::Ptr m_data;
+		int m_cursor;
 	};
 
 	class AnimateRotation : public Animation
 	{
 	public:
 		AnimateRotation( SceneNode::Ptr const &node, KeyData< floatq >::Ptr const &data )
-			: m_node( node ), m_data( data ) {}
-        virtual void update( double time ) override { if( m_node ) m_node->rotation( m_data->get( time ) ); }
+			: m_node( node ), m_data( data ), m_cursor( 0 ) {}
+        virtual void update( double time ) override { if( m_node ) m_node->rotation( m_data->get( time, m_cursor ) ); }
 	private:
 		SceneNode::Ptr m_node;
 		KeyData< floatq >::Ptr m_data;
+		int m_cursor;
 	};
 
+	void fix_bones()
+	{
+		for( SceneMesh *m : m_root->meshes() )
+			for( auto &bone : m->mesh.bones )
+				m->bones.push_back( find_node( *m_root, bone.node_name.c_str() ) );
+	}
+
 	void load_animations()
 	{
 		m_animation.set( new AnimationGroup );
@@ -83,10 +78,18 @@ public:
 		{
 			aiAnimation *anim = m_scene->mAnimations[i];
 			double time_mult = anim->mTicksPerSecond ? 1.0 / anim->mTicksPerSecond : 1.0;
+
+			std::vector< char const * > names( anim->mNumChannels );
+			std::vector< SceneNode::Ptr > nodes( anim->mNumChannels );
+			for( int j = 0; j != anim->mNumChannels; ++j )
+				names[j] = anim->mChannels[j]->mNodeName.C_Str();
+			if( anim->mNumChannels )
+				find_nodes( *m_root, &names[0], names.size(), &nodes[0] );
+
 			for( int j = 0; j != anim->mNumChannels; ++j )
 			{
 				aiNodeAnim *node_anim = anim->mChannels[j];
-				SceneNode::Ptr node = find_node( *m_root, node_anim->mNodeName.C_Str() );
+				SceneNode::Ptr node = nodes[j];
 				if( node_anim->mNumPositionKeys )
 				{
 					KeyData< float3 >::Ptr data( new KeyData< float3 >() );
@@ -133,15 +136,14 @@ public:
 			node = mesh;
 			mesh->mesh = m_meshes[ ai_node.mMeshes[0] ];
 			mesh->material = m_materials[ m_scene->mMeshes[ ai_node.mMeshes[0] ]->mMaterialIndex ];
-			mesh->aabb.half_size = float3( 10000.f, 10000.f, 10000.f );
-			mesh->aabb.mid = float3( 0.f, 0.f, 0.f );
+			mesh->local_aabb = bounds( *m_scene->mMeshes[ ai_node.mMeshes[0] ] );
 		}
 		else
 		{
 			node.set( new SceneNode );
 		}
 
-		node->name = ai_node.mName.C_Str();
+		node->name( ai_node.mName.C_Str() );
 
 		aiMatrix4x4 m = ai_node.mTransformation;
 		aiVector3D scaling, position;
@@ -159,6 +161,27 @@ public:
 		return node;
 	}
 
+	static AABB bounds( aiMesh const &ai_mesh )
+	{
+		AABB box;
+		box.mid = float3( 0.f, 0.f, 0.f );
+		box.half_size = float3( 0.f, 0.f, 0.f );
+		if( !ai_mesh.HasPositions() || !ai_mesh.mNumVertices )
+			return box;
+
+		aiVector3D lo = ai_mesh.mVertices[0], hi = lo;
+		for( unsigned int i = 1; i < ai_mesh.mNumVertices; ++i )
+		{
+			aiVector3D const &v = ai_mesh.mVertices[i];
+			lo.x = std::min( lo.x, v.x ); hi.x = std::max( hi.x, v.x );
+			lo.y = std::min( lo.y, v.y ); hi.y = std::max( hi.y, v.y );
+			lo.z = std::min( lo.z, v.z ); hi.z = std::max( hi.z, v.z );
+		}
+		box.mid = float3( lo.x + hi.x, lo.y + hi.y, lo.z + hi.z ) * 0.5f;
+		box.half_size = float3( hi.x - lo.x, hi.y - lo.y, hi.z - lo.z ) * 0.5f;
+		return box;
+	}
+
 	void set_texture( Material &material, aiMaterial &ai_material, aiTextureType type, char const *uniform, char const *default_name )
 	{
 		if( ai_material.GetTextureCount( type ) )
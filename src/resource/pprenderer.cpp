@@ -23,7 +23,10 @@ PPRenderer::PPRenderer( Device &device, ResourcePool &pool ) :
 	m_near_shadow_target( new TextureTarget() ),
 	m_far_shadow_target( new TextureTarget() ),
 	m_quad( make_quad() ),
-	m_icosohedron( make_cube() )
+	m_icosohedron( make_cube() ),
+	m_scene( 0 ),
+	m_scene_version( 0 ),
+	m_sync( 0 )
 {
 	int w = device.width(), h = device.height();
 
@@ -83,23 +86,30 @@ void PPRenderer::render( Device &device,
                          float44 const &projected_from_camera,
                          SceneNode &root )
 {
-	m_lights.clear();
-	m_meshes.clear();
+	std::vector< SceneLight * > const &lights = root.lights();
 
-	visit_scene( root, *this );
-
-	float3 eye_pos = world_from_camera.t.xyz();
-
-	for( auto m = m_meshes.begin(); m != m_meshes.end(); ++m )
-		( *m )->distance_from_eye2 = length_sqr( ( *m )->aabb.mid - eye_pos );
-
-	std::sort( m_meshes.begin(), m_meshes.end(), dist_sort );
+	update_mesh_tree( root );
 
 	float44 camera_from_world = inverse( world_from_camera );
 	float44 projected_from_world = projected_from_camera * camera_from_world;
 
 	Frustum frustum( projected_from_world );
 
+	// Cull once for the depth, geometry and material passes, sorting just
+	// the meshes that are drawn
+
+	m_mesh_tree.cull( frustum, m_visible );
+
+	float3 eye_pos = world_from_camera.t.xyz();
+	m_drawn.clear();
+	for( auto h = m_visible.begin(); h != m_visible.end(); ++h )
+	{
+		SceneMesh *m = m_handle_meshes[ *h ];
+		m->distance_from_eye2 = length_sqr( m->aabb.mid - eye_pos );
+		m_drawn.push_back( m );
+	}
+	std::sort( m_drawn.begin(), m_drawn.end(), dist_sort );
+
 	// Depth pass
 
 	m_depth_pass_target->clear( false, true );
@@ -107,14 +117,14 @@ void PPRenderer::render( Device &device,
 	RenderState depth_pass_state;
 	depth_pass_state.colour_write( false );
 
-	draw_meshes( DEPTH, depth_pass_state, *m_depth_pass_target, frustum, projected_from_world, m_dummy_uniforms );
+	draw_meshes( DEPTH, depth_pass_state, *m_depth_pass_target, projected_from_world, m_dummy_uniforms );
 
 	// Geometery pass
 
 	RenderState gbuf_state;
 	gbuf_state.depth_write( false );
 
-	draw_meshes( GEOMETRY, gbuf_state, *m_gbuf_target, frustum, projected_from_world, m_dummy_uniforms );
+	draw_meshes( GEOMETRY, gbuf_state, *m_gbuf_target, projected_from_world, m_dummy_uniforms );
 
 
 
@@ -131,11 +141,12 @@ void PPRenderer::render( Device &device,
 	m_light_sh_program->set( "u_world_from_clip", inverse( projected_from_world ) );
 
 
-	for( int i = 0; i != m_lights.size(); ++i )
+	for( auto l = lights.begin(); l != lights.end(); ++l )
 	{
-		if( !frustum.intersect_sphere( m_lights[i]->position.xyz(), m_lights[i]->radius ) )
+		SceneLight &light = **l;
+		if( !frustum.intersect_sphere( light.position.xyz(), light.radius ) )
 			continue;
-		if( length( ( m_lights[i]->position - world_from_camera.t ).xyz() ) > m_lights[i]->radius * 1.5f )
+		if( length( ( light.position - world_from_camera.t ).xyz() ) > light.radius * 1.5f )
 		{
             rs_light.depth_compare( Compare::LEqual );
 			rs_light.draw_back( false );
@@ -147,19 +158,19 @@ void PPRenderer::render( Device &device,
 			rs_light.draw_back( true );
 			rs_light.draw_front( false );
 		}
-		update_light( *m_lights[i] );
+		update_light( light );
 		m_light_sh_program->set( m_light_uniforms );
-		m_light_sh_program->set( "u_light_position", m_lights[i]->position );
-		m_light_sh_program->set( "u_light_colour", m_lights[i]->colour );
-		m_light_sh_program->set( "u_light_radius", m_lights[i]->radius );
-		m_light_sh_program->set( "u_light_radius2", m_lights[i]->radius * m_lights[i]->radius );
-		m_light_sh_program->set( "u_light_radius2rec", 1.f / ( m_lights[i]->radius * m_lights[i]->radius ) );
-		m_light_sh_program->set( "u_shadow", m_lights[i]->shadow_map );
-		m_light_sh_program->set( "u_near", m_lights[i]->radius / 100.f );
-		m_light_sh_program->set( "u_far", m_lights[i]->radius );
-		float s = m_lights[i]->radius;
+		m_light_sh_program->set( "u_light_position", light.position );
+		m_light_sh_program->set( "u_light_colour", light.colour );
+		m_light_sh_program->set( "u_light_radius", light.radius );
+		m_light_sh_program->set( "u_light_radius2", light.radius * light.radius );
+		m_light_sh_program->set( "u_light_radius2rec", 1.f / ( light.radius * light.radius ) );
+		m_light_sh_program->set( "u_shadow", light.shadow_map );
+		m_light_sh_program->set( "u_near", light.radius / 100.f );
+		m_light_sh_program->set( "u_far", light.radius );
+		float s = light.radius;
 		float44 projected_from_model = projected_from_world *
-		                               translation( m_lights[i]->position ) *
+		                               translation( light.position ) *
 		                               scale( float4( s, s, s, 1.f ) );
 		m_light_sh_program->set( "u_t_clip_from_model",  projected_from_model );
 		m_icosohedron.draw( *m_light_sh_program, rs_light, *m_light_target );
@@ -174,7 +185,7 @@ void PPRenderer::render( Device &device,
 
 	m_hdr_target->clear( true, false );
 
-	draw_meshes( MATERIAL, rs_material, *m_hdr_target, frustum, projected_from_world, m_shade_uniforms );
+	draw_meshes( MATERIAL, rs_material, *m_hdr_target, projected_from_world, m_shade_uniforms );
 
 
 	// Render final image
@@ -190,11 +201,11 @@ void PPRenderer::render( Device &device,
 	m_quad.draw( *m_hdr_program, rs_quad, device );
 }
 
-void PPRenderer::draw_meshes( Shader shader, RenderState &s, RenderTarget &t, Frustum const &f, float44 const &projected_from_world, UniformGroup &uniforms )
+void PPRenderer::draw_meshes( Shader shader, RenderState &s, RenderTarget &t, float44 const &projected_from_world, UniformGroup &uniforms )
 {
-	for( auto m : m_meshes )
+	for( auto d = m_drawn.begin(); d != m_drawn.end(); ++d )
 	{
-		if( f.intersect_aabb( m->aabb ) )
+		SceneMesh *m = *d;
 		{
 			ShaderProgram *p;
 			switch( shader )
@@ -203,14 +214,13 @@ void PPRenderer::draw_meshes( Shader shader, RenderState &s, RenderTarget &t, Fr
 			case GEOMETRY: p = m->material->geom_program.get(); break;
 			case MATERIAL: p = m->material->program.get();      break;
 			}
-			float44 const &model = m->world_from_local();
+			float44 model = m->world_from_local();
 			float33 normal_mat( model.i.xyz(), model.j.xyz(), model.k.xyz() );
 
 			p->set( uniforms );
 			p->set( "u_t_world_from_model",  model );
-			auto &wfl = m->world_from_local( );
-			p->set( "u_t_normal", float33( wfl.i.xyz( ), wfl.j.xyz( ), wfl.k.xyz( ) ) );
-			p->set( "u_t_clip_from_model", projected_from_world * wfl );
+			p->set( "u_t_normal", normal_mat );
+			p->set( "u_t_clip_from_model", projected_from_world * model );
 			p->set( "u_t_clip_from_world",  projected_from_world );
 			m->set_bones( *p );
 			p->set( m->material->uniforms );
@@ -258,33 +268,29 @@ void PPRenderer::update_light( SceneLight &light )
 			float44 face_from_world = inverse( look_at( light.position, light.position + dir[i], up[i] ) );
 			float44 proj_from_world = proj * face_from_world;
 			m_shadow_program->set( "u_t_clip_from_world", proj_from_world );
-			Frustum frustum( proj_from_world );
+			m_mesh_tree.cull( Frustum( proj_from_world ), m_shadow_visible );
 			m_shadow_state.depth_test( true );
 
 			m_shadow_state.draw_back( false );
 			m_shadow_state.draw_front( true );
 			m_near_shadow_target->clear( false, true );
-			for( auto m : m_meshes )
+			for( auto h = m_shadow_visible.begin(); h != m_shadow_visible.end(); ++h )
 			{
-				if( frustum.intersect_aabb( m->aabb ) )
-				{
-					m->set_bones( *m_shadow_program );
-					m_shadow_program->set( "u_t_clip_from_model", proj_from_world * m->world_from_local() );
-					m->mesh.draw( *m_shadow_program, m_shadow_state, *m_near_shadow_target );
-				}
+				SceneMesh *m = m_handle_meshes[ *h ];
+				m->set_bones( *m_shadow_program );
+				m_shadow_program->set( "u_t_clip_from_model", proj_from_world * m->world_from_local() );
+				m->mesh.draw( *m_shadow_program, m_shadow_state, *m_near_shadow_target );
 			}
 
 			m_shadow_state.draw_back( true );
 			m_shadow_state.draw_front( false );
 			m_far_shadow_target->clear( false, true );
-			for( auto m : m_meshes )
+			for( auto h = m_shadow_visible.begin(); h != m_shadow_visible.end(); ++h )
 			{
-				if( frustum.intersect_aabb( m->aabb ) )
-				{
-					m->set_bones( *m_shadow_program );
-					m_shadow_program->set( "u_t_clip_from_model", proj_from_world * m->world_from_local( ) );
-					m->mesh.draw( *m_shadow_program, m_shadow_state, *m_far_shadow_target );
-				}
+				SceneMesh *m = m_handle_meshes[ *h ];
+				m->set_bones( *m_shadow_program );
+				m_shadow_program->set( "u_t_clip_from_model", proj_from_world * m->world_from_local( ) );
+				m->mesh.draw( *m_shadow_program, m_shadow_state, *m_far_shadow_target );
 			}
 
 			m_shadow_target->attach( light.shadow_map, i, TextureTarget::Depth );
@@ -304,13 +310,72 @@ void PPRenderer::update_light( SceneLight &light )
 	}
 }
 
-void PPRenderer::visit( SceneMesh &mesh )
+namespace
 {
-	m_meshes.push_back( &mesh );
-	mesh.update_bones();
+	bool same( AABB const &a, AABB const &b )
+	{
+		return a.mid == b.mid && a.half_size == b.half_size;
+	}
 }
 
-void PPRenderer::visit( SceneLight &light )
+void PPRenderer::update_mesh_tree( SceneNode &root )
 {
-	m_lights.push_back( &light );
+	// The entries are only looked up again when meshes join or leave the
+	// scene, which is also when those that left are taken out of the tree
+	unsigned int version = root.contents_version();
+	if( &root != m_scene || version != m_scene_version )
+	{
+		std::vector< SceneMesh * > const &meshes = root.meshes();
+		m_scene = &root;
+		m_scene_version = version;
+		++m_sync;
+		m_scene_meshes.resize( meshes.size() );
+		for( size_t i = 0; i != meshes.size(); ++i )
+		{
+			MeshEntry &e = m_mesh_entries[ meshes[i] ];
+			e.mesh = meshes[i];
+			e.sync = m_sync;
+			m_scene_meshes[i] = &e;
+		}
+
+		for( auto e = m_mesh_entries.begin(); e != m_mesh_entries.end(); )
+			if( e->second.sync != m_sync )
+			{
+				if( e->second.handle >= 0 )
+				{
+					m_mesh_tree.remove( e->second.handle );
+					m_handle_meshes[ e->second.handle ] = 0;
+				}
+				e = m_mesh_entries.erase( e );
+			}
+			else
+				++e;
+	}
+
+	// Bounds are only worked out again for meshes that have moved, apart from
+	// skinned ones, which follow their bones. Those new to the tree are added
+	// and those that have moved refitted.
+	for( auto p = m_scene_meshes.begin(); p != m_scene_meshes.end(); ++p )
+	{
+		MeshEntry &e = **p;
+		SceneMesh *m = e.mesh;
+		unsigned int version = m->transform_version();
+		if( !m->bones.empty() )
+			m->update_bones();
+		else if( e.handle >= 0 && e.version == version && same( e.local_aabb, m->local_aabb ) )
+			continue;
+		e.version = version;
+		e.local_aabb = m->local_aabb;
+		m->update_bounds();
+
+		if( e.handle < 0 )
+		{
+			e.handle = m_mesh_tree.insert( m->aabb );
+			if( e.handle >= int( m_handle_meshes.size() ) )
+				m_handle_meshes.resize( e.handle + 1 );
+			m_handle_meshes[ e.handle ] = m;
+		}
+		else if( !same( m_mesh_tree.box( e.handle ), m->aabb ) )
+			m_mesh_tree.move( e.handle, m->aabb );
+	}
 }
@@ -1,17 +1,22 @@
 #include "resource/scenenode.h"
 #include "resource/resourcepool.h"
 #include <algorithm>
+#include <atomic>
 
-SceneNode::SceneNode() : 
-	m_scale( 1.f, 1.f, 1.f ),
-	m_position( 0.f, 0.f, 0.f ),
-	m_dirty( false ), m_local_dirty( false ), m_local_set( false ),
-	m_parent( 0 ) {}
+SceneNode::SceneNode() :
+	m_names_cached( false ), m_contents_cached( false ),
+	m_transforms( new TransformHierarchy ),
+	m_transform( m_transforms->create() ),
+	m_parent( 0 ), m_child_index( -1 ) {}
 
 SceneNode::~SceneNode()
 {
 	for( auto i = begin(); i != end(); ++i )
+	{
 		( *i )->m_parent = 0;
+		( *i )->m_child_index = -1;
+	}
+	m_transforms->destroy( m_transform );
 }
 
 
@@ -23,113 +28,243 @@ void SceneNode::set_parent( SceneNode *parent )
 	// Make sure this is not deleted after removing from parent;
 	Ptr p( this );
 
+	// The lists and indices of this node are unchanged, only those above
+	SceneNode *old_parent = m_parent;
 	if( m_parent )
 	{
-		auto vec = &m_parent->m_children;
-		vec->erase( std::remove( vec->begin(), vec->end(), p ), vec->end() );
+		m_parent->names_changed();
+		auto &siblings = m_parent->m_children;
+		siblings.back()->m_child_index = m_child_index;
+		siblings[ m_child_index ] = siblings.back();
+		siblings.pop_back();
+		m_child_index = -1;
 	}
 
 	m_parent = parent;
 	if( m_parent )
 	{
+		m_child_index = int( m_parent->m_children.size() );
 		m_parent->m_children.push_back( p );
-		set_dirty();
 	}
+	if( m_parent && m_parent->m_transforms != m_transforms )
+	{
+		// Joining another tree, so this and the nodes below move into its
+		// hierarchy, parents first
+		TransformHierarchy::Ptr from( m_transforms );
+		std::vector< SceneNode * > stack( 1, this );
+		while( !stack.empty() )
+		{
+			SceneNode *n = stack.back();
+			stack.pop_back();
+			n->m_transforms = m_parent->m_transforms;
+			n->m_transform = n->m_transforms->adopt( *from, n->m_transform );
+			n->m_transforms->set_parent( n->m_transform, n->m_parent->m_transform );
+			for( auto c = n->m_children.begin(); c != n->m_children.end(); ++c )
+				stack.push_back( c->get() );
+		}
+	}
+	else
+		m_transforms->set_parent( m_transform, m_parent ? m_parent->m_transform : -1 );
+	if( m_parent )
+		m_parent->names_changed();
+	contents_moved( old_parent, m_parent );
 }
 
-float44 const &SceneNode::world_from_local() const
+void SceneNode::name( std::string const &n )
 {
-	if( m_dirty )
+	if( n != m_name )
 	{
-		if( m_parent )
-			m_world_from_local = m_parent->world_from_local() * parent_from_local();
-		else
-			m_world_from_local = parent_from_local();
-		m_dirty = false;
+		m_name = n;
+		names_changed();
 	}
-
-	return m_world_from_local;
 }
 
-void SceneNode::accept( SceneNodeVisitor &visitor )
+void SceneNode::names_changed()
 {
-	visitor.visit( *this );
+	for( SceneNode *n = this; n && n->m_names_cached; n = n->m_parent )
+	{
+		n->m_names.reset();
+		n->m_names_cached = false;
+	}
 }
 
-void SceneNode::parent_from_local( float44 const &m )
+namespace
+{
+// Shared by every list, so no two have the same version
+std::atomic< unsigned int > contents_versions( 0 );
+
+template< typename T >
+void add_all( std::vector< T * > &list, std::unordered_map< T *, size_t > &slots, std::vector< T * > const &added )
 {
-	set_dirty();
-	m_local_dirty = false;
-	m_local_set = true;
-	m_parent_from_local = m;
+	for( auto a = added.begin(); a != added.end(); ++a )
+	{
+		slots[ *a ] = list.size();
+		list.push_back( *a );
+	}
 }
 
-float44 const &SceneNode::parent_from_local() const
+// Moves the last entry into each gap
+template< typename T >
+void remove_all( std::vector< T * > &list, std::unordered_map< T *, size_t > &slots, std::vector< T * > const &gone )
 {
-	if( m_local_dirty )
+	for( auto g = gone.begin(); g != gone.end(); ++g )
 	{
-		float44 r;
-		to_matrix( m_rotation, r );
-		//m_parent_from_local = r * ::scale( float4( m_scale, 1.0f ) );
-		for( int i = 0; i != 3; ++i )
-			m_parent_from_local[i].xyz() *= m_scale[i];
-		m_parent_from_local = r * ::scale( float4( m_scale, 1.0f ) );
-		m_parent_from_local.t.xyz() = m_position;
-		m_local_dirty = false;
+		auto s = slots.find( *g );
+		size_t i = s->second;
+		slots.erase( s );
+		if( i + 1 != list.size() )
+		{
+			list[i] = list.back();
+			slots[ list[i] ] = i;
+		}
+		list.pop_back();
 	}
-	return m_parent_from_local;
+}
 }
 
+void SceneNode::Contents::add( Contents const &c )
+{
+	add_all( meshes, mesh_slots, c.meshes );
+	add_all( lights, light_slots, c.lights );
+	version = ++contents_versions;
+}
 
-void SceneNode::rotation( floatq const &q )
+void SceneNode::Contents::remove( Contents const &c )
 {
-	decompose();
-	if( q != m_rotation )
+	remove_all( meshes, mesh_slots, c.meshes );
+	remove_all( lights, light_slots, c.lights );
+	version = ++contents_versions;
+}
+
+void SceneNode::contents_moved( SceneNode *from, SceneNode *to )
+{
+	bool listed_from = from && from->m_contents_cached, listed_to = to && to->m_contents_cached;
+	if( !listed_from && !listed_to )
+		return;
+
+	Contents moved;
+	gather( moved, listed_to );
+	if( moved.meshes.empty() && moved.lights.empty() )
+		return;
+
+	for( SceneNode *n = from; n && n->m_contents_cached; n = n->m_parent )
+		if( n->m_contents )
+			n->m_contents->remove( moved );
+	for( SceneNode *n = to; n && n->m_contents_cached; n = n->m_parent )
+		if( n->m_contents )
+			n->m_contents->add( moved );
+}
+
+class ContentsGatherer : public SceneNodeVisitor
+{
+public:
+	ContentsGatherer( std::vector< SceneMesh * > &meshes, std::vector< SceneLight * > &lights )
+		: meshes( meshes ), lights( lights ) {}
+
+	virtual void visit( SceneMesh &m ) override { meshes.push_back( &m ); }
+	virtual void visit( SceneLight &l ) override { lights.push_back( &l ); }
+
+	std::vector< SceneMesh * > &meshes;
+	std::vector< SceneLight * > &lights;
+};
+
+SceneNode::Contents const &SceneNode::contents()
+{
+	if( !m_contents )
 	{
-		set_dirty();
-		m_local_dirty = true;
-		m_rotation = q;
+		Contents all;
+		gather( all, true );
+		m_contents.reset( new Contents );
+		m_contents->add( all );
 	}
+	return *m_contents;
 }
 
-floatq const &SceneNode::rotation() const
+void SceneNode::gather( Contents &c, bool cover )
 {
-	decompose();
-	return m_rotation;
+	// Children are pushed in reverse to visit them in order
+	ContentsGatherer gatherer( c.meshes, c.lights );
+	std::vector< SceneNode * > stack( 1, this );
+	while( !stack.empty() )
+	{
+		SceneNode *n = stack.back();
+		stack.pop_back();
+		n->accept( gatherer );
+		if( cover )
+			n->m_contents_cached = true;
+		for( auto ch = n->m_children.rbegin(); ch != n->m_children.rend(); ++ch )
+			stack.push_back( ch->get() );
+	}
+}
+
+std::vector< SceneMesh * > const &SceneNode::meshes()
+{
+	return contents().meshes;
+}
+
+std::vector< SceneLight * > const &SceneNode::lights()
+{
+	return contents().lights;
+}
+
+unsigned int SceneNode::contents_version()
+{
+	return contents().version;
+}
+
+float44 SceneNode::world_from_local() const
+{
+	return m_transforms->world( m_transform );
+}
+
+unsigned int SceneNode::transform_version() const
+{
+	return m_transforms->version( m_transform );
+}
+
+void SceneNode::accept( SceneNodeVisitor &visitor )
+{
+	visitor.visit( *this );
+}
+
+void SceneNode::parent_from_local( float44 const &m )
+{
+	m_transforms->local( m_transform, m );
+}
+
+float44 SceneNode::parent_from_local() const
+{
+	return m_transforms->local( m_transform );
+}
+
+void SceneNode::rotation( floatq const &q )
+{
+	m_transforms->rotation( m_transform, q );
+}
+
+floatq SceneNode::rotation() const
+{
+	return m_transforms->rotation( m_transform );
 }
 
 void SceneNode::scale( float3 const &s )
 {
-	decompose();
-	if( s != m_scale )
-	{
-		set_dirty();
-		m_local_dirty = true;
-		m_scale = s;
-	}
+	m_transforms->scale( m_transform, s );
 }
 
-float3 const &SceneNode::scale() const
+float3 SceneNode::scale() const
 {
-	decompose();
-	return m_scale;
+	return m_transforms->scale( m_transform );
 }
 
 void SceneNode::position( float3 const &p )
 {
-	decompose();
-	if( p != m_position )
-	{
-		set_dirty();
-		m_local_dirty = true;
-		m_position = p;
-	}
+	m_transforms->position( m_transform, p );
 }
 
-float3 const &SceneNode::position() const
+float3 SceneNode::position() const
 {
-	decompose();
-	return m_position;
+	return m_transforms->position( m_transform );
 }
 
 SceneNode::Iterator SceneNode::begin()
@@ -142,42 +277,45 @@ SceneNode::Iterator SceneNode::end()
 	return m_children.end();
 }
 
-void SceneNode::set_dirty()
+void SceneMesh::update_bones()
 {
-	// Avoid repeatedly setting dirty on all descendants
-	if( m_dirty )
-		return;
-
-	m_dirty = true;
-
-	for( auto i = begin(); i != end(); ++i )
-		( *i )->set_dirty();
+	if( bones.size() )
+	{
+		size_t count = bones.size();
+		bone_transforms.data.resize( count );
+		for( size_t i = 0; i != count; ++i )
+			bone_transforms.data[i] = bones[i]->world_from_local( ) * mesh.bones[i].bone_from_model;
+	}
 }
 
-void SceneNode::decompose() const
+void SceneMesh::update_bounds()
 {
-	if( m_local_set )
+	if( bones.empty() )
 	{
-		m_position = m_parent_from_local.t.xyz();
-		m_scale = float3( length( m_parent_from_local.i ),
-		                  length( m_parent_from_local.j ),
-						  length( m_parent_from_local.k ) );
-		float33 rot( m_parent_from_local.i.xyz() / m_scale.x,
-			         m_parent_from_local.j.xyz() / m_scale.y,
-					 m_parent_from_local.k.xyz() / m_scale.z );
-		from_matrix( m_rotation, rot );
-		m_local_set = false;
+		aabb = transform_aabb( world_from_local(), local_aabb );
+		return;
 	}
-}
 
-void SceneMesh::update_bones()
-{
-	if( bones.size() )
+	// Each skinned vertex is a weighted mean of the vertex under each of its
+	// bones, so lies within the box around every bone's copy of local_aabb
+	float3 lo, hi;
+	for( size_t i = 0; i != bone_transforms.data.size(); ++i )
 	{
-		bone_transforms.data.resize( bones.size() );
-		for( int i = 0; i != bones.size(); ++i )
-			bone_transforms.data[i] = bones[i]->world_from_local( ) * mesh.bones[i].bone_from_model;
+		AABB b = transform_aabb( bone_transforms.data[i], local_aabb );
+		float3 blo = b.mid - b.half_size, bhi = b.mid + b.half_size;
+		if( i == 0 )
+		{
+			lo = blo;
+			hi = bhi;
+		}
+		for( int a = 0; a != 3; ++a )
+		{
+			lo[a] = std::min( lo[a], blo[a] );
+			hi[a] = std::max( hi[a], bhi[a] );
+		}
 	}
+	aabb.mid = ( lo + hi ) * 0.5f;
+	aabb.half_size = ( hi - lo ) * 0.5f;
 }
 
 void SceneMesh::set_bones( ShaderProgram &sp )
@@ -212,22 +350,38 @@ void visit_scene( SceneNode &node, SceneNodeVisitor &visitor )
 		visit_scene( **i, visitor );
 }
 
-
-class NodeFinder : public SceneNodeVisitor
+SceneNode::Ptr find_node( SceneNode &root, char const *name )
 {
-public:
-	NodeFinder( char const *name ) : name( name ) {}
+	if( !root.m_names )
+	{
+		// Children are pushed in reverse to walk them in order, each node
+		// replacing any earlier of its name, so the last is the one kept as
+		// visit_scene() would find it
+		root.m_names.reset( new SceneNode::NameIndex );
+		std::vector< SceneNode * > stack( 1, &root );
+		while( !stack.empty() )
+		{
+			SceneNode *n = stack.back();
+			stack.pop_back();
+			( *root.m_names )[ n->m_name ] = n;
+			n->m_names_cached = true;
+			for( auto c = n->m_children.rbegin(); c != n->m_children.rend(); ++c )
+				stack.push_back( c->get() );
+		}
+	}
 
-    virtual void visit( SceneNode & n ) override { if( n.name == name ) node = SceneNode::Ptr( &n ); }
+	auto found = root.m_names->find( name );
+	return SceneNode::Ptr( found == root.m_names->end() ? 0 : found->second );
+}
 
-	SceneNode::Ptr node;
-	std::string name;
-};
+void find_nodes( SceneNode &root, char const *const *names, size_t count, SceneNode::Ptr *out )
+{
+	for( size_t i = 0; i != count; ++i )
+		out[i] = find_node( root, names[i] );
+}
 
-SceneNode::Ptr find_node( SceneNode &root, char const *name )
+void update_transforms( SceneNode &root, ThreadPool &pool )
 {
-	NodeFinder finder( name );
-	visit_scene( root, finder );
-	return finder.node;
+	root.m_transforms->update( root.m_transform, pool );
 }
 
@@ -0,0 +1,440 @@
+#include "resource/transformhierarchy.h"
+#include "common/threadpool.h"
+#include "math/mat33.h"
+
+#include <algorithm>
+#include <atomic>
+
+TransformHierarchy::TransformHierarchy() : m_dead( 0 ), m_moved_count( 0 ), m_changes( 0 ), m_reorder( false ) {}
+
+int TransformHierarchy::create()
+{
+	int node;
+	if( m_free_handles.empty() )
+	{
+		node = int( m_index.size() );
+		m_index.push_back( 0 );
+	}
+	else
+	{
+		node = m_free_handles.back();
+		m_free_handles.pop_back();
+	}
+
+	// A new root can go on the end without reordering
+	m_index[node] = int( m_parent.size() );
+	m_parent.push_back( -1 );
+	m_local.push_back( float44() );
+	m_world.push_back( float44() );
+	m_rotation.push_back( floatq() );
+	m_scale.push_back( float3( 1.f, 1.f, 1.f ) );
+	m_position.push_back( float3( 0.f, 0.f, 0.f ) );
+	m_flags.push_back( 0 );
+	m_handle.push_back( node );
+	m_end.push_back( int( m_parent.size() ) );
+	m_version.push_back( ++m_changes );
+	return node;
+}
+
+void TransformHierarchy::destroy( int node )
+{
+	// The children are made roots by the reorder
+	int i = m_index[node];
+	if( m_flags[i] & Moved )
+		--m_moved_count;
+	m_handle[i] = -1;
+	m_index[node] = -1;
+	m_free_handles.push_back( node );
+	++m_dead;
+	++m_changes; // The children lose their parent
+	m_reorder = true;
+}
+
+int TransformHierarchy::adopt( TransformHierarchy &from, int node )
+{
+	// Versions carried over from the other hierarchy must not be mistaken
+	// for ones of this
+	int i = from.m_index[node];
+	m_changes = std::max( m_changes, from.m_changes );
+	int n = create();
+	int j = m_index[n];
+	m_local[j] = from.m_local[i];
+	m_rotation[j] = from.m_rotation[i];
+	m_scale[j] = from.m_scale[i];
+	m_position[j] = from.m_position[i];
+	changed( j, from.m_flags[i] & ( ComposeLocal | DecomposeLocal ) );
+	from.destroy( node );
+	return n;
+}
+
+void TransformHierarchy::set_parent( int node, int parent )
+{
+	int i = m_index[node];
+	int p = parent < 0 ? -1 : m_index[parent];
+	if( m_parent[i] == p )
+		return;
+
+	m_parent[i] = p;
+	changed( i, 0 );
+	m_reorder = true;
+}
+
+int TransformHierarchy::parent( int node ) const
+{
+	int p = m_parent[ m_index[node] ];
+	return p < 0 ? -1 : m_handle[p];
+}
+
+void TransformHierarchy::local( int node, float44 const &m )
+{
+	int i = m_index[node];
+	m_local[i] = m;
+	m_flags[i] &= ~ComposeLocal;
+	changed( i, DecomposeLocal );
+}
+
+float44 TransformHierarchy::local( int node ) const
+{
+	return composed( m_index[node] );
+}
+
+void TransformHierarchy::rotation( int node, floatq const &q )
+{
+	int i = m_index[node];
+	decompose( i );
+	if( q != m_rotation[i] )
+	{
+		m_rotation[i] = q;
+		changed( i, ComposeLocal );
+	}
+}
+
+floatq TransformHierarchy::rotation( int node ) const
+{
+	int i = m_index[node];
+	if( !( m_flags[i] & DecomposeLocal ) )
+		return m_rotation[i];
+	floatq r;
+	float3 s, p;
+	decomposed( i, r, s, p );
+	return r;
+}
+
+void TransformHierarchy::scale( int node, float3 const &s )
+{
+	int i = m_index[node];
+	decompose( i );
+	if( s != m_scale[i] )
+	{
+		m_scale[i] = s;
+		changed( i, ComposeLocal );
+	}
+}
+
+float3 TransformHierarchy::scale( int node ) const
+{
+	int i = m_index[node];
+	if( !( m_flags[i] & DecomposeLocal ) )
+		return m_scale[i];
+	floatq r;
+	float3 s, p;
+	decomposed( i, r, s, p );
+	return s;
+}
+
+void TransformHierarchy::position( int node, float3 const &p )
+{
+	int i = m_index[node];
+	decompose( i );
+	if( p != m_position[i] )
+	{
+		m_position[i] = p;
+		changed( i, ComposeLocal );
+	}
+}
+
+float3 TransformHierarchy::position( int node ) const
+{
+	int i = m_index[node];
+	if( !( m_flags[i] & DecomposeLocal ) )
+		return m_position[i];
+	floatq r;
+	float3 s, p;
+	decomposed( i, r, s, p );
+	return p;
+}
+
+float44 TransformHierarchy::world( int node ) const
+{
+	int i = m_index[node];
+	if( !m_moved_count && !m_reorder )
+		return m_world[i];
+
+	// Only the path to the root is looked at, so a read between changes
+	// costs the depth of the node rather than an update of every node
+	int top = moved_above( i );
+	return top < 0 ? m_world[i] : world_below( i, top );
+}
+
+unsigned int TransformHierarchy::version( int node ) const
+{
+	// A node yet to be updated after moving takes the count of changes, which
+	// the update then gives it, so it reads the same until it moves again
+	int i = m_index[node];
+	if( !m_moved_count && !m_reorder )
+		return m_version[i];
+	return moved_above( i ) < 0 ? m_version[i] : m_changes;
+}
+
+int TransformHierarchy::moved_above( int i ) const
+{
+	int top = -1;
+	for( int n = i; n >= 0; n = live_parent( n ) )
+		if( ( m_flags[n] & Moved ) || live_parent( n ) != m_parent[n] )
+			top = n;
+	return top;
+}
+
+int TransformHierarchy::live_parent( int i ) const
+{
+	int p = m_parent[i];
+	return p >= 0 && m_handle[p] >= 0 ? p : -1;
+}
+
+float44 TransformHierarchy::world_below( int i, int top ) const
+{
+	// Multiplied in the same order as update_node(), so the result matches
+	// what the next update works out
+	if( i != top )
+		return world_below( live_parent( i ), top ) * composed( i );
+	int p = live_parent( i );
+	return p >= 0 ? m_world[p] * composed( i ) : composed( i );
+}
+
+void TransformHierarchy::update()
+{
+	if( m_reorder )
+		reorder();
+	if( m_moved_count )
+	{
+		m_moved.resize( m_parent.size() );
+		m_moved_count -= update_range( 0, int( m_parent.size() ) );
+	}
+}
+
+void TransformHierarchy::update( int node, ThreadPool &pool )
+{
+	if( m_reorder )
+		reorder();
+	if( !m_moved_count )
+		return;
+
+	// The node's ancestors first, from the top down. They stay flagged, as
+	// their other descendants aren't updated here.
+	m_moved.resize( m_parent.size() );
+	int root = m_index[node];
+	std::vector< int > runs, stack;
+	for( int p = m_parent[root]; p >= 0; p = m_parent[p] )
+		stack.push_back( p );
+	while( !stack.empty() )
+	{
+		update_node( stack.back() );
+		stack.pop_back();
+	}
+	int moved = 0;
+
+	// Then the subtree, split into runs small enough to share out well,
+	// updating the nodes above the runs first so their parents are ready
+	int grain = std::max( ( m_end[root] - root ) / ( 4 * ( pool.thread_count() + 1 ) ), 256 );
+	stack.push_back( root );
+	while( !stack.empty() )
+	{
+		int i = stack.back();
+		stack.pop_back();
+		if( m_end[i] - i <= grain )
+		{
+			runs.push_back( i );
+			continue;
+		}
+		moved += update_range( i, i + 1 );
+		for( int c = i + 1; c != m_end[i]; c = m_end[c] )
+			stack.push_back( c );
+	}
+
+	std::atomic< int > moved_in_runs( 0 );
+	pool.parallel_for( int( runs.size() ), [&]( int r )
+	{
+		moved_in_runs += update_range( runs[r], m_end[ runs[r] ] );
+	} );
+	m_moved_count -= moved + moved_in_runs;
+}
+
+int TransformHierarchy::update_range( int begin, int end )
+{
+	// Parents come first, so whether a node's world transform changes is
+	// known by the time its children are reached
+	int count = 0;
+	for( int i = begin; i != end; ++i )
+		if( update_node( i ) && ( m_flags[i] & Moved ) )
+		{
+			m_flags[i] &= ~Moved;
+			++count;
+		}
+	return count;
+}
+
+bool TransformHierarchy::update_node( int i )
+{
+	int p = m_parent[i];
+	bool moved = ( m_flags[i] & Moved ) || ( p >= 0 && m_moved[p] );
+	m_moved[i] = moved;
+	if( moved )
+	{
+		// Either form of the local transform can then be read without writing
+		compose( i );
+		decompose( i );
+		if( p >= 0 )
+			m_world[i] = m_world[p] * m_local[i];
+		else
+			m_world[i] = m_local[i];
+		m_version[i] = m_changes;
+	}
+	return moved;
+}
+
+float44 TransformHierarchy::composed( int i ) const
+{
+	if( !( m_flags[i] & ComposeLocal ) )
+		return m_local[i];
+	float44 r;
+	to_matrix( m_rotation[i], r );
+	float44 m = r * ::scale( float4( m_scale[i], 1.f ) );
+	m.t.xyz() = m_position[i];
+	return m;
+}
+
+void TransformHierarchy::decomposed( int i, floatq &r, float3 &s, float3 &p ) const
+{
+	float44 const &m = m_local[i];
+	p = m.t.xyz();
+	s = float3( length( m.i ), length( m.j ), length( m.k ) );
+	float33 rot( m.i.xyz() / s.x, m.j.xyz() / s.y, m.k.xyz() / s.z );
+	from_matrix( r, rot );
+}
+
+void TransformHierarchy::compose( int i )
+{
+	if( m_flags[i] & ComposeLocal )
+	{
+		m_local[i] = composed( i );
+		m_flags[i] &= ~ComposeLocal;
+	}
+}
+
+void TransformHierarchy::decompose( int i )
+{
+	if( m_flags[i] & DecomposeLocal )
+	{
+		decomposed( i, m_rotation[i], m_scale[i], m_position[i] );
+		m_flags[i] &= ~DecomposeLocal;
+	}
+}
+
+void TransformHierarchy::changed( int i, int flags )
+{
+	++m_changes;
+	if( !( m_flags[i] & Moved ) )
+		++m_moved_count;
+	m_flags[i] |= flags | Moved;
+}
+
+void TransformHierarchy::reorder()
+{
+	int count = int( m_parent.size() );
+
+	// Children of each node, in their current order. Nodes whose parent has
+	// been removed become roots.
+	std::vector< int > first( count + 1, 0 ), children( count ), roots;
+	for( int i = 0; i != count; ++i )
+	{
+		if( m_handle[i] < 0 )
+			continue;
+		int p = m_parent[i];
+		if( p >= 0 && m_handle[p] < 0 )
+		{
+			m_parent[i] = p = -1;
+			changed( i, 0 );
+		}
+		if( p >= 0 )
+			++first[ p + 1 ];
+		else
+			roots.push_back( i );
+	}
+	for( int i = 0; i != count; ++i )
+		first[ i + 1 ] += first[i];
+	std::vector< int > next( first.begin(), first.end() - 1 );
+	for( int i = 0; i != count; ++i )
+		if( m_handle[i] >= 0 && m_parent[i] >= 0 )
+			children[ next[ m_parent[i] ]++ ] = i;
+
+	// Depth first, so each subtree ends up in one run after its root
+	std::vector< int > order, stack;
+	order.reserve( count - m_dead );
+	for( size_t r = roots.size(); r-- != 0; )
+		stack.push_back( roots[r] );
+	while( !stack.empty() )
+	{
+		int i = stack.back();
+		stack.pop_back();
+		order.push_back( i );
+		for( int c = first[ i + 1 ]; c-- != first[i]; )
+			stack.push_back( children[c] );
+	}
+
+	// New places, by old
+	std::vector< int > place( count, -1 );
+	for( size_t n = 0; n != order.size(); ++n )
+		place[ order[n] ] = int( n );
+
+	size_t live = order.size();
+	std::vector< int > parent( live ), handle( live );
+	std::vector< float44 > local( live ), world( live );
+	std::vector< floatq > rotation( live );
+	std::vector< float3 > scale( live ), position( live );
+	std::vector< unsigned char > flags( live );
+	std::vector< unsigned int > version( live );
+	for( size_t n = 0; n != live; ++n )
+	{
+		int i = order[n];
+		parent[n] = m_parent[i] < 0 ? -1 : place[ m_parent[i] ];
+		handle[n] = m_handle[i];
+		local[n] = m_local[i];
+		world[n] = m_world[i];
+		rotation[n] = m_rotation[i];
+		scale[n] = m_scale[i];
+		position[n] = m_position[i];
+		flags[n] = m_flags[i];
+		version[n] = m_version[i];
+		m_index[ handle[n] ] = int( n );
+	}
+
+	m_parent.swap( parent );
+	m_handle.swap( handle );
+	m_local.swap( local );
+	m_world.swap( world );
+	m_rotation.swap( rotation );
+	m_scale.swap( scale );
+	m_position.swap( position );
+	m_flags.swap( flags );
+	m_version.swap( version );
+
+	// Every subtree runs from its root to just past its last descendant
+	m_end.resize( live );
+	for( size_t n = live; n-- != 0; )
+		m_end[n] = int( n ) + 1;
+	for( size_t n = live; n-- != 0; )
+		if( m_parent[n] >= 0 )
+			m_end[ m_parent[n] ] = std::max( m_end[ m_parent[n] ], m_end[n] );
+	m_dead = 0;
+	m_reorder = false;
+}
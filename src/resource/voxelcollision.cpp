@@ -0,0 +1,264 @@
+#include "resource/voxelcollision.h"
+#include "common/threadpool.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+
+// Gap left between a body and the voxels it stops against, so rounding
+// doesn't leave it touching them on the next step
+const float skin = 1e-3f;
+
+// Lowest and highest set bit of a non-zero word
+int low_bit( uint32_t w )
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward( &i, w );
+	return int( i );
+#else
+	return __builtin_ctz( w );
+#endif
+}
+
+int high_bit( uint32_t w )
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanReverse( &i, w );
+	return int( i );
+#else
+	return 31 - __builtin_clz( w );
+#endif
+}
+
+// floorf and ceilf are library calls without SSE4.1, and a sweep makes
+// plenty of them
+inline int fastfloor( float x ) { int i = ( int )x; return x < i ? i - 1 : i; }
+inline int fastceil( float x ) { int i = ( int )x; return x > i ? i + 1 : i; }
+
+int3 floor_cell( float3 const &p )
+{
+	return int3( fastfloor( p.x ), fastfloor( p.y ), fastfloor( p.z ) );
+}
+
+int3 ceil_cell( float3 const &p )
+{
+	return int3( fastceil( p.x ), fastceil( p.y ), fastceil( p.z ) );
+}
+
+// Bits [a, b) of a row
+uint32_t span( int a, int b )
+{
+	return uint32_t( ( uint64_t( 1 ) << b ) - ( uint64_t( 1 ) << a ) );
+}
+
+}
+
+VoxelOccupancy::Chunk const *VoxelOccupancy::chunk( int3 const &c ) const
+{
+	std::unordered_map< int3, Chunk, ChunkHash >::const_iterator i = m_chunks.find( c );
+	return i != m_chunks.end() ? &i->second : 0;
+}
+
+void VoxelOccupancy::prune( int3 const &c )
+{
+	std::unordered_map< int3, Chunk, ChunkHash >::iterator i = m_chunks.find( c );
+	uint32_t any = 0;
+	for( int r = 0; r != chunk_size * chunk_size; ++r )
+		any |= i->second.rows[r];
+	if( !any )
+		m_chunks.erase( i );
+}
+
+bool VoxelOccupancy::solid( int3 const &v ) const
+{
+	Chunk const *ch = chunk( chunk_of( v ) );
+	return ch && ( ch->rows[ ( v.y & chunk_mask ) + ( v.z & chunk_mask ) * chunk_size ] >> ( v.x & chunk_mask ) & 1 );
+}
+
+bool VoxelOccupancy::any_solid( int3 const &lo, int3 const &hi ) const
+{
+	if( lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z )
+		return false;
+
+	int3 c0 = chunk_of( lo ), c1 = chunk_of( hi - int3( 1, 1, 1 ) ), c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+			{
+				Chunk const *ch = chunk( c );
+				if( !ch )
+					continue;
+				int3 base = c * chunk_size;
+				int3 v0 = lo - base, v1 = hi - base;
+				v0 = int3( std::max( v0.x, 0 ), std::max( v0.y, 0 ), std::max( v0.z, 0 ) );
+				v1 = int3( std::min( v1.x, int( chunk_size ) ), std::min( v1.y, int( chunk_size ) ), std::min( v1.z, int( chunk_size ) ) );
+				uint32_t mask = span( v0.x, v1.x );
+				for( int z = v0.z; z != v1.z; ++z )
+					for( int y = v0.y; y != v1.y; ++y )
+						if( ch->rows[ y + z * chunk_size ] & mask )
+							return true;
+			}
+	return false;
+}
+
+bool VoxelOccupancy::first_in_chunk( Chunk const &ch, int3 const &lo, int3 const &hi, int axis, int dir, int &layer )
+{
+	uint32_t mask = span( lo.x, hi.x );
+	if( axis == 0 )
+	{
+		// A row holds every layer along x, so the rows are or'd together
+		// and the nearest bit found in one go
+		uint32_t found = 0;
+		for( int z = lo.z; z != hi.z; ++z )
+			for( int y = lo.y; y != hi.y; ++y )
+				found |= ch.rows[ y + z * chunk_size ];
+		found &= mask;
+		if( !found )
+			return false;
+		layer = dir > 0 ? low_bit( found ) : high_bit( found );
+		return true;
+	}
+
+	int other = 3 - axis;
+	for( int l = 0; l != hi[ axis ] - lo[ axis ]; ++l )
+	{
+		int at = dir > 0 ? lo[ axis ] + l : hi[ axis ] - 1 - l;
+		for( int o = lo[ other ]; o != hi[ other ]; ++o )
+			if( ch.rows[ axis == 1 ? at + o * chunk_size : o + at * chunk_size ] & mask )
+			{
+				layer = at;
+				return true;
+			}
+	}
+	return false;
+}
+
+bool VoxelOccupancy::first_solid( int3 const &lo, int3 const &hi, int axis, int dir, int &layer ) const
+{
+	if( lo.x >= hi.x || lo.y >= hi.y || lo.z >= hi.z )
+		return false;
+
+	// Walk the slabs of chunks along the axis, nearest first, taking the
+	// nearest layer found in any chunk of a slab
+	int3 c0 = chunk_of( lo ), c1 = chunk_of( hi - int3( 1, 1, 1 ) );
+	int other[2] = { ( axis + 1 ) % 3, ( axis + 2 ) % 3 };
+	for( int i = 0; i <= c1[ axis ] - c0[ axis ]; ++i )
+	{
+		bool found = false;
+		int3 c;
+		c[ axis ] = dir > 0 ? c0[ axis ] + i : c1[ axis ] - i;
+		for( c[ other[1] ] = c0[ other[1] ]; c[ other[1] ] <= c1[ other[1] ]; ++c[ other[1] ] )
+			for( c[ other[0] ] = c0[ other[0] ]; c[ other[0] ] <= c1[ other[0] ]; ++c[ other[0] ] )
+			{
+				Chunk const *ch = chunk( c );
+				if( !ch )
+					continue;
+				int3 base = c * chunk_size;
+				int3 v0 = lo - base, v1 = hi - base;
+				v0 = int3( std::max( v0.x, 0 ), std::max( v0.y, 0 ), std::max( v0.z, 0 ) );
+				v1 = int3( std::min( v1.x, int( chunk_size ) ), std::min( v1.y, int( chunk_size ) ), std::min( v1.z, int( chunk_size ) ) );
+				int l;
+				if( first_in_chunk( *ch, v0, v1, axis, dir, l ) )
+				{
+					l += base[ axis ];
+					if( !found || ( dir > 0 ? l < layer : l > layer ) )
+						layer = l;
+					found = true;
+				}
+			}
+		if( found )
+			return true;
+	}
+	return false;
+}
+
+void sweep( VoxelOccupancy const &occ, VoxelBody &body )
+{
+	typedef VoxelOccupancy Occ;
+
+	// Most moves stay within one chunk, which is then looked up just once
+	float3 reach_lo( std::min( body.move.x, 0.f ), std::min( body.move.y, 0.f ), std::min( body.move.z, 0.f ) );
+	float3 reach_hi( std::max( body.move.x, 0.f ), std::max( body.move.y, 0.f ), std::max( body.move.z, 0.f ) );
+	int3 swept_lo = floor_cell( body.lo + reach_lo ), swept_hi = ceil_cell( body.hi + reach_hi ) - int3( 1, 1, 1 );
+	int3 c = Occ::chunk_of( swept_lo );
+	bool one_chunk = c == Occ::chunk_of( swept_hi );
+	Occ::Chunk const *ch = one_chunk ? occ.chunk( c ) : 0;
+	int3 base = c * Occ::chunk_size;
+
+	// The voxels the box covers, kept up to date as it moves
+	int3 covered_lo = floor_cell( body.lo ), covered_hi = ceil_cell( body.hi );
+	for( int i = 0; i != 3; ++i )
+		covered_hi[i] = std::max( covered_hi[i], covered_lo[i] + 1 );
+
+	static const int order[3] = { 1, 0, 2 };
+	body.blocked = int3( 0, 0, 0 );
+	for( int o = 0; o != 3; ++o )
+	{
+		int a = order[o];
+		float d = body.move[a];
+		if( d == 0.f )
+			continue;
+
+		// The voxels the box's leading face passes into, across the
+		// voxels it covers on the other two axes
+		int3 lo = covered_lo, hi = covered_hi;
+		if( d > 0.f )
+		{
+			lo[a] = fastceil( body.hi[a] );
+			hi[a] = fastceil( body.hi[a] + d );
+		}
+		else
+		{
+			lo[a] = fastfloor( body.lo[a] + d );
+			hi[a] = fastfloor( body.lo[a] );
+		}
+
+		int layer;
+		bool hit;
+		if( !one_chunk )
+			hit = occ.first_solid( lo, hi, a, d > 0.f ? 1 : -1, layer );
+		else if( !ch || lo[a] >= hi[a] )
+			hit = false;
+		else if( ( hit = Occ::first_in_chunk( *ch, lo - base, hi - base, a, d > 0.f ? 1 : -1, layer ) ) )
+			layer += base[a];
+
+		if( hit && d > 0.f )
+		{
+			d = std::max( std::min( float( layer ) - body.hi[a] - skin, d ), 0.f );
+			body.blocked[a] = 1;
+		}
+		else if( hit )
+		{
+			d = std::min( std::max( float( layer + 1 ) - body.lo[a] + skin, d ), 0.f );
+			body.blocked[a] = -1;
+		}
+		body.lo[a] += d;
+		body.hi[a] += d;
+		covered_lo[a] = fastfloor( body.lo[a] );
+		covered_hi[a] = std::max( fastceil( body.hi[a] ), covered_lo[a] + 1 );
+	}
+}
+
+void sweep( VoxelOccupancy const &occ, VoxelBody *bodies, int count, ThreadPool *pool )
+{
+	if( !pool )
+	{
+		for( int i = 0; i != count; ++i )
+			sweep( occ, bodies[i] );
+		return;
+	}
+
+	// Hand out runs of bodies, as a single sweep is too quick to be worth
+	// a job of its own
+	const int run = 64;
+	pool->parallel_for( ( count + run - 1 ) / run, [&]( int r )
+	{
+		for( int i = r * run; i != std::min( count, r * run + run ); ++i )
+			sweep( occ, bodies[i] );
+	} );
+}
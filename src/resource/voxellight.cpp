@@ -0,0 +1,85 @@
+#include "resource/voxellight.h"
+
+VoxelLightField::VoxelLightField( int3 const &size )
+	: m_size( size ), m_levels( size, 0 ), m_any_touched( false )
+{
+	// Outside the box reads as open sky
+	m_levels.at( -1, -1, -1 ) = max_level << 4;
+}
+
+void VoxelLightField::set( int3 const &v, int c, int level )
+{
+	unsigned char &l = m_levels.fast_at( v );
+	l = ( unsigned char )( ( l & ~( 15 << ( 4 * c ) ) ) | ( level << ( 4 * c ) ) );
+
+	VoxelRange r( v, v + int3( 1, 1, 1 ) );
+	if( m_any_touched )
+		m_touched.add( r );
+	else
+		m_touched = r;
+	m_any_touched = true;
+}
+
+void VoxelLightField::remove_pass( int c )
+{
+	// Clears the voxels lit from the removed ones. Neighbours lit as
+	// brightly or more from elsewhere go on the add queue to light the
+	// cleared area back up from the other side.
+	for( size_t head = 0; head != m_remove.size(); ++head )
+	{
+		Node r = m_remove[ head ];
+		for( int d = 0; d != 6; ++d )
+		{
+			Node n = { r.v + detail::voxel_light_dirs[d], 0 };
+			if( !inside( n.v ) || !( n.level = get( n.v, c ) ) )
+				continue;
+			if( n.level < r.level || n.level == spread( c, r.level, d ) )
+			{
+				set( n.v, c, 0 );
+				m_remove.push_back( n );
+
+				// Sources are relit as the pass reaches them
+				std::unordered_map< int3, int, ChunkHash >::const_iterator s;
+				if( c == Block && ( s = m_sources.find( n.v ) ) != m_sources.end() )
+				{
+					set( n.v, c, s->second );
+					Node l = { n.v, s->second };
+					m_add.push_back( l );
+				}
+			}
+			else
+				m_add.push_back( n );
+		}
+	}
+	m_remove.clear();
+}
+
+void VoxelLightField::flush_changed()
+{
+	if( !m_any_touched )
+		return;
+
+	// Split the area touched into the chunks it covers
+	typedef VoxelWorld< unsigned char > World;
+	int3 c0 = World::chunk_of( m_touched.lo ), c1 = World::chunk_of( m_touched.hi - int3( 1, 1, 1 ) );
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+			{
+				int3 lo = c * World::chunk_size, hi = lo + int3( World::chunk_size, World::chunk_size, World::chunk_size );
+				VoxelRange r;
+				for( int i = 0; i != 3; ++i )
+				{
+					r.lo[i] = std::max( lo[i], m_touched.lo[i] );
+					r.hi[i] = std::min( hi[i], m_touched.hi[i] );
+				}
+
+				VoxelDirtyMap::iterator d = m_changed.find( c );
+				if( d == m_changed.end() )
+					m_changed[c] = r;
+				else
+					d->second.add( r );
+			}
+	m_any_touched = false;
+}
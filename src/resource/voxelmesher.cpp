@@ -0,0 +1,217 @@
+#include "resource/voxelmesher.h"
+
+#include <unordered_set>
+
+void VoxelMeshData::clear()
+{
+	positions.clear();
+	normals.clear();
+	tangents.clear();
+	uvs.clear();
+	types.clear();
+	lights.clear();
+	occlusion.clear();
+	indices.clear();
+}
+
+void VoxelMeshData::add_quad( float3 const &c, float3 const &du, float3 const &dv, float2 const &size,
+                              char3 const &n, char3 const &t, unsigned char type )
+{
+	unsigned int base = ( unsigned int )positions.size();
+
+	positions.push_back( c );
+	positions.push_back( c + du );
+	positions.push_back( c + du + dv );
+	positions.push_back( c + dv );
+
+	uvs.push_back( float2( 0.f, 0.f ) );
+	uvs.push_back( float2( size.x, 0.f ) );
+	uvs.push_back( float2( size.x, size.y ) );
+	uvs.push_back( float2( 0.f, size.y ) );
+
+	for( int i = 0; i != 4; ++i )
+	{
+		normals.push_back( n );
+		tangents.push_back( t );
+		types.push_back( type );
+	}
+
+	unsigned int quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+	indices.insert( indices.end(), quad, quad + 6 );
+}
+
+void VoxelMeshData::light_quad( unsigned char levels )
+{
+	uchar2 l( ( unsigned char )( ( levels >> 4 ) * 17 ), ( unsigned char )( ( levels & 15 ) * 17 ) );
+	lights.insert( lights.end(), 4, l );
+}
+
+void VoxelMeshData::occlude_quad( unsigned char const ao[4] )
+{
+	for( int i = 0; i != 4; ++i )
+		occlusion.push_back( ( unsigned char )( 255 - ao[i] * 85 ) );
+
+	if( ao[0] + ao[2] > ao[1] + ao[3] )
+	{
+		unsigned int *quad = &indices[ indices.size() - 6 ];
+		unsigned int base = quad[0];
+		quad[0] = base + 1, quad[1] = base + 2, quad[2] = base + 3;
+		quad[3] = base + 1, quad[4] = base + 3, quad[5] = base;
+	}
+}
+
+namespace
+{
+struct VoxelOcclusionTable
+{
+	unsigned char table[256];
+
+	VoxelOcclusionTable()
+	{
+		// The ring runs from corner ( -a, -b ) along b's row, so each
+		// corner's voxel is between the two edge voxels beside it
+		static const int corner_voxel[4] = { 0, 2, 6, 4 };
+		for( int solid = 0; solid != 256; ++solid )
+		{
+			auto is_solid = [solid]( int r ) { return ( solid >> ( r & 7 ) ) & 1; };
+			int packed = 0;
+			for( int c = 0; c != 4; ++c )
+			{
+				int r = corner_voxel[c];
+				int side1 = is_solid( r + 7 ), side2 = is_solid( r + 1 ), corner = is_solid( r );
+				int ao = side1 && side2 ? 3 : side1 + side2 + corner;
+				packed |= ao << ( 2 * c );
+			}
+			table[ solid ] = ( unsigned char )packed;
+		}
+	}
+};
+}
+
+unsigned char const *detail::voxel_occlusion_table()
+{
+	static const VoxelOcclusionTable t;
+	return t.table;
+}
+
+Mesh make_voxel_mesh( VoxelMeshData const &data )
+{
+	Mesh mesh;
+	mesh.type = RenderTarget::Triangles;
+	mesh.vb = VertexBuffer::Ptr( new VertexBuffer );
+	mesh.vb->vertex_count( data.vertex_count() );
+
+	// Vertices are interleaved, so every attribute is added before any are
+	// written
+	auto pos_att = mesh.vb->add_attribute< float3 >( "a_position" );
+	auto norm_att = mesh.vb->add_attribute< char3 >( "a_normal" );
+	auto tan_att = mesh.vb->add_attribute< char3 >( "a_tangent" );
+	auto uv_att = mesh.vb->add_attribute< float2 >( "a_uv0" );
+	auto type_att = mesh.vb->add_attribute< unsigned char >( "a_type", false, false );
+	bool occluded = !data.occlusion.empty(), lit = !data.lights.empty();
+	VertexAttribute< unsigned char > occlusion_att;
+	VertexAttribute< uchar2 > light_att;
+	if( occluded )
+		occlusion_att = mesh.vb->add_attribute< unsigned char >( "a_occlusion" );
+	if( lit )
+		light_att = mesh.vb->add_attribute< uchar2 >( "a_light" );
+
+	auto pos_it = pos_att.begin();
+	auto norm_it = norm_att.begin();
+	auto tan_it = tan_att.begin();
+	auto uv_it = uv_att.begin();
+	auto type_it = type_att.begin();
+	VertexAttribute< unsigned char >::Iterator occlusion_it;
+	VertexAttribute< uchar2 >::Iterator light_it;
+	if( occluded )
+		occlusion_it = occlusion_att.begin();
+	if( lit )
+		light_it = light_att.begin();
+	for( int i = 0; i != data.vertex_count(); ++i )
+	{
+		*pos_it++ = data.positions[i];
+		*norm_it++ = data.normals[i];
+		*tan_it++ = data.tangents[i];
+		*uv_it++ = data.uvs[i];
+		*type_it++ = data.types[i];
+		if( occluded )
+			*occlusion_it++ = data.occlusion[i];
+		if( lit )
+			*light_it++ = data.lights[i];
+	}
+
+	mesh.ib = IndexBuffer::Ptr( new IndexBuffer( int( data.indices.size() ), data.indices.data() ) );
+	return mesh;
+}
+
+VoxelChunkMesher::VoxelChunkMesher( int chunk_size )
+	: m_chunk_size( chunk_size )
+{
+}
+
+void VoxelChunkMesher::chunks_in( int3 const &v0, int3 const &v1, std::vector< int3 > &chunks ) const
+{
+	// Rounds towards negative infinity for voxels below zero
+	auto chunk_of = [this]( int v ) { return v >= 0 ? v / m_chunk_size : ( v + 1 ) / m_chunk_size - 1; };
+
+	int3 c0( chunk_of( v0.x ), chunk_of( v0.y ), chunk_of( v0.z ) );
+	int3 c1( chunk_of( v1.x - 1 ), chunk_of( v1.y - 1 ), chunk_of( v1.z - 1 ) );
+	int3 c;
+	for( c.z = c0.z; c.z <= c1.z; ++c.z )
+		for( c.y = c0.y; c.y <= c1.y; ++c.y )
+			for( c.x = c0.x; c.x <= c1.x; ++c.x )
+				chunks.push_back( c );
+}
+
+void VoxelChunkMesher::dirty_chunks( VoxelDirtyMap const &dirty, std::vector< int3 > &chunks ) const
+{
+	// A mesh reads one voxel beyond its chunk, so grow each range by one
+	std::unordered_set< int3, ChunkHash > seen( chunks.begin(), chunks.end() );
+	std::vector< int3 > touched;
+	for( VoxelDirtyMap::const_iterator d = dirty.begin(); d != dirty.end(); ++d )
+	{
+		touched.clear();
+		chunks_in( d->second.lo - int3( 1, 1, 1 ), d->second.hi + int3( 1, 1, 1 ), touched );
+		for( size_t i = 0; i != touched.size(); ++i )
+			if( seen.insert( touched[i] ).second )
+				chunks.push_back( touched[i] );
+	}
+}
+
+void VoxelChunkMesher::lod_levels( std::vector< int3 > const &chunks, float3 const &eye, float near, int levels,
+                                   std::vector< int > &out ) const
+{
+	for( size_t i = 0; i != chunks.size(); ++i )
+	{
+		float3 lo( chunks[i] * m_chunk_size ), hi( ( chunks[i] + int3( 1, 1, 1 ) ) * m_chunk_size );
+		float3 nearest( std::min( std::max( eye.x, lo.x ), hi.x ), std::min( std::max( eye.y, lo.y ), hi.y ),
+		                std::min( std::max( eye.z, lo.z ), hi.z ) );
+		out.push_back( lod_level( length( nearest - eye ), near, levels ) );
+	}
+}
+
+int VoxelChunkMesher::mesh_level( int3 const &c ) const
+{
+	std::unordered_map< int3, int, ChunkHash >::const_iterator i = m_mesh_levels.find( c );
+	return i != m_mesh_levels.end() ? i->second : -1;
+}
+
+void VoxelChunkMesher::upload()
+{
+	for( size_t i = 0; i != m_built.size(); ++i )
+	{
+		m_mesh_levels[ m_built_chunks[i] ] = m_built_levels[i];
+		if( m_built[i].quad_count() )
+			m_meshes[ m_built_chunks[i] ] = make_voxel_mesh( m_built[i] );
+		else
+			m_meshes.erase( m_built_chunks[i] );
+	}
+	discard();
+}
+
+void VoxelChunkMesher::discard()
+{
+	m_built_chunks.clear();
+	m_built_levels.clear();
+	m_built.clear();
+}
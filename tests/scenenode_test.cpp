@@ -0,0 +1,250 @@
+// Moves, reparents and removes scene nodes at random across two scenes,
+// checking the transforms read back between changes against ones worked out
+// by walking up each node's parents, and again after update_transforms(), and
+// that a node's transform only changes when its transform_version() does.
+// Also checks the mesh and light lists and find_node() stay right as the
+// trees change, and that a matrix set with parent_from_local() reads back as
+// the rotation, scale and position it was made from, and that find_node()
+// gives the last of two nodes with the same name, as a depth first walk would.
+
+#include "resource/scenenode.h"
+#include "common/threadpool.h"
+
+#include <math.h>
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+struct Model
+{
+	std::vector< SceneNode::Ptr > nodes;
+	std::vector< int > parent; // -1 for a root, or for one removed or not in the scene
+	std::vector< bool > alive;
+
+	float44 world( int i ) const
+	{
+		float44 local = nodes[i]->parent_from_local();
+		return parent[i] < 0 ? local : world( parent[i] ) * local;
+	}
+
+	bool below( int i, int ancestor ) const
+	{
+		for( ; i >= 0; i = parent[i] )
+			if( i == ancestor )
+				return true;
+		return false;
+	}
+};
+
+float difference( float44 const &a, float44 const &b )
+{
+	float d = 0.f;
+	for( int c = 0; c != 4; ++c )
+		for( int r = 0; r != 4; ++r )
+			d = std::max( d, fabsf( a[c][r] - b[c][r] ) );
+	return d;
+}
+}
+
+int main()
+{
+	std::mt19937 rng( 7 );
+	std::uniform_real_distribution< float > unit( -1.f, 1.f );
+	ThreadPool pool( 2 );
+	Model m;
+
+	// Two scenes, nodes 0 and 1
+	const int count = 200;
+	std::vector< SceneMesh * > meshes( count, 0 );
+	std::vector< SceneLight * > lights( count, 0 );
+	for( int i = 0; i != count; ++i )
+	{
+		if( i % 3 == 2 )
+			m.nodes.push_back( SceneNode::Ptr( meshes[i] = new SceneMesh ) );
+		else if( i % 10 == 5 )
+			m.nodes.push_back( SceneNode::Ptr( lights[i] = new SceneLight ) );
+		else
+			m.nodes.push_back( SceneNode::Ptr( new SceneNode ) );
+		m.nodes.back()->name( "node " + std::to_string( i ) );
+		m.parent.push_back( -1 );
+		m.alive.push_back( true );
+		if( i >= 2 )
+		{
+			m.parent[i] = int( rng() % i );
+			m.nodes[i]->set_parent( m.nodes[ m.parent[i] ].get() );
+		}
+	}
+
+	int failures = 0;
+	std::vector< unsigned int > seen_version( count );
+	std::vector< float44 > seen_world( count );
+	auto check = [&]( int step, char const *when )
+	{
+		for( int i = 0; i != count; ++i )
+		{
+			if( !m.alive[i] )
+				continue;
+			float44 world = m.nodes[i]->world_from_local();
+			unsigned int version = m.nodes[i]->transform_version();
+			if( difference( world, m.world( i ) ) > 1e-3f )
+			{
+				printf( "node %d wrong %s at step %d\n", i, when, step );
+				++failures;
+				return;
+			}
+			if( step && version == seen_version[i] && difference( world, seen_world[i] ) > 0.f )
+			{
+				printf( "node %d moved %s at step %d without a new version\n", i, when, step );
+				++failures;
+				return;
+			}
+			seen_version[i] = version;
+			seen_world[i] = world;
+		}
+	};
+
+	// Everything below the root, or root itself
+	auto check_contents = [&]( int step, int root )
+	{
+		if( !m.alive[root] )
+			return;
+		std::vector< SceneMesh * > want_meshes, got_meshes( m.nodes[root]->meshes() );
+		std::vector< SceneLight * > want_lights, got_lights( m.nodes[root]->lights() );
+		for( int i = 0; i != count; ++i )
+			if( m.alive[i] && m.below( i, root ) )
+			{
+				if( meshes[i] )
+					want_meshes.push_back( meshes[i] );
+				if( lights[i] )
+					want_lights.push_back( lights[i] );
+				if( find_node( *m.nodes[root], ( "node " + std::to_string( i ) ).c_str() ).get() != m.nodes[i].get() )
+				{
+					printf( "find_node missed node %d below %d at step %d\n", i, root, step );
+					++failures;
+					return;
+				}
+			}
+		std::sort( want_meshes.begin(), want_meshes.end() );
+		std::sort( got_meshes.begin(), got_meshes.end() );
+		std::sort( want_lights.begin(), want_lights.end() );
+		std::sort( got_lights.begin(), got_lights.end() );
+		if( want_meshes != got_meshes || want_lights != got_lights )
+		{
+			printf( "%d meshes and %d lights below %d at step %d, not %d and %d\n", int( got_meshes.size() ),
+			        int( got_lights.size() ), root, step, int( want_meshes.size() ), int( want_lights.size() ) );
+			++failures;
+		}
+	};
+
+	for( int step = 0; step != 2000 && !failures; ++step )
+	{
+		int i = int( rng() % count );
+		if( !m.alive[i] )
+			continue;
+		switch( rng() % 8 )
+		{
+		case 0:
+		case 1:
+			m.nodes[i]->position( float3( unit( rng ), unit( rng ), unit( rng ) ) );
+			break;
+		case 2:
+		{
+			float a = unit( rng );
+			m.nodes[i]->rotation( floatq( 0.f, sinf( a ), 0.f, cosf( a ) ) );
+			break;
+		}
+		case 3:
+			m.nodes[i]->scale( float3( 1.f + 0.5f * unit( rng ), 1.f, 1.f ) );
+			break;
+		case 4:
+		{
+			float a = unit( rng );
+			floatq q( 0.f, 0.f, sinf( a ), cosf( a ) );
+			float3 s( 1.f + 0.5f * unit( rng ), 1.f, 2.f ), p( unit( rng ), unit( rng ), unit( rng ) );
+			float44 t;
+			to_matrix( q, t );
+			t = t * scale( float4( s, 1.f ) );
+			t.t = float4( p, 1.f );
+			m.nodes[i]->parent_from_local( t );
+
+			// q and -q are the same rotation
+			float3 ds = m.nodes[i]->scale() - s, dp = m.nodes[i]->position() - p;
+			if( fabsf( fabsf( dot( m.nodes[i]->rotation(), q ) ) - 1.f ) > 1e-3f ||
+			    std::max( fabsf( ds.x ), std::max( fabsf( ds.y ), fabsf( ds.z ) ) ) > 1e-3f ||
+			    std::max( fabsf( dp.x ), std::max( fabsf( dp.y ), fabsf( dp.z ) ) ) > 1e-3f )
+			{
+				printf( "node %d parts read back wrong at step %d\n", i, step );
+				++failures;
+			}
+			break;
+		}
+		case 5:
+		{
+			// Into either scene, or another tree, but not below itself
+			int p = int( rng() % count );
+			if( m.alive[p] && !m.below( p, i ) )
+			{
+				m.nodes[i]->set_parent( m.nodes[p].get() );
+				m.parent[i] = p;
+			}
+			break;
+		}
+		case 6:
+			m.nodes[i]->set_parent( 0 );
+			m.parent[i] = -1;
+			break;
+		case 7:
+			// Removing a node makes its children roots
+			if( i >= 2 && rng() % 4 == 0 )
+			{
+				m.nodes[i]->set_parent( 0 );
+				m.nodes[i].set( 0 );
+				meshes[i] = 0;
+				lights[i] = 0;
+				m.alive[i] = false;
+				for( int c = 0; c != count; ++c )
+					if( m.parent[c] == i )
+						m.parent[c] = -1;
+			}
+			break;
+		}
+
+		// Reads between changes, then after updating one scene or the other,
+		// or a tree detached from them
+		if( step % 5 == 0 )
+			check( step, "before update" );
+		if( step % 5 == 0 )
+		{
+			int root = int( rng() % count );
+			check_contents( step, step % 10 ? root % 2 : root );
+		}
+		if( step % 25 == 0 )
+		{
+			int root = step % 50 ? step % 100 == 25 ? 0 : 1 : int( rng() % count );
+			if( m.alive[root] && m.parent[root] < 0 )
+			{
+				update_transforms( *m.nodes[root], pool );
+				check( step, "after update" );
+			}
+		}
+	}
+
+	// root, first, middle, last in a depth first walk
+	SceneNode::Ptr root( new SceneNode ), first( new SceneNode ), middle( new SceneNode ), last( new SceneNode );
+	first->name( "twin" );
+	last->name( "twin" );
+	first->set_parent( root.get() );
+	middle->set_parent( root.get() );
+	last->set_parent( middle.get() );
+	if( find_node( *root, "twin" ).get() != last.get() )
+	{
+		printf( "find_node didn't give the last node named twin\n" );
+		++failures;
+	}
+
+	return failures ? 1 : 0;
+}
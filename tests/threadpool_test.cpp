@@ -0,0 +1,40 @@
+// Checks ThreadPool::parallel_for calls func once for each index, including
+// the edge cases of no indices and a single one, which have no helpers.
+
+#include "common/threadpool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+int main()
+{
+	int failures = 0;
+	ThreadPool pool( 4 );
+
+	for( int n = -1; n != 3; ++n )
+	{
+		std::atomic< int > calls( 0 );
+		pool.parallel_for( n, [&calls]( int ) { ++calls; } );
+		if( calls != std::max( n, 0 ) )
+		{
+			printf( "parallel_for( %d ) made %d calls\n", n, int( calls ) );
+			++failures;
+		}
+	}
+
+	const int count = 1000;
+	std::vector< std::atomic< int > > hits( count );
+	for( int i = 0; i != count; ++i )
+		hits[i] = 0;
+	pool.parallel_for( count, [&hits]( int i ) { ++hits[i]; } );
+	for( int i = 0; i != count; ++i )
+		if( hits[i] != 1 )
+		{
+			printf( "parallel_for( %d ) called index %d %d times\n", count, i, int( hits[i] ) );
+			++failures;
+		}
+
+	return failures ? 1 : 0;
+}
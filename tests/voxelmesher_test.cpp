@@ -0,0 +1,73 @@
+// Meshes a lit chunk with ambient occlusion and checks make_voxel_mesh copies
+// every attribute of every vertex into the interleaved vertex buffer.
+
+#include "resource/voxelmesher.h"
+
+#include <cstdio>
+#include <cstring>
+
+template< typename T >
+int check_attribute( VertexBuffer &vb, int index, char const *name, std::vector< T > const &expected )
+{
+	auto it = vb.attribute_begin< T >( index );
+	for( size_t i = 0; i != expected.size(); ++i, ++it )
+		if( memcmp( &*it, &expected[i], sizeof( T ) ) != 0 )
+		{
+			printf( "%s differs at vertex %d\n", name, int( i ) );
+			return 1;
+		}
+	return 0;
+}
+
+int main()
+{
+	// A floor with a block standing on it, so the floor around the block is
+	// occluded, lit differently along x and z
+	VoxelBox< unsigned char > vol( 6, 4, 6 ), light( 6, 4, 6 );
+	fill( vol, ( unsigned char )1, int3( 0, 0, 0 ), int3( 6, 1, 6 ) );
+	vol.at( 2, 1, 3 ) = 2;
+	for( int z = 0; z != 6; ++z )
+		for( int y = 0; y != 4; ++y )
+			for( int x = 0; x != 6; ++x )
+				light.at( x, y, z ) = ( unsigned char )( ( ( 15 - x - y ) << 4 ) | z );
+
+	VoxelMeshData data;
+	greedy_mesh( vol, int3( 0, 0, 0 ), int3( 6, 4, 6 ), data, &light );
+
+	int failures = 0;
+	int n = data.vertex_count();
+	bool shaded = false;
+	for( int i = 0; i != int( data.occlusion.size() ); ++i )
+		shaded = shaded || data.occlusion[i] != 255;
+	if( !n || int( data.lights.size() ) != n || int( data.occlusion.size() ) != n || !shaded )
+	{
+		printf( "mesh has %d vertices, %d lit and %d occluded, %s shaded\n", n, int( data.lights.size() ),
+		        int( data.occlusion.size() ), shaded ? "some" : "none" );
+		++failures;
+	}
+
+	Mesh mesh = make_voxel_mesh( data );
+	VertexBuffer &vb = *mesh.vb;
+	if( vb.vertex_count() != n )
+	{
+		printf( "vertex buffer has %d vertices, not %d\n", vb.vertex_count(), n );
+		++failures;
+	}
+
+	// In the order make_voxel_mesh adds them
+	failures += check_attribute( vb, 0, "a_position", data.positions );
+	failures += check_attribute( vb, 1, "a_normal", data.normals );
+	failures += check_attribute( vb, 2, "a_tangent", data.tangents );
+	failures += check_attribute( vb, 3, "a_uv0", data.uvs );
+	failures += check_attribute( vb, 4, "a_type", data.types );
+	failures += check_attribute( vb, 5, "a_occlusion", data.occlusion );
+	failures += check_attribute( vb, 6, "a_light", data.lights );
+
+	if( mesh.ib->count() != int( data.indices.size() ) )
+	{
+		printf( "index buffer has %d indices, not %d\n", mesh.ib->count(), int( data.indices.size() ) );
+		++failures;
+	}
+
+	return failures ? 1 : 0;
+}